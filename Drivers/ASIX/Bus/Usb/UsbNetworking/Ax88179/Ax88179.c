@@ -934,6 +934,80 @@ Ax88179GetLinkStatus (
 
 }
 
+/**
+  Parse the frames aggregated in a bulk IN transfer.
+
+  The transfer ends with a trailer holding the number of frames and the
+  offset of their descriptors, one 32-bit descriptor per frame. Each frame
+  starts with two bytes of 0xEE padding and is 8-byte aligned. The whole
+  transfer is parsed at once, so that Receive only has to copy the frames
+  out, and a bad frame only costs that frame rather than the rest of the
+  transfer.
+
+  @param [in] NicDevice       Pointer to the NIC_DEVICE structure
+  @param [in] Length          Length of the bulk IN transfer in bytes
+
+  @retval EFI_SUCCESS         At least one valid frame was found.
+  @retval EFI_NOT_READY       The transfer is malformed or holds no valid frame.
+
+**/
+STATIC
+EFI_STATUS
+Ax88179ParseBulkIn (
+  IN NIC_DEVICE *NicDevice,
+  IN UINTN      Length
+  )
+{
+  UINT8   *Buffer;
+  UINT16  HwPktCnt;
+  UINT16  HdrOff;
+  UINT16  PktHdr;
+  UINT16  PktLen;
+  UINTN   Offset;
+  UINTN   Index;
+
+  NicDevice->PktCnt = 0;
+  NicDevice->CurPkt = 0;
+
+  if (Length < 4) {
+    return EFI_NOT_READY;
+  }
+
+  Buffer = NicDevice->BulkInbuf;
+  HwPktCnt = ReadUnaligned16 ((UINT16 *)(Buffer + Length - 4));
+  HdrOff = ReadUnaligned16 ((UINT16 *)(Buffer + Length - 2));
+
+  if (((UINTN)(((HwPktCnt * 4 + 4 + 7) & 0xfff8) + HdrOff)) != Length) {
+    return EFI_NOT_READY;
+  }
+
+  Offset = 0;
+  for (Index = 0; Index < HwPktCnt; Index++) {
+    PktHdr = ReadUnaligned16 ((UINT16 *)(Buffer + HdrOff + Index * 4 + 2));
+    PktLen = PktHdr & 0x1fff;
+    if (PktLen < 2 || Offset + PktLen > HdrOff) {
+      break;
+    }
+
+    //
+    //  The length includes the 0xEEEE padding
+    //
+    if ((PktHdr & (RXHDR_DROP | RXHDR_CRCERR)) == 0 &&
+        (60 + 2) <= PktLen &&
+        (PktLen - 2 - 14) <= MAX_ETHERNET_PKT_SIZE &&
+        ReadUnaligned16 ((UINT16 *)(Buffer + Offset)) == 0xEEEE &&
+        NicDevice->PktCnt < AX88179_MAX_RX_PKTS) {
+      NicDevice->RxPkts[NicDevice->PktCnt].Data = Buffer + Offset + 2;
+      NicDevice->RxPkts[NicDevice->PktCnt].Length = PktLen - 2;
+      NicDevice->PktCnt++;
+    }
+
+    Offset += (PktLen + 7) & 0xfff8;
+  }
+
+  return (NicDevice->PktCnt != 0) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
 EFI_STATUS
 Ax88179BulkIn(
   IN NIC_DEVICE *NicDevice
@@ -1018,25 +1092,52 @@ Ax88179BulkIn(
 
 done:
   if (LengthInBytes != 0) {
-    UINT16 tmplen = 0;
-    UINT16 TmpPktCnt = 0;
-
-    TmpPktCnt = *((UINT16 *) (NicDevice->BulkInbuf + LengthInBytes - 4));
-    tmplen =  *((UINT16*) (NicDevice->BulkInbuf + LengthInBytes - 2));
-
-    if (((UINTN)(((TmpPktCnt * 4 + 4 + 7) & 0xfff8) + tmplen)) == LengthInBytes) {
-      NicDevice->PktCnt = TmpPktCnt;
-      NicDevice->CurPktHdrOff = NicDevice->BulkInbuf + tmplen;
-      NicDevice->CurPktOff = NicDevice->BulkInbuf;
-      *((UINT16 *) (NicDevice->BulkInbuf + LengthInBytes - 4)) = 0;
-      *((UINT16*) (NicDevice->BulkInbuf + LengthInBytes - 2)) = 0;
-      Status = EFI_SUCCESS;
-    } else {
-      Status = EFI_NOT_READY;
-    }
+    Status = Ax88179ParseBulkIn (NicDevice, LengthInBytes);
   } else {
     Status = EFI_NOT_READY;
   }
 no_pkt:
    return Status;
 }
+
+#if RX_BENCHMARK
+/**
+  Account for a received frame, and report the receive throughput at the
+  end of each benchmark period.
+
+  @param [in] NicDevice       Pointer to the NIC_DEVICE structure
+  @param [in] Length          Length of the received frame in bytes
+
+**/
+VOID
+Ax88179RxBenchmark (
+  IN NIC_DEVICE *NicDevice,
+  IN UINTN      Length
+  )
+{
+  UINT64  Now;
+  UINT64  Elapsed;
+  UINT64  KBps;
+
+  Now = GetTimeInNanoSecond (GetPerformanceCounter ());
+  NicDevice->RxBenchFrames++;
+  NicDevice->RxBenchBytes += Length;
+
+  Elapsed = Now - NicDevice->RxBenchStart;
+  if (Elapsed < RX_BENCHMARK_PERIOD) {
+    return;
+  }
+
+  if (NicDevice->RxBenchStart != 0) {
+    KBps = DivU64x64Remainder (MultU64x32 (NicDevice->RxBenchBytes, 1000000), Elapsed, NULL);
+    DEBUG ((DEBUG_INFO, "Ax88179: RX %Ld frames/s, %Ld.%03Ld MB/s\r\n",
+            DivU64x64Remainder (MultU64x32 (NicDevice->RxBenchFrames, 1000000000), Elapsed, NULL),
+            DivU64x32 (KBps, 1000),
+            ModU64x32 (KBps, 1000)));
+  }
+
+  NicDevice->RxBenchStart = Now;
+  NicDevice->RxBenchFrames = 0;
+  NicDevice->RxBenchBytes = 0;
+}
+#endif
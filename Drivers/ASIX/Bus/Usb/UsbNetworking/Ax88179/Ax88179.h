@@ -17,10 +17,12 @@
 
 #include <IndustryStandard/Pci.h>
 
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/DevicePathLib.h>
 #include <Library/NetLib.h>
+#include <Library/TimerLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/UefiLib.h>
@@ -72,12 +74,15 @@
 #define AX88179_BULKIN_SIZE_INK     2
 #define AX88179_MAX_BULKIN_SIZE    (1024 * AX88179_BULKIN_SIZE_INK)
 #define AX88179_MAX_PKT_SIZE  2048
+#define AX88179_MAX_RX_PKTS   (AX88179_MAX_BULKIN_SIZE / 64)  ///<  Bulk IN holds frames of at least 64 bytes, padding included
 
 #define HC_DEBUG        0
 #define ADD_MACPATHNOD  1
 #define BULKIN_TIMEOUT  3 //5000
 #define TX_RETRY        0
 #define AUTONEG_DELAY   1000000
+#define RX_BENCHMARK    0 //  Report the receive throughput every RX_BENCHMARK_PERIOD
+#define RX_BENCHMARK_PERIOD  1000000000ULL  ///<  In nanoseconds
 
 /**
   Verify new TPL value
@@ -234,6 +239,14 @@ typedef struct _RX_PACKET {
 } RX_PACKET;
 #pragma pack()
 
+/**
+  Received frame, within the bulk IN buffer
+**/
+typedef struct {
+  UINT8   *Data;    ///<  Start of the Ethernet frame
+  UINT16  Length;   ///<  Length of the Ethernet frame in bytes
+} RX_PKT_DESC;
+
 /**
   AX88179 control structure
 
@@ -275,9 +288,15 @@ typedef struct {
   UINTN                     SkipRXCnt;
 
   UINT8                     *BulkInbuf;
-  UINT16                    PktCnt;
-  UINT8                     *CurPktHdrOff;
-  UINT8                     *CurPktOff;
+  UINT16                    PktCnt;             ///<  Number of frames not yet returned by Receive
+  UINT16                    CurPkt;             ///<  Next frame returned by Receive
+  RX_PKT_DESC               RxPkts[AX88179_MAX_RX_PKTS];  ///<  Valid frames of the last bulk IN
+
+#if RX_BENCHMARK
+  UINT64                    RxBenchStart;       ///<  Start of the current period, in nanoseconds
+  UINT64                    RxBenchFrames;      ///<  Frames received in the current period
+  UINT64                    RxBenchBytes;       ///<  Bytes received in the current period
+#endif
 
   TX_PACKET                 *TxTest;
 
@@ -1049,5 +1068,13 @@ Ax88179BulkIn(
   IN NIC_DEVICE *NicDevice
 );
 
+#if RX_BENCHMARK
+VOID
+Ax88179RxBenchmark (
+  IN NIC_DEVICE *NicDevice,
+  IN UINTN      Length
+  );
+#endif
+
 
 #endif  //  AX88179_H_
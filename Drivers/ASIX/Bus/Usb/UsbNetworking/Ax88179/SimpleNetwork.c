@@ -527,8 +527,7 @@ SN_Receive (
   NIC_DEVICE              *NicDevice;
   EFI_STATUS              Status;
   UINT16                  Type = 0;
-  UINT16                  CurrentPktLen;
-  BOOLEAN                 Valid = TRUE;
+  RX_PKT_DESC             *Pkt;
   EFI_TPL                 TplPrevious;
 
   TplPrevious = gBS->RaiseTPL (TPL_CALLBACK);
@@ -570,47 +569,40 @@ SN_Receive (
           if (EFI_ERROR(Status))
             goto  no_pkt;
         }
-        CurrentPktLen = *((UINT16*) (NicDevice->CurPktHdrOff + 2));
-        if (CurrentPktLen & (RXHDR_DROP | RXHDR_CRCERR))
-          Valid = FALSE;
-        CurrentPktLen &=  0x1fff;
-        CurrentPktLen -= 2; /*EEEE*/
-
-        if (Valid && (60 <= CurrentPktLen) &&
-        ((CurrentPktLen - 14) <= MAX_ETHERNET_PKT_SIZE) &&
-            (*((UINT16*)NicDevice->CurPktOff)) == 0xEEEE) {
-          if (*BufferSize < (UINTN)CurrentPktLen) {
-            gBS->RestoreTPL (TplPrevious);
-            return EFI_BUFFER_TOO_SMALL;
-          }
-          *BufferSize = CurrentPktLen;
-          CopyMem (Buffer, NicDevice->CurPktOff + 2, CurrentPktLen);
+        //
+        //  The frames were validated when the bulk IN was parsed
+        //
+        Pkt = &NicDevice->RxPkts[NicDevice->CurPkt];
+        if (*BufferSize < (UINTN)Pkt->Length) {
+          gBS->RestoreTPL (TplPrevious);
+          return EFI_BUFFER_TOO_SMALL;
+        }
+        *BufferSize = Pkt->Length;
+        CopyMem (Buffer, Pkt->Data, Pkt->Length);
 
-          Header = (ETHERNET_HEADER *) NicDevice->CurPktOff + 2;
+        Header = (ETHERNET_HEADER *) Pkt->Data;
 
-          if ((HeaderSize != NULL)  && ((*HeaderSize != 7720))) {
-            *HeaderSize = sizeof (*Header);
-          }
+        if ((HeaderSize != NULL)  && ((*HeaderSize != 7720))) {
+          *HeaderSize = sizeof (*Header);
+        }
 
-          if (DestAddr != NULL) {
-            CopyMem (DestAddr, &Header->DestAddr, PXE_HWADDR_LEN_ETHER);
-          }
-          if (SrcAddr != NULL) {
-            CopyMem (SrcAddr, &Header->SrcAddr, PXE_HWADDR_LEN_ETHER);
-          }
-          if (Protocol != NULL) {
-            Type = Header->Type;
-            Type = (UINT16)((Type >> 8) | (Type << 8));
-            *Protocol = Type;
-          }
-          NicDevice->PktCnt--;
-          NicDevice->CurPktHdrOff += 4;
-          NicDevice->CurPktOff += (CurrentPktLen + 2 + 7) & 0xfff8;
-          Status = EFI_SUCCESS;
-        } else {
-          NicDevice->PktCnt = 0;
-          Status = EFI_NOT_READY;
+        if (DestAddr != NULL) {
+          CopyMem (DestAddr, &Header->DestAddr, PXE_HWADDR_LEN_ETHER);
         }
+        if (SrcAddr != NULL) {
+          CopyMem (SrcAddr, &Header->SrcAddr, PXE_HWADDR_LEN_ETHER);
+        }
+        if (Protocol != NULL) {
+          Type = Header->Type;
+          Type = (UINT16)((Type >> 8) | (Type << 8));
+          *Protocol = Type;
+        }
+#if RX_BENCHMARK
+        Ax88179RxBenchmark (NicDevice, Pkt->Length);
+#endif
+        NicDevice->PktCnt--;
+        NicDevice->CurPkt++;
+        Status = EFI_SUCCESS;
       } else {
         Status = EFI_NOT_READY;
       }
@@ -968,6 +960,7 @@ SN_Setup (
   NicDevice->Grub_f = FALSE;
   NicDevice->FirstRst = TRUE;
   NicDevice->PktCnt = 0;
+  NicDevice->CurPkt = 0;
   NicDevice->SkipRXCnt = 0;
   NicDevice->UsbMaxPktSize = 512;
   NicDevice->SetZeroLen = TRUE;
@@ -69,6 +69,28 @@ CheckBounds (
   return EFI_SUCCESS;
 }
 
+/**
+ * Record that lines of the local copy of the Frame Buffer have changed, so that they are
+ * sent in the next screen update.
+ * @param UsbDisplayLinkDev
+ * @param Y                First line that changed
+ * @param Height           Number of lines that changed
+ */
+STATIC VOID
+DlGopMarkDirty (
+  IN  USB_DISPLAYLINK_DEV                     *UsbDisplayLinkDev,
+  IN  UINTN                                   Y,
+  IN  UINTN                                   Height
+)
+{
+  if (Y < UsbDisplayLinkDev->LastY1) {
+    UsbDisplayLinkDev->LastY1 = Y;
+  }
+  if ((Y + Height) > UsbDisplayLinkDev->LastY2) {
+    UsbDisplayLinkDev->LastY2 = Y + Height;
+  }
+}
+
 /**
  * Update the local copy of the Frame Buffer. This local copy is periodically transmitted to the
  * DisplayLink device (via DlGopSendScreenUpdate)
@@ -122,12 +144,7 @@ BuildBackBuffer (
   case EfiBltBufferToVideo:
   {
     // Update the store of the area of the screen that is "dirty" - that we need to send in the next screen update.
-    if (DestinationY < UsbDisplayLinkDev->LastY1) {
-      UsbDisplayLinkDev->LastY1 = DestinationY;
-    }
-    if ((DestinationY + Height) > UsbDisplayLinkDev->LastY2) {
-      UsbDisplayLinkDev->LastY2 = DestinationY + Height;
-    }
+    DlGopMarkDirty (UsbDisplayLinkDev, DestinationY, Height);
 
     EFI_GRAPHICS_OUTPUT_BLT_PIXEL* Blt;
     EFI_GRAPHICS_OUTPUT_BLT_PIXEL* DstB;
@@ -146,6 +163,8 @@ BuildBackBuffer (
 
   case EfiBltVideoToVideo:
   {
+    DlGopMarkDirty (UsbDisplayLinkDev, DestinationY, Height);
+
     EFI_GRAPHICS_OUTPUT_BLT_PIXEL* SrcB;
     EFI_GRAPHICS_OUTPUT_BLT_PIXEL* DstB;
     SrcB = UsbDisplayLinkDev->Screen + SourceY * PixelsPerScanLine + SourceX;
@@ -163,6 +182,8 @@ BuildBackBuffer (
 
   case EfiBltVideoFill:
   {
+    DlGopMarkDirty (UsbDisplayLinkDev, DestinationY, Height);
+
     EFI_GRAPHICS_OUTPUT_BLT_PIXEL* DstB;
     DstB = UsbDisplayLinkDev->Screen + DestinationY * PixelsPerScanLine + DestinationX;
     for (H = 0; H < Height; H++) {
@@ -251,6 +272,56 @@ DlGopSendTestPattern (
 }
 
 
+/**
+ * Convert a line of pixels from the BLT format (BGRA, 32 bits per pixel) to the format sent to
+ * the DisplayLink device (RGB, 24 bits per pixel). Four pixels are packed into three 32-bit words
+ * at a time, rather than byte by byte.
+ * @param Dst
+ * @param Src
+ * @param Count           Number of pixels
+ */
+STATIC VOID
+DlGopConvertLine (
+  OUT UINT8                                   *Dst,
+  IN  CONST EFI_GRAPHICS_OUTPUT_BLT_PIXEL     *Src,
+  IN  UINTN                                   Count
+)
+{
+  CONST UINT32* Src32;
+  UINT32 P0;
+  UINT32 P1;
+  UINT32 P2;
+  UINT32 P3;
+
+  // Pixels are read as little-endian 0xXXRRGGBB words, and turned into 0x00BBGGRR
+  // so that R, G and B end up in that order in memory.
+#define BGRA_TO_RGB24(Pixel)  ((((Pixel) >> 16) & 0xFF) | ((Pixel) & 0xFF00) | (((Pixel) & 0xFF) << 16))
+
+  Src32 = (CONST UINT32 *)Src;
+  for (; Count >= 4; Count -= 4) {
+    P0 = BGRA_TO_RGB24 (Src32[0]);
+    P1 = BGRA_TO_RGB24 (Src32[1]);
+    P2 = BGRA_TO_RGB24 (Src32[2]);
+    P3 = BGRA_TO_RGB24 (Src32[3]);
+    WriteUnaligned32 ((UINT32 *)Dst, P0 | (P1 << 24));
+    WriteUnaligned32 ((UINT32 *)(Dst + 4), (P1 >> 8) | (P2 << 16));
+    WriteUnaligned32 ((UINT32 *)(Dst + 8), (P2 >> 16) | (P3 << 8));
+    Src32 += 4;
+    Dst += 12;
+  }
+
+#undef BGRA_TO_RGB24
+
+  Src = (CONST EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Src32;
+  for (; Count > 0; Count--) {
+    Dst[0] = Src->Red;
+    Dst[1] = Src->Green;
+    Dst[2] = Src->Blue;
+    Src++;
+    Dst += 3;
+  }
+}
+
 /**
  * Transfer the latest copy of the Blt buffer over USB to the DisplayLink device
  * @param UsbDisplayLinkDev
@@ -263,83 +334,131 @@ DlGopSendScreenUpdate (
 {
   EFI_STATUS Status;
   UINT32 USBStatus;
+  UINTN DataLen;
+  UINTN LineLen;
+  UINTN BufferSize;
+  UINTN Width;
+  UINTN Height;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL* Screen;
+  UINTN H;
+  UINTN Lines;
+  UINTN Line;
+  UINTN DirtyY1;
+  UINTN DirtyY2;
+  EFI_TPL OriginalTPL;
+
   Status = EFI_SUCCESS;
 
+  OriginalTPL = gBS->RaiseTPL (TPL_NOTIFY);
+  Width = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->HorizontalResolution;
+  Height = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->VerticalResolution;
+  Screen = UsbDisplayLinkDev->Screen;
+  gBS->RestoreTPL (OriginalTPL);
+
+  DataLen = Width * 3; // Send 1 line @ 24 bits per pixel
+  LineLen = DataLen;
+  // If the line length is a multiple of USB MaxPacketSize, send two spare bytes along with it so
+  // that the transfer still ends with a short packet. They just get written into the (invisible)
+  // stride area. This saves a separate transfer per line, as the API doesn't let us do a bulk write of 0.
+  if ((DataLen & (UsbDisplayLinkDev->BulkOutEndpointDescriptor.MaxPacketSize - 1)) == 0) {
+    LineLen += 2;
+  }
+
+  // The staging buffer is only used from here, so it is (re)sized here rather than in SetMode,
+  // which may run while a frame is being sent.
+  BufferSize = DISPLAYLINK_LINES_PER_CONVERSION * LineLen;
+  if (UsbDisplayLinkDev->TransferBufferSize < BufferSize) {
+    if (UsbDisplayLinkDev->TransferBuffer != NULL) {
+      FreePool (UsbDisplayLinkDev->TransferBuffer);
+    }
+    UsbDisplayLinkDev->TransferBuffer = AllocateZeroPool (BufferSize);
+    if (UsbDisplayLinkDev->TransferBuffer == NULL) {
+      UsbDisplayLinkDev->TransferBufferSize = 0;
+      return EFI_OUT_OF_RESOURCES;
+    }
+    UsbDisplayLinkDev->TransferBufferSize = BufferSize;
+  }
+
+  OriginalTPL = gBS->RaiseTPL (TPL_NOTIFY);
+
   // If it has been a while since we sent an update, send a full screen.
   // This allows us to update a hot-plugged monitor quickly.
   if (UsbDisplayLinkDev->TimeSinceLastScreenUpdate > DISPLAYLINK_FULL_SCREEN_UPDATE_PERIOD) {
     UsbDisplayLinkDev->LastY1 = 0;
-    UsbDisplayLinkDev->LastY2 = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->HorizontalResolution - 1;
+    UsbDisplayLinkDev->LastY2 = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->VerticalResolution;
   }
 
   // If there has been no BLT since the last update/poll, drop out quietly.
-  if (UsbDisplayLinkDev->LastY2 < UsbDisplayLinkDev->LastY1) {
+  if (UsbDisplayLinkDev->LastY2 <= UsbDisplayLinkDev->LastY1) {
     UsbDisplayLinkDev->TimeSinceLastScreenUpdate += (DISPLAYLINK_SCREEN_UPDATE_TIMER_PERIOD / 1000);  // Convert us to ms
+    gBS->RestoreTPL (OriginalTPL);
     return EFI_SUCCESS;
   }
 
   UsbDisplayLinkDev->TimeSinceLastScreenUpdate = 0;
 
-  EFI_TPL OriginalTPL = gBS->RaiseTPL (TPL_NOTIFY);
+  // Take ownership of the damaged area, so that BLTs made while this frame is being sent are
+  // picked up by the next screen update rather than lost when this one completes.
+  DirtyY1 = UsbDisplayLinkDev->LastY1;
+  DirtyY2 = UsbDisplayLinkDev->LastY2;
+  UsbDisplayLinkDev->LastY2 = 0;
+  UsbDisplayLinkDev->LastY1 = (UINTN)-1;
 
-  UINTN DataLen;
-  UINTN Width;
-  UINTN Height;
-  EFI_GRAPHICS_OUTPUT_BLT_PIXEL* SrcPtr;
-  UINT8* DstPtr;
-  UINT8 DstBuffer[1920 * 3]; // Get rid of the magic numbers at some point
-                             // Could also use a buffer allocated at runtime to store the line, stored in the USB_DISPLAYLINK_DEV structure.
-  UINTN H;
+  gBS->RestoreTPL (OriginalTPL);
 
-  DataLen = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->HorizontalResolution * 3; // Send 1 line @ 24 bits per pixel
-  Width = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->HorizontalResolution;
-  Height = UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->VerticalResolution;
-  SrcPtr = UsbDisplayLinkDev->Screen;
-  DstPtr = DstBuffer;
-
-  for (H = 0; H < Height; H++) {
-    DstPtr = DstBuffer;
-
-    UINTN W;
-    for (W = 0; W < Width; W++) {
-      // Need to swap round the RGB values
-      DstPtr[0] = ((UINT8 *)SrcPtr)[2];
-      DstPtr[1] = ((UINT8 *)SrcPtr)[1];
-      DstPtr[2] = ((UINT8 *)SrcPtr)[0];
-      SrcPtr++;
-      DstPtr += 3;
-    }
+  for (H = 0; H < Height; H += Lines) {
+    Lines = MIN (DISPLAYLINK_LINES_PER_CONVERSION, Height - H);
 
-    Status = DlUsbBulkWrite (UsbDisplayLinkDev, DstBuffer, DataLen, &USBStatus);
+    // Only lock out BLTs while lines are converted, not for the USB transfers. The DisplayLink
+    // stream has no addressing, so each frame still carries every line, but TPL_NOTIFY events
+    // (USB keyboard polling for instance) can now run in between.
+    OriginalTPL = gBS->RaiseTPL (TPL_NOTIFY);
 
-    // USBStatus values defined in usbio.h, e.g. EFI_USB_ERR_TIMEOUT 0x40
-    if (EFI_ERROR (Status)) {
-      DEBUG ((DEBUG_ERROR, "Screen update - USB bulk transfer of pixel data failed. Line %d len %d, failure code %r USB status x%x\n", H, DataLen, Status, USBStatus));
+    // Give up on this frame if the mode was changed under us.
+    if (UsbDisplayLinkDev->Screen != Screen ||
+        UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->HorizontalResolution != Width ||
+        UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info->VerticalResolution != Height) {
+      gBS->RestoreTPL (OriginalTPL);
+      Status = EFI_ABORTED;
       break;
     }
-    // Need an extra DlUsbBulkWrite if the data length is divisible by USB MaxPacketSize. This spare data will just get written into the (invisible) stride area.
-    // Note that the API doesn't let us do a bulk write of 0.
-    if ((DataLen & (UsbDisplayLinkDev->BulkOutEndpointDescriptor.MaxPacketSize - 1)) == 0) {
-      Status = DlUsbBulkWrite (UsbDisplayLinkDev, DstBuffer, 2, &USBStatus);
+
+    for (Line = 0; Line < Lines; Line++) {
+      DlGopConvertLine (UsbDisplayLinkDev->TransferBuffer + Line * LineLen, Screen + (H + Line) * Width, Width);
+    }
+
+    gBS->RestoreTPL (OriginalTPL);
+
+    // Each line has to go in a transfer of its own, as the device takes the short packet that
+    // ends a transfer as the end of a line.
+    for (Line = 0; Line < Lines; Line++) {
+      Status = DlUsbBulkWrite (UsbDisplayLinkDev, UsbDisplayLinkDev->TransferBuffer + Line * LineLen, LineLen, &USBStatus);
+
+      // USBStatus values defined in usbio.h, e.g. EFI_USB_ERR_TIMEOUT 0x40
       if (EFI_ERROR (Status)) {
-        DEBUG ((DEBUG_ERROR, "Screen update - USB bulk transfer of pixel data failed. Line %d len %d, failure code %r USB status x%x\n", H, DataLen, Status, USBStatus));
+        DEBUG ((DEBUG_ERROR, "Screen update - USB bulk transfer of pixel data failed. Line %d len %d, failure code %r USB status x%x\n", H + Line, LineLen, Status, USBStatus));
         break;
       }
     }
+
+    if (EFI_ERROR (Status)) {
+      break;
+    }
   }
 
-  if (!EFI_ERROR (Status)) {
-    // If we've successfully transmitted the frame, reset the values that store which area of the screen has been BLTted to.
-    // If we haven't succeeded, this will mean we'll try to resend it after the next poll period.
-    UsbDisplayLinkDev->LastY2 = 0;
-    UsbDisplayLinkDev->LastY1 = (UINTN)-1;
+  if (EFI_ERROR (Status)) {
+    // If we haven't succeeded, merge the area we were sending back in, so that we'll try to
+    // resend it after the next poll period.
+    OriginalTPL = gBS->RaiseTPL (TPL_NOTIFY);
+    DlGopMarkDirty (UsbDisplayLinkDev, DirtyY1, DirtyY2 - DirtyY1);
+    gBS->RestoreTPL (OriginalTPL);
+  } else {
+    UsbDisplayLinkDev->FramesSent++;
   }
 
   // Payload with length of 1 to terminate the frame
   // We need to do this even if we had an error, to indicate to the DL device that it should now expect a new frame.
-  DlUsbBulkWrite (UsbDisplayLinkDev, DstBuffer, 1, &USBStatus);
-
-  gBS->RestoreTPL (OriginalTPL);
+  DlUsbBulkWrite (UsbDisplayLinkDev, UsbDisplayLinkDev->TransferBuffer, 1, &USBStatus);
 
   return Status;
 }
@@ -532,8 +532,12 @@ DisplayLinkPeriodicTimer (
     STATIC UINTN Count = 0;
 
     if (Count++ % 50 == 0) {
-      DlGopPrintTextToScreen (&UsbDisplayLinkDev->GraphicsOutputProtocol, 32, 48, (CONST CHAR16*)L"  Bandwidth: %d MB/s    ", UsbDisplayLinkDev->DataSent * 10000000 / DISPLAYLINK_SCREEN_UPDATE_TIMER_PERIOD / 50 / 1024 / 1024);
+      DlGopPrintTextToScreen (&UsbDisplayLinkDev->GraphicsOutputProtocol, 32, 48, (CONST CHAR16*)L"  Bandwidth: %d MB/s, %d.%d fps    ",
+        UsbDisplayLinkDev->DataSent * 10000000 / DISPLAYLINK_SCREEN_UPDATE_TIMER_PERIOD / 50 / 1024 / 1024,
+        UsbDisplayLinkDev->FramesSent / 5,
+        (UsbDisplayLinkDev->FramesSent * 2) % 10);
       UsbDisplayLinkDev->DataSent = 0;
+      UsbDisplayLinkDev->FramesSent = 0;
     }
   }
 
@@ -1065,6 +1069,11 @@ UsbDisplayLinkDriverBindingStop (
     UsbDisplayLinkDev->Screen = NULL;
   }
 
+  if (UsbDisplayLinkDev->TransferBuffer != NULL) {
+    FreePool (UsbDisplayLinkDev->TransferBuffer);
+    UsbDisplayLinkDev->TransferBuffer = NULL;
+  }
+
   if (UsbDisplayLinkDev->GraphicsOutputProtocol.Mode) {
     if (UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info) {
       FreePool (UsbDisplayLinkDev->GraphicsOutputProtocol.Mode->Info);
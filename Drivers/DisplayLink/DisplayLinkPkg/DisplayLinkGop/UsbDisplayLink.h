@@ -20,6 +20,7 @@
 #include <Protocol/GraphicsOutput.h>
 #include <Protocol/UsbIo.h>
 
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
@@ -41,6 +42,7 @@
 
 #define DISPLAYLINK_SCREEN_UPDATE_TIMER_PERIOD  ((UINTN)1000000) // 0.1s in us
 #define DISPLAYLINK_FULL_SCREEN_UPDATE_PERIOD   ((UINTN)30000) // 3s in ticks
+#define DISPLAYLINK_LINES_PER_CONVERSION        ((UINTN)16)    // Lines converted to RGB24 in one go
 
 #define DISPLAYLINK_FIXED_VERTICAL_REFRESH_RATE ((UINT16)60)
 
@@ -81,11 +83,14 @@ typedef struct {
   EFI_UNICODE_STRING_TABLE      *ControllerNameTable;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Screen;
   UINTN                         DataSent;                       /** Debug - used to track the bandwidth */
+  UINTN                         FramesSent;                     /** Debug - used to track the frame rate */
+  UINT8                         *TransferBuffer;                /** Lines converted to RGB24, waiting to be sent */
+  UINTN                         TransferBufferSize;
   EFI_EVENT                     TimerEvent;
   EFI_EVENT                     DriverExitBootServicesEvent;
   BOOLEAN                       ShowBandwidth;                 /** Debugging - show the bandwidth on the screen */
   BOOLEAN                       ShowTestPattern;               /** Show a colourbar pattern instead of the BLTd contents of the framebuffer */
-  UINTN                         LastY1;                        /** Used to track if we can do a partial screen update */
+  UINTN                         LastY1;                        /** Lines [LastY1, LastY2) have been BLTted to since the last screen update */
   UINTN                         LastY2;
   UINTN                         LastWidth;
   UINTN                         TimeSinceLastScreenUpdate;     /** Do a full screen update every (x) seconds */
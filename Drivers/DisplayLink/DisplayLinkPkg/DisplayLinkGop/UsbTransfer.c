@@ -43,6 +43,10 @@ DlUsbBulkWrite (
     DISPLAYLINK_USB_BULK_TIMEOUT,
     USBStatus);
 
+  if (!EFI_ERROR (Status)) {
+    UsbDisplayLinkDev->DataSent += DataLen;
+  }
+
   return Status;
 }
 
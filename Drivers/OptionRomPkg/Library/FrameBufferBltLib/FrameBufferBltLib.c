@@ -32,6 +32,279 @@ EFI_PIXEL_BITMASK               mPixelBitMasks;
 INTN                            mPixelShl[4]; // R-G-B-Rsvd
 INTN                            mPixelShr[4]; // R-G-B-Rsvd
 
+//
+// Converts Width pixels of one line between the BltBuffer format
+// (EFI_GRAPHICS_OUTPUT_BLT_PIXEL) and the frame buffer format.
+//
+typedef
+VOID
+(*BLT_LIB_LINE_CONVERT) (
+  OUT VOID                              *Destination,
+  IN  CONST VOID                        *Source,
+  IN  UINTN                             Width
+  );
+
+//
+// Line kernels selected by BltLibConfigure. NULL means that the frame
+// buffer format matches EFI_GRAPHICS_OUTPUT_BLT_PIXEL, and lines are copied.
+//
+BLT_LIB_LINE_CONVERT            mBltLibToVideoLine;
+BLT_LIB_LINE_CONVERT            mBltLibFromVideoLine;
+
+#define RGBX_SWAP_RED_BLUE(Pixel, Mask) \
+  ((((Pixel) & ((Mask) << 0)) << 16) | \
+   ((Pixel) & ((Mask) << 8)) | \
+   (((Pixel) >> 16) & ((Mask) << 0)))
+
+#define RGB565_FROM_BLT(Pixel) \
+  ((UINT16) ((((Pixel) >> 8) & 0xF800) | \
+             (((Pixel) >> 5) & 0x07E0) | \
+             (((Pixel) >> 3) & 0x001F)))
+
+#define RGB565_TO_BLT(Pixel) \
+  ((UINT32) ((((Pixel) & 0xF800) << 8) | \
+             (((Pixel) & 0x07E0) << 5) | \
+             (((Pixel) & 0x001F) << 3)))
+
+
+/**
+  Swaps the red and blue channels of a line, in either direction between
+  the BltBuffer and a 32-bit RGBX frame buffer. The reserved byte is cleared.
+  Once the destination is aligned, two pixels are written per 64-bit store.
+
+  @param[out] Destination  Converted pixels
+  @param[in]  Source       Pixels to convert
+  @param[in]  Width        Number of pixels
+
+**/
+STATIC
+VOID
+BltLibLineRgbx (
+  OUT VOID                              *Destination,
+  IN  CONST VOID                        *Source,
+  IN  UINTN                             Width
+  )
+{
+  UINT32        *Dst;
+  CONST UINT32  *Src;
+  UINT64        Pair;
+
+  Dst = (UINT32*) Destination;
+  Src = (CONST UINT32*) Source;
+
+  if ((((UINTN) Dst & 7) != 0) && (Width > 0)) {
+    *Dst++ = RGBX_SWAP_RED_BLUE (*Src, 0xFFU);
+    Src++;
+    Width--;
+  }
+
+  for (; Width >= 2; Width -= 2) {
+    Pair = Src[0] | LShiftU64 (Src[1], 32);
+    *(UINT64*) Dst = RGBX_SWAP_RED_BLUE (Pair, 0x000000FF000000FFULL);
+    Dst += 2;
+    Src += 2;
+  }
+
+  if (Width > 0) {
+    *Dst = RGBX_SWAP_RED_BLUE (*Src, 0xFFU);
+  }
+}
+
+
+/**
+  Converts a line of BltBuffer pixels to a 16-bit RGB565 frame buffer.
+  Once the destination is aligned, four pixels are written per 64-bit store.
+
+  @param[out] Destination  Frame buffer line
+  @param[in]  Source       BltBuffer pixels
+  @param[in]  Width        Number of pixels
+
+**/
+STATIC
+VOID
+BltLibLineToRgb565 (
+  OUT VOID                              *Destination,
+  IN  CONST VOID                        *Source,
+  IN  UINTN                             Width
+  )
+{
+  UINT16        *Dst;
+  CONST UINT32  *Src;
+
+  Dst = (UINT16*) Destination;
+  Src = (CONST UINT32*) Source;
+
+  for (; (((UINTN) Dst & 7) != 0) && (Width > 0); Width--) {
+    *Dst++ = RGB565_FROM_BLT (*Src);
+    Src++;
+  }
+
+  for (; Width >= 4; Width -= 4) {
+    *(UINT64*) Dst = RGB565_FROM_BLT (Src[0]) |
+                     LShiftU64 (RGB565_FROM_BLT (Src[1]), 16) |
+                     LShiftU64 (RGB565_FROM_BLT (Src[2]), 32) |
+                     LShiftU64 (RGB565_FROM_BLT (Src[3]), 48);
+    Dst += 4;
+    Src += 4;
+  }
+
+  for (; Width > 0; Width--) {
+    *Dst++ = RGB565_FROM_BLT (*Src);
+    Src++;
+  }
+}
+
+
+/**
+  Converts a line of a 16-bit RGB565 frame buffer to BltBuffer pixels.
+  Once the source is aligned, four pixels are read per 64-bit load.
+
+  @param[out] Destination  BltBuffer pixels
+  @param[in]  Source       Frame buffer line
+  @param[in]  Width        Number of pixels
+
+**/
+STATIC
+VOID
+BltLibLineFromRgb565 (
+  OUT VOID                              *Destination,
+  IN  CONST VOID                        *Source,
+  IN  UINTN                             Width
+  )
+{
+  UINT32        *Dst;
+  CONST UINT16  *Src;
+  UINT64        Quad;
+
+  Dst = (UINT32*) Destination;
+  Src = (CONST UINT16*) Source;
+
+  for (; (((UINTN) Src & 7) != 0) && (Width > 0); Width--) {
+    *Dst++ = RGB565_TO_BLT (*Src);
+    Src++;
+  }
+
+  for (; Width >= 4; Width -= 4) {
+    Quad = *(CONST UINT64*) Src;
+    Dst[0] = RGB565_TO_BLT ((UINT32) Quad & 0xFFFF);
+    Dst[1] = RGB565_TO_BLT ((UINT32) RShiftU64 (Quad, 16) & 0xFFFF);
+    Dst[2] = RGB565_TO_BLT ((UINT32) RShiftU64 (Quad, 32) & 0xFFFF);
+    Dst[3] = RGB565_TO_BLT ((UINT32) RShiftU64 (Quad, 48));
+    Dst += 4;
+    Src += 4;
+  }
+
+  for (; Width > 0; Width--) {
+    *Dst++ = RGB565_TO_BLT (*Src);
+    Src++;
+  }
+}
+
+
+/**
+  Converts a line of BltBuffer pixels to any bit mask frame buffer format,
+  one pixel at a time through mBltLibLineBuffer.
+
+  @param[out] Destination  Frame buffer line
+  @param[in]  Source       BltBuffer pixels
+  @param[in]  Width        Number of pixels
+
+**/
+STATIC
+VOID
+BltLibLineToBitMask (
+  OUT VOID                              *Destination,
+  IN  CONST VOID                        *Source,
+  IN  UINTN                             Width
+  )
+{
+  UINTN                           X;
+  UINT32                          Uint32;
+
+  for (X = 0; X < Width; X++) {
+    Uint32 = ((CONST UINT32*) Source)[X];
+    *(UINT32*) (mBltLibLineBuffer + (X * mBltLibBytesPerPixel)) =
+      (UINT32) (
+          (((Uint32 << mPixelShl[0]) >> mPixelShr[0]) & mPixelBitMasks.RedMask) |
+          (((Uint32 << mPixelShl[1]) >> mPixelShr[1]) & mPixelBitMasks.GreenMask) |
+          (((Uint32 << mPixelShl[2]) >> mPixelShr[2]) & mPixelBitMasks.BlueMask)
+        );
+  }
+
+  CopyMem (Destination, mBltLibLineBuffer, Width * mBltLibBytesPerPixel);
+}
+
+
+/**
+  Converts a line of any bit mask frame buffer format to BltBuffer pixels,
+  one pixel at a time through mBltLibLineBuffer.
+
+  @param[out] Destination  BltBuffer pixels
+  @param[in]  Source       Frame buffer line
+  @param[in]  Width        Number of pixels
+
+**/
+STATIC
+VOID
+BltLibLineFromBitMask (
+  OUT VOID                              *Destination,
+  IN  CONST VOID                        *Source,
+  IN  UINTN                             Width
+  )
+{
+  UINTN                           X;
+  UINT32                          Uint32;
+
+  CopyMem (mBltLibLineBuffer, Source, Width * mBltLibBytesPerPixel);
+
+  for (X = 0; X < Width; X++) {
+    Uint32 = *(UINT32*) (mBltLibLineBuffer + (X * mBltLibBytesPerPixel));
+    ((UINT32*) Destination)[X] =
+      (UINT32) (
+          (((Uint32 & mPixelBitMasks.RedMask)   >> mPixelShl[0]) << mPixelShr[0]) |
+          (((Uint32 & mPixelBitMasks.GreenMask) >> mPixelShl[1]) << mPixelShr[1]) |
+          (((Uint32 & mPixelBitMasks.BlueMask)  >> mPixelShl[2]) << mPixelShr[2])
+        );
+  }
+}
+
+
+/**
+  Copies a rectangle of bytes. When both sides are contiguous, the
+  whole rectangle is moved with a single CopyMem.
+
+  @param[out] Destination        Top left of the destination rectangle
+  @param[in]  DestinationStride  Bytes between destination lines
+  @param[in]  Source             Top left of the source rectangle
+  @param[in]  SourceStride       Bytes between source lines
+  @param[in]  WidthInBytes       Bytes per line
+  @param[in]  Height             Number of lines
+
+**/
+STATIC
+VOID
+BltLibCopyRect (
+  OUT UINT8                             *Destination,
+  IN  UINTN                             DestinationStride,
+  IN  CONST UINT8                       *Source,
+  IN  UINTN                             SourceStride,
+  IN  UINTN                             WidthInBytes,
+  IN  UINTN                             Height
+  )
+{
+  if ((DestinationStride == WidthInBytes) && (SourceStride == WidthInBytes)) {
+    CopyMem (Destination, Source, WidthInBytes * Height);
+    return;
+  }
+
+  while (Height > 0) {
+    CopyMem (Destination, Source, WidthInBytes);
+    Destination += DestinationStride;
+    Source += SourceStride;
+    Height--;
+  }
+}
+
 
 VOID
 ConfigurePixelBitMaskFormat (
@@ -65,6 +338,32 @@ ConfigurePixelBitMaskFormat (
   DEBUG ((EFI_D_INFO, "Bytes per pixel: %d\n", mBltLibBytesPerPixel));
 
   CopyMem (&mPixelBitMasks, BitMask, sizeof (*BitMask));
+
+  //
+  // Pick the line kernels for the layouts with a fast path.
+  //
+  if ((mBltLibBytesPerPixel == 4) &&
+      (BitMask->RedMask == 0x00ff0000) &&
+      (BitMask->GreenMask == 0x0000ff00) &&
+      (BitMask->BlueMask == 0x000000ff)) {
+    mBltLibToVideoLine   = NULL;
+    mBltLibFromVideoLine = NULL;
+  } else if ((mBltLibBytesPerPixel == 4) &&
+             (BitMask->RedMask == 0x000000ff) &&
+             (BitMask->GreenMask == 0x0000ff00) &&
+             (BitMask->BlueMask == 0x00ff0000)) {
+    mBltLibToVideoLine   = BltLibLineRgbx;
+    mBltLibFromVideoLine = BltLibLineRgbx;
+  } else if ((mBltLibBytesPerPixel == 2) &&
+             (BitMask->RedMask == 0xf800) &&
+             (BitMask->GreenMask == 0x07e0) &&
+             (BitMask->BlueMask == 0x001f)) {
+    mBltLibToVideoLine   = BltLibLineToRgb565;
+    mBltLibFromVideoLine = BltLibLineFromRgb565;
+  } else {
+    mBltLibToVideoLine   = BltLibLineToBitMask;
+    mBltLibFromVideoLine = BltLibLineFromBitMask;
+  }
 }
 
 
@@ -298,18 +597,21 @@ BltLibVideoFill (
     }
   }
 
-  if (UseWideFill && (DestinationX == 0) && (Width == mBltLibWidthInPixels)) {
+  Offset = DestinationY * mBltLibWidthInPixels;
+  Offset = mBltLibBytesPerPixel * Offset;
+  BltMemDst = (VOID*) (mBltLibFrameBuffer + Offset);
+
+  if (UseWideFill && (DestinationX == 0) && (Width == mBltLibWidthInPixels) &&
+      (((UINTN) BltMemDst & 7) == 0)) {
     VDEBUG ((EFI_D_INFO, "VideoFill (wide, one-shot)\n"));
-    Offset = DestinationY * mBltLibWidthInPixels;
-    Offset = mBltLibBytesPerPixel * Offset;
-    BltMemDst = (VOID*) (mBltLibFrameBuffer + Offset);
     SizeInBytes = WidthInBytes * Height;
     if (SizeInBytes >= 8) {
-      SetMem32 (BltMemDst, SizeInBytes & ~3, (UINT32) WideFill);
-      SizeInBytes = SizeInBytes & 3;
+      SetMem64 (BltMemDst, SizeInBytes & ~7, WideFill);
+      BltMemDst = (VOID*) ((UINT8*) BltMemDst + (SizeInBytes & ~7));
+      SizeInBytes = SizeInBytes & 7;
     }
     if (SizeInBytes > 0) {
-      SetMem (BltMemDst, SizeInBytes, (UINT8)(UINTN) WideFill);
+      CopyMem (BltMemDst, (VOID*) &WideFill, SizeInBytes);
     }
   } else {
     LineBufferReady = FALSE;
@@ -326,8 +628,14 @@ BltLibVideoFill (
           SizeInBytes = SizeInBytes & 7;
         }
         if (SizeInBytes > 0) {
-          CopyMem (BltMemDst, (VOID*) &WideFill, SizeInBytes);
+          CopyMem ((UINT8*) BltMemDst + (WidthInBytes & ~7), (VOID*) &WideFill, SizeInBytes);
         }
+      } else if ((mBltLibBytesPerPixel == 4) && (((UINTN) BltMemDst & 3) == 0)) {
+        VDEBUG ((EFI_D_INFO, "VideoFill (32-bit)\n"));
+        SetMem32 (BltMemDst, WidthInBytes, (UINT32) WideFill);
+      } else if ((mBltLibBytesPerPixel == 2) && (((UINTN) BltMemDst & 1) == 0)) {
+        VDEBUG ((EFI_D_INFO, "VideoFill (16-bit)\n"));
+        SetMem16 (BltMemDst, WidthInBytes, (UINT16) WideFill);
       } else {
         VDEBUG ((EFI_D_INFO, "VideoFill (not wide)\n"));
         if (!LineBufferReady) {
@@ -421,11 +729,8 @@ BltLibVideoToBltBufferEx (
 {
   UINTN                           DstY;
   UINTN                           SrcY;
-  EFI_GRAPHICS_OUTPUT_BLT_PIXEL   *Blt;
   VOID                            *BltMemSrc;
   VOID                            *BltMemDst;
-  UINTN                           X;
-  UINT32                          Uint32;
   UINTN                           Offset;
   UINTN                           WidthInBytes;
 
@@ -455,40 +760,27 @@ BltLibVideoToBltBufferEx (
 
   WidthInBytes = Width * mBltLibBytesPerPixel;
 
-  //
-  // Video to BltBuffer: Source is Video, destination is BltBuffer
-  //
-  for (SrcY = SourceY, DstY = DestinationY; DstY < (Height + DestinationY); SrcY++, DstY++) {
+  Offset = (SourceY * mBltLibWidthInPixels) + SourceX;
+  Offset = mBltLibBytesPerPixel * Offset;
+  BltMemSrc = (VOID *) (mBltLibFrameBuffer + Offset);
 
-    Offset = (SrcY * mBltLibWidthInPixels) + SourceX;
-    Offset = mBltLibBytesPerPixel * Offset;
-    BltMemSrc = (VOID *) (mBltLibFrameBuffer + Offset);
-
-    if (mPixelFormat == PixelBlueGreenRedReserved8BitPerColor) {
-      BltMemDst =
-        (VOID *) (
-            (UINT8 *) BltBuffer +
-            (DstY * Delta) +
-            (DestinationX * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL))
-          );
-    } else {
-      BltMemDst = (VOID *) mBltLibLineBuffer;
-    }
+  BltMemDst =
+    (VOID *) (
+        (UINT8 *) BltBuffer +
+        (DestinationY * Delta) +
+        (DestinationX * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL))
+      );
 
-    CopyMem (BltMemDst, BltMemSrc, WidthInBytes);
+  if (mBltLibFromVideoLine == NULL) {
+    BltLibCopyRect (BltMemDst, Delta, BltMemSrc, mBltLibWidthInBytes, WidthInBytes, Height);
+    return EFI_SUCCESS;
+  }
 
-    if (mPixelFormat != PixelBlueGreenRedReserved8BitPerColor) {
-      for (X = 0; X < Width; X++) {
-        Blt         = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *) ((UINT8 *) BltBuffer + (DstY * Delta) + (DestinationX + X) * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
-        Uint32 = *(UINT32*) (mBltLibLineBuffer + (X * mBltLibBytesPerPixel));
-        *(UINT32*) Blt =
-          (UINT32) (
-              (((Uint32 & mPixelBitMasks.RedMask)   >> mPixelShl[0]) << mPixelShr[0]) |
-              (((Uint32 & mPixelBitMasks.GreenMask) >> mPixelShl[1]) << mPixelShr[1]) |
-              (((Uint32 & mPixelBitMasks.BlueMask)  >> mPixelShl[2]) << mPixelShr[2])
-            );
-      }
-    }
+  for (SrcY = SourceY, DstY = DestinationY; DstY < (Height + DestinationY); SrcY++, DstY++) {
+    mBltLibFromVideoLine (BltMemDst, BltMemSrc, Width);
+
+    BltMemSrc = (VOID *) ((UINT8 *) BltMemSrc + mBltLibWidthInBytes);
+    BltMemDst = (VOID *) ((UINT8 *) BltMemDst + Delta);
   }
 
   return EFI_SUCCESS;
@@ -565,11 +857,8 @@ BltLibBufferToVideoEx (
 {
   UINTN                           DstY;
   UINTN                           SrcY;
-  EFI_GRAPHICS_OUTPUT_BLT_PIXEL   *Blt;
   VOID                            *BltMemSrc;
   VOID                            *BltMemDst;
-  UINTN                           X;
-  UINT32                          Uint32;
   UINTN                           Offset;
   UINTN                           WidthInBytes;
 
@@ -599,34 +888,27 @@ BltLibBufferToVideoEx (
 
   WidthInBytes = Width * mBltLibBytesPerPixel;
 
-  for (SrcY = SourceY, DstY = DestinationY; SrcY < (Height + SourceY); SrcY++, DstY++) {
+  Offset = (DestinationY * mBltLibWidthInPixels) + DestinationX;
+  Offset = mBltLibBytesPerPixel * Offset;
+  BltMemDst = (VOID*) (mBltLibFrameBuffer + Offset);
 
-    Offset = (DstY * mBltLibWidthInPixels) + DestinationX;
-    Offset = mBltLibBytesPerPixel * Offset;
-    BltMemDst = (VOID*) (mBltLibFrameBuffer + Offset);
+  BltMemSrc =
+    (VOID *) (
+        (UINT8 *) BltBuffer +
+        (SourceY * Delta) +
+        (SourceX * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL))
+      );
 
-    if (mPixelFormat == PixelBlueGreenRedReserved8BitPerColor) {
-      BltMemSrc = (VOID *) ((UINT8 *) BltBuffer + (SrcY * Delta));
-    } else {
-      for (X = 0; X < Width; X++) {
-        Blt =
-          (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *) (
-              (UINT8 *) BltBuffer +
-              (SrcY * Delta) +
-              ((SourceX + X) * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL))
-            );
-        Uint32 = *(UINT32*) Blt;
-        *(UINT32*) (mBltLibLineBuffer + (X * mBltLibBytesPerPixel)) =
-          (UINT32) (
-              (((Uint32 << mPixelShl[0]) >> mPixelShr[0]) & mPixelBitMasks.RedMask) |
-              (((Uint32 << mPixelShl[1]) >> mPixelShr[1]) & mPixelBitMasks.GreenMask) |
-              (((Uint32 << mPixelShl[2]) >> mPixelShr[2]) & mPixelBitMasks.BlueMask)
-            );
-      }
-      BltMemSrc = (VOID *) mBltLibLineBuffer;
-    }
+  if (mBltLibToVideoLine == NULL) {
+    BltLibCopyRect (BltMemDst, mBltLibWidthInBytes, BltMemSrc, Delta, WidthInBytes, Height);
+    return EFI_SUCCESS;
+  }
 
-    CopyMem (BltMemDst, BltMemSrc, WidthInBytes);
+  for (SrcY = SourceY, DstY = DestinationY; SrcY < (Height + SourceY); SrcY++, DstY++) {
+    mBltLibToVideoLine (BltMemDst, BltMemSrc, Width);
+
+    BltMemSrc = (VOID *) ((UINT8 *) BltMemSrc + Delta);
+    BltMemDst = (VOID *) ((UINT8 *) BltMemDst + mBltLibWidthInBytes);
   }
 
   return EFI_SUCCESS;
@@ -698,6 +980,14 @@ BltLibVideoToVideo (
   Offset = mBltLibBytesPerPixel * Offset;
   BltMemDst = (VOID *) (mBltLibFrameBuffer + Offset);
 
+  //
+  // Full width lines are contiguous, and CopyMem handles the overlap.
+  //
+  if (WidthInBytes == mBltLibWidthInBytes) {
+    CopyMem (BltMemDst, BltMemSrc, WidthInBytes * Height);
+    return EFI_SUCCESS;
+  }
+
   LineStride = mBltLibWidthInBytes;
   if ((UINTN) BltMemDst > (UINTN) BltMemSrc) {
     LineStride = -LineStride;
@@ -0,0 +1,358 @@
+/** @file
+  Metadata block cache
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "Ext4Dxe.h"
+
+//
+// A single cached filesystem block. The block's data (Partition->BlockSize bytes)
+// immediately follows the structure, in the same pool allocation.
+//
+typedef struct {
+  EXT4_BLOCK_NR               Block;
+  LIST_ENTRY                  LruNode;
+  ORDERED_COLLECTION_ENTRY    *MapEntry;
+} EXT4_BLOCK_CACHE_ENTRY;
+
+#define EXT4_BLOCK_CACHE_ENTRY_FROM_LRU_NODE(Node)                             \
+  BASE_CR(Node, EXT4_BLOCK_CACHE_ENTRY, LruNode)
+
+#define EXT4_BLOCK_CACHE_ENTRY_DATA(Entry)  ((UINT8 *)((Entry) + 1))
+
+/**
+  Compare two EXT4_BLOCK_CACHE_ENTRY structs.
+  Used in the block cache's ORDERED_COLLECTION.
+
+  @param[in] UserStruct1  Pointer to the first user structure.
+
+  @param[in] UserStruct2  Pointer to the second user structure.
+
+  @retval <0  If UserStruct1 compares less than UserStruct2.
+
+  @retval  0  If UserStruct1 compares equal to UserStruct2.
+
+  @retval >0  If UserStruct1 compares greater than UserStruct2.
+**/
+STATIC
+INTN
+EFIAPI
+Ext4BlockCacheStructCompare (
+  IN CONST VOID  *UserStruct1,
+  IN CONST VOID  *UserStruct2
+  )
+{
+  CONST EXT4_BLOCK_CACHE_ENTRY  *Entry1;
+  CONST EXT4_BLOCK_CACHE_ENTRY  *Entry2;
+
+  Entry1 = UserStruct1;
+  Entry2 = UserStruct2;
+
+  return Entry1->Block < Entry2->Block ? -1 :
+         Entry1->Block > Entry2->Block ? 1 : 0;
+}
+
+/**
+  Compare a standalone key against a EXT4_BLOCK_CACHE_ENTRY containing an embedded key.
+  Used in the block cache's ORDERED_COLLECTION.
+
+  @param[in] StandaloneKey  Pointer to the bare key (an EXT4_BLOCK_NR).
+
+  @param[in] UserStruct     Pointer to the user structure with the embedded
+                            key.
+
+  @retval <0  If StandaloneKey compares less than UserStruct's key.
+
+  @retval  0  If StandaloneKey compares equal to UserStruct's key.
+
+  @retval >0  If StandaloneKey compares greater than UserStruct's key.
+**/
+STATIC
+INTN
+EFIAPI
+Ext4BlockCacheKeyCompare (
+  IN CONST VOID  *StandaloneKey,
+  IN CONST VOID  *UserStruct
+  )
+{
+  CONST EXT4_BLOCK_CACHE_ENTRY  *Entry;
+  EXT4_BLOCK_NR                 Block;
+
+  // Block numbers are 64-bit, so (unlike the extents map) we can't smuggle them
+  // inside the key pointer on 32-bit architectures.
+  Entry = UserStruct;
+  Block = *(CONST EXT4_BLOCK_NR *)StandaloneKey;
+
+  return Block < Entry->Block ? -1 :
+         Block > Entry->Block ? 1 : 0;
+}
+
+/**
+   Initialises the partition's (empty) metadata block cache.
+   The size of the cache is taken from PcdExt4BlockCacheSize; a size of 0 disables it.
+
+   @param[in out]  Partition   Pointer to the opened partition. Partition->BlockSize
+                               must already be valid.
+
+   @retval EFI_SUCCESS          The cache was initialised.
+   @retval EFI_OUT_OF_RESOURCES Not enough memory to set up the cache.
+**/
+EFI_STATUS
+Ext4InitBlockCache (
+  IN OUT EXT4_PARTITION  *Partition
+  )
+{
+  EXT4_BLOCK_CACHE  *Cache;
+
+  Cache = &Partition->BlockCache;
+
+  InitializeListHead (&Cache->LruList);
+  Cache->NumberEntries = 0;
+  Cache->MaxEntries    = FixedPcdGet32 (PcdExt4BlockCacheSize);
+  Cache->Hits          = 0;
+  Cache->Misses        = 0;
+  Cache->Map           = NULL;
+
+  if (Cache->MaxEntries == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Cache->Map = OrderedCollectionInit (Ext4BlockCacheStructCompare, Ext4BlockCacheKeyCompare);
+
+  if (Cache->Map == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Frees the partition's metadata block cache, dropping every cached block.
+
+   @param[in out]  Partition   Pointer to the opened partition.
+**/
+VOID
+Ext4FreeBlockCache (
+  IN OUT EXT4_PARTITION  *Partition
+  )
+{
+  EXT4_BLOCK_CACHE        *Cache;
+  EXT4_BLOCK_CACHE_ENTRY  *Entry;
+  LIST_ENTRY              *Node;
+  LIST_ENTRY              *NextNode;
+
+  Cache = &Partition->BlockCache;
+
+  if (Cache->Map == NULL) {
+    return;
+  }
+
+  DEBUG ((
+    DEBUG_FS,
+    "[ext4] Block cache: %lu hits, %lu misses (%u/%u blocks in use)\n",
+    Cache->Hits,
+    Cache->Misses,
+    Cache->NumberEntries,
+    Cache->MaxEntries
+    ));
+
+  BASE_LIST_FOR_EACH_SAFE (Node, NextNode, &Cache->LruList) {
+    Entry = EXT4_BLOCK_CACHE_ENTRY_FROM_LRU_NODE (Node);
+
+    RemoveEntryList (&Entry->LruNode);
+    OrderedCollectionDelete (Cache->Map, Entry->MapEntry, NULL);
+    FreePool (Entry);
+  }
+
+  ASSERT (OrderedCollectionIsEmpty (Cache->Map));
+
+  OrderedCollectionUninit (Cache->Map);
+  Cache->Map           = NULL;
+  Cache->NumberEntries = 0;
+}
+
+/**
+   Looks up a block in the cache, reading it from disk (and possibly evicting
+   the least recently used block) if it's not present.
+
+   @param[in]  Partition      Pointer to the opened ext4 partition.
+   @param[in]  BlockNumber    Physical block number.
+   @param[out] Data           Pointer to where a pointer to the block's data will be stored.
+                              The data is only valid until the next block cache call.
+
+   @retval EFI_SUCCESS          The block was found (or read into the cache).
+   @retval EFI_OUT_OF_RESOURCES The block could not be cached.
+   @retval !EFI_SUCCESS         The disk read failed.
+**/
+STATIC
+EFI_STATUS
+Ext4GetCachedBlock (
+  IN  EXT4_PARTITION  *Partition,
+  IN  EXT4_BLOCK_NR   BlockNumber,
+  OUT UINT8           **Data
+  )
+{
+  EXT4_BLOCK_CACHE          *Cache;
+  EXT4_BLOCK_CACHE_ENTRY    *Entry;
+  ORDERED_COLLECTION_ENTRY  *MapEntry;
+  EFI_STATUS                Status;
+
+  Cache    = &Partition->BlockCache;
+  MapEntry = OrderedCollectionFind (Cache->Map, &BlockNumber);
+
+  if (MapEntry != NULL) {
+    Entry = OrderedCollectionUserStruct (MapEntry);
+
+    // Move the block to the head of the LRU list, as it's now the most recently used one
+    RemoveEntryList (&Entry->LruNode);
+    InsertHeadList (&Cache->LruList, &Entry->LruNode);
+
+    Cache->Hits++;
+    *Data = EXT4_BLOCK_CACHE_ENTRY_DATA (Entry);
+    return EFI_SUCCESS;
+  }
+
+  Cache->Misses++;
+
+  if (Cache->NumberEntries < Cache->MaxEntries) {
+    Entry = AllocatePool (sizeof (EXT4_BLOCK_CACHE_ENTRY) + Partition->BlockSize);
+
+    if (Entry == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  } else {
+    // The cache is full, recycle the least recently used block (the tail of the list)
+    ASSERT (!IsListEmpty (&Cache->LruList));
+    Entry = EXT4_BLOCK_CACHE_ENTRY_FROM_LRU_NODE (GetPreviousNode (&Cache->LruList, &Cache->LruList));
+
+    RemoveEntryList (&Entry->LruNode);
+    OrderedCollectionDelete (Cache->Map, Entry->MapEntry, NULL);
+    Cache->NumberEntries--;
+  }
+
+  // Note: We use Ext4ReadDiskIo directly instead of Ext4ReadBlocks, since corrupted
+  // metadata may very well point us to block 0.
+  Status = Ext4ReadDiskIo (
+             Partition,
+             EXT4_BLOCK_CACHE_ENTRY_DATA (Entry),
+             Partition->BlockSize,
+             EXT4_BLOCK_TO_BYTES (Partition, BlockNumber)
+             );
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Entry);
+    return Status;
+  }
+
+  Entry->Block = BlockNumber;
+
+  // This can't return EFI_ALREADY_STARTED, since we've just looked the block up.
+  Status = OrderedCollectionInsert (Cache->Map, &Entry->MapEntry, Entry);
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Entry);
+    return Status;
+  }
+
+  InsertHeadList (&Cache->LruList, &Entry->LruNode);
+  Cache->NumberEntries++;
+
+  *Data = EXT4_BLOCK_CACHE_ENTRY_DATA (Entry);
+  return EFI_SUCCESS;
+}
+
+/**
+   Reads from the partition's disk through the metadata block cache.
+   Falls back to reading directly from the disk if the cache is disabled
+   or a block can't be cached.
+
+   @param[in]  Partition      Pointer to the opened ext4 partition.
+   @param[out] Buffer         Pointer to a destination buffer.
+   @param[in]  Length         Length of the destination buffer.
+   @param[in]  Offset         Offset, in bytes, of the location to read.
+
+   @return Success status of the read.
+**/
+EFI_STATUS
+Ext4ReadDiskIoCached (
+  IN EXT4_PARTITION  *Partition,
+  OUT VOID           *Buffer,
+  IN UINTN           Length,
+  IN UINT64          Offset
+  )
+{
+  EFI_STATUS     Status;
+  EXT4_BLOCK_NR  BlockNumber;
+  UINT32         BlockOffset;
+  UINTN          ToCopy;
+  UINT8          *Data;
+
+  if (Partition->BlockCache.Map == NULL) {
+    return Ext4ReadDiskIo (Partition, Buffer, Length, Offset);
+  }
+
+  while (Length != 0) {
+    BlockNumber = DivU64x32Remainder (Offset, Partition->BlockSize, &BlockOffset);
+    ToCopy      = MIN (Length, Partition->BlockSize - BlockOffset);
+
+    Status = Ext4GetCachedBlock (Partition, BlockNumber, &Data);
+
+    if (Status == EFI_OUT_OF_RESOURCES) {
+      // Failing to cache a block isn't fatal, just go to the disk.
+      Status = Ext4ReadDiskIo (Partition, Buffer, ToCopy, Offset);
+    } else if (!EFI_ERROR (Status)) {
+      CopyMem (Buffer, Data + BlockOffset, ToCopy);
+    }
+
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Buffer  = (CHAR8 *)Buffer + ToCopy;
+    Offset += ToCopy;
+    Length -= ToCopy;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Reads blocks from the partition's disk through the metadata block cache.
+
+   @param[in]  Partition      Pointer to the opened ext4 partition.
+   @param[out] Buffer         Pointer to a destination buffer.
+   @param[in]  NumberBlocks   Length of the read, in filesystem blocks.
+   @param[in]  BlockNumber    Starting block number.
+
+   @return Success status of the read.
+**/
+EFI_STATUS
+Ext4ReadBlocksCached (
+  IN EXT4_PARTITION  *Partition,
+  OUT VOID           *Buffer,
+  IN UINTN           NumberBlocks,
+  IN EXT4_BLOCK_NR   BlockNumber
+  )
+{
+  UINT64  Offset;
+  UINTN   Length;
+
+  ASSERT (NumberBlocks != 0);
+  ASSERT (BlockNumber != EXT4_BLOCK_FILE_HOLE);
+
+  Offset = MultU64x32 (BlockNumber, Partition->BlockSize);
+  Length = NumberBlocks * Partition->BlockSize;
+
+  // Check for overflow on the block -> byte conversions, like Ext4ReadBlocks does.
+
+  if (DivU64x64Remainder (Offset, BlockNumber, NULL) != Partition->BlockSize) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Length / NumberBlocks != Partition->BlockSize) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return Ext4ReadDiskIoCached (Partition, Buffer, Length, Offset);
+}
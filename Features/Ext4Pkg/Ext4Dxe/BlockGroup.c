@@ -82,7 +82,15 @@ Ext4ReadInode (
                       BlockGroup->bg_inode_table_hi
                       );
 
-  Status = Ext4ReadDiskIo (
+  // Inodes in the inode cache were already checked, so we're done if we find it there.
+  Status = Ext4ReadInodeCached (Partition, InodeNum, BlockGroupNumber, InodeTableStart, InodeOffset, Inode);
+
+  if (Status == EFI_SUCCESS) {
+    *OutIno = Inode;
+    return EFI_SUCCESS;
+  }
+
+  Status = Ext4ReadDiskIoCached (
              Partition,
              Inode,
              Partition->InodeSize,
@@ -7,9 +7,6 @@
 
 #include <Ext4Dxe.h>
 
-// Note: The largest path we can take uses up 4 indices
-#define EXT4_MAX_BLOCK_PATH  4
-
 typedef enum ext4_logical_block_type {
   EXT4_TYPE_DIRECT_BLOCK = 0,
   EXT4_TYPE_SINGLY_BLOCK,
@@ -115,7 +112,7 @@ Ext4GetBlockPath (
       BlockPath[2]  = LogicalBlock % Entries;
       break;
     case EXT4_TYPE_TREBLY_BLOCK:
-      BlockPath[0]  = EXT4_DIND_BLOCK;
+      BlockPath[0]  = EXT4_TIND_BLOCK;
       LogicalBlock -= MinTreblyBlock;
       BlockPath[1]  = LogicalBlock / EntriesEntries;
       BlockPath[2]  = (LogicalBlock % EntriesEntries) / Entries;
@@ -200,33 +197,86 @@ Ext4GetExtentInBlockMap (
 }
 
 /**
-   Retrieves an extent from an EXT2/3 inode (with a blockmap).
+   Reads an indirect block of a file's block map, going through the file's cache.
+
    @param[in]      Partition     Pointer to the opened EXT4 partition.
    @param[in]      File          Pointer to the opened file.
-   @param[in]      LogicalBlock  Block number which the returned extent must cover.
-   @param[out]     Extent        Pointer to the output buffer, where the extent will be copied to.
+   @param[in]      Level         Level of the indirect block (0 for the block pointed to by the inode).
+   @param[in]      BlockNumber   Block number of the indirect block.
+   @param[out]     Buffer        Pointer to the contents of the indirect block. Only valid until the
+                                 next indirect block of the same level is read.
+
+   @return Result of the operation.
+**/
+STATIC
+EFI_STATUS
+Ext4ReadIndirectBlock (
+  IN  EXT4_PARTITION  *Partition,
+  IN  EXT4_FILE       *File,
+  IN  UINTN           Level,
+  IN  UINT32          BlockNumber,
+  OUT CONST UINT32    **Buffer
+  )
+{
+  EXT4_BLOCK_MAP_CACHE  *Entry;
+  EFI_STATUS            Status;
+
+  Entry = &File->BlockMapCache[Level];
+
+  if (Entry->BlockNumber != BlockNumber) {
+    if (Entry->Data == NULL) {
+      Entry->Data = AllocatePool (Partition->BlockSize);
+      if (Entry->Data == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+      }
+    }
+
+    // Invalidate the entry first, in case the read fails halfway.
+    Entry->BlockNumber = 0;
+
+    Status = Ext4ReadBlocksCached (Partition, Entry->Data, 1, BlockNumber);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Entry->BlockNumber = BlockNumber;
+  }
+
+  *Buffer = Entry->Data;
+  return EFI_SUCCESS;
+}
+
+/**
+   Finds the block pointer table (either the inode's direct blocks or an indirect block)
+   that maps a logical block.
+
+   @param[in]      Partition     Pointer to the opened EXT4 partition.
+   @param[in]      File          Pointer to the opened file.
+   @param[in]      LogicalBlock  Logical block.
+   @param[out]     Table         Pointer to the block pointer table.
+   @param[out]     Entries       Number of entries in the table.
+   @param[out]     StartIndex    Index of LogicalBlock's entry in the table.
 
    @retval EFI_SUCCESS        Retrieval was successful.
    @retval EFI_NO_MAPPING     Block has no mapping.
 **/
+STATIC
 EFI_STATUS
-Ext4GetBlocks (
+Ext4GetBlockMapTable (
   IN  EXT4_PARTITION  *Partition,
   IN  EXT4_FILE       *File,
-  IN  EXT2_BLOCK_NR   LogicalBlock,
-  OUT EXT4_EXTENT     *Extent
+  IN  UINT32          LogicalBlock,
+  OUT CONST UINT32    **Table,
+  OUT UINT32          *Entries,
+  OUT UINT32          *StartIndex
   )
 {
-  EXT4_INODE     *Inode;
   EXT2_BLOCK_NR  BlockPath[EXT4_MAX_BLOCK_PATH];
   UINTN          BlockPathLength;
   UINTN          Index;
-  UINT32         *Buffer;
+  CONST UINT32   *Buffer;
   EFI_STATUS     Status;
   UINT32         Block;
-  UINT32         BlockIndex;
-
-  Inode = File->Inode;
 
   BlockPathLength = Ext4GetBlockPath (Partition, LogicalBlock, BlockPath);
 
@@ -235,51 +285,123 @@ Ext4GetBlocks (
     return EFI_NO_MAPPING;
   }
 
-  Extent->ee_block = LogicalBlock;
+  Buffer = File->Inode->i_data;
 
-  if (BlockPathLength == 1) {
-    // Fast path for blocks 0 - 12 that skips allocations
-    Ext4GetExtentInBlockMap (Inode->i_data, EXT4_DBLOCKS, BlockPath[0], Extent);
+  // Note the BlockPathLength - 1 so we don't end up reading the final block
+  for (Index = 0; Index < BlockPathLength - 1; Index++) {
+    Block = Buffer[BlockPath[Index]];
+
+    if (Block == EXT4_BLOCK_FILE_HOLE) {
+      return EFI_NO_MAPPING;
+    }
 
-    return EFI_SUCCESS;
+    Status = Ext4ReadIndirectBlock (Partition, File, Index, Block, &Buffer);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
   }
 
-  Buffer = AllocatePool (Partition->BlockSize);
-  if (Buffer == NULL) {
-    return EFI_OUT_OF_RESOURCES;
+  *Table      = Buffer;
+  *Entries    = BlockPathLength == 1 ? EXT4_DBLOCKS : Partition->BlockSize / sizeof (UINT32);
+  *StartIndex = BlockPath[BlockPathLength - 1];
+  return EFI_SUCCESS;
+}
+
+/**
+   Retrieves an extent from an EXT2/3 inode (with a blockmap).
+   @param[in]      Partition     Pointer to the opened EXT4 partition.
+   @param[in]      File          Pointer to the opened file.
+   @param[in]      LogicalBlock  Block number which the returned extent must cover.
+   @param[out]     Extent        Pointer to the output buffer, where the extent will be copied to.
+
+   @retval EFI_SUCCESS        Retrieval was successful.
+   @retval EFI_NO_MAPPING     Block has no mapping.
+**/
+EFI_STATUS
+Ext4GetBlocks (
+  IN  EXT4_PARTITION  *Partition,
+  IN  EXT4_FILE       *File,
+  IN  EXT2_BLOCK_NR   LogicalBlock,
+  OUT EXT4_EXTENT     *Extent
+  )
+{
+  CONST UINT32  *Table;
+  UINT32        Entries;
+  UINT32        StartIndex;
+  EFI_STATUS    Status;
+  EXT4_EXTENT   Next;
+  UINT64        NextBlock;
+  UINT32        Length;
+  UINT32        TotalLength;
+  UINT32        MaxLength;
+  BOOLEAN       IsHole;
+
+  Status = Ext4GetBlockMapTable (Partition, File, LogicalBlock, &Table, &Entries, &StartIndex);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
-  // Note the BlockPathLength - 1 so we don't end up reading the final block
-  for (Index = 0; Index < BlockPathLength - 1; Index++) {
-    BlockIndex = BlockPath[Index];
+  Extent->ee_block = LogicalBlock;
+  Ext4GetExtentInBlockMap (Table, Entries, StartIndex, Extent);
 
-    if (Index == 0) {
-      Block = Inode->i_data[BlockIndex];
-    } else {
-      Block = Buffer[BlockIndex];
+  IsHole      = EXT4_EXTENT_IS_UNINITIALIZED (Extent);
+  Length      = Ext4GetExtentLength (Extent);
+  TotalLength = Length;
+  MaxLength   = IsHole ? EXT4_EXTENT_MAX_INITIALIZED - 1 : EXT4_EXTENT_MAX_INITIALIZED;
+
+  // Runs found by Ext4GetExtentInBlockMap stop at the end of the block pointer table. If a run
+  // reaches it, keep going into the next table, so that physically contiguous files (and long holes)
+  // are described by long extents and can be read with a single request.
+  while ((StartIndex + Length == Entries) && (TotalLength < MaxLength)) {
+    NextBlock = (UINT64)LogicalBlock + TotalLength;
+
+    if (NextBlock > MAX_UINT32) {
+      break;
     }
 
-    if (Block == EXT4_BLOCK_FILE_HOLE) {
-      FreePool (Buffer);
-      return EFI_NO_MAPPING;
+    Status = Ext4GetBlockMapTable (Partition, File, (UINT32)NextBlock, &Table, &Entries, &StartIndex);
+    if (EFI_ERROR (Status)) {
+      // We already have an extent, so this just ends the run.
+      break;
     }
 
-    Status = Ext4ReadBlocks (Partition, Buffer, 1, Block);
+    Ext4GetExtentInBlockMap (Table, Entries, StartIndex, &Next);
 
-    if (EFI_ERROR (Status)) {
-      FreePool (Buffer);
-      return Status;
+    if (EXT4_EXTENT_IS_UNINITIALIZED (&Next) != IsHole) {
+      break;
+    }
+
+    if (!IsHole && (Next.ee_start_lo != Extent->ee_start_lo + TotalLength)) {
+      break;
     }
-  }
 
-  Ext4GetExtentInBlockMap (
-    Buffer,
-    Partition->BlockSize / sizeof (UINT32),
-    BlockPath[BlockPathLength - 1],
-    Extent
-    );
+    Length       = MIN (Ext4GetExtentLength (&Next), MaxLength - TotalLength);
+    TotalLength += Length;
+  }
 
-  FreePool (Buffer);
+  Extent->ee_len = (UINT16)(IsHole ? EXT4_EXTENT_MAX_INITIALIZED + TotalLength : TotalLength);
 
   return EFI_SUCCESS;
 }
+
+/**
+   Frees the indirect blocks cached by Ext4GetBlocks.
+
+   @param[in]      File          Pointer to the opened file.
+**/
+VOID
+Ext4FreeBlockMapCache (
+  IN EXT4_FILE  *File
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (File->BlockMapCache); Index++) {
+    if (File->BlockMapCache[Index].Data != NULL) {
+      FreePool (File->BlockMapCache[Index].Data);
+    }
+
+    File->BlockMapCache[Index].BlockNumber = 0;
+    File->BlockMapCache[Index].Data        = NULL;
+  }
+}
@@ -0,0 +1,144 @@
+/** @file
+  CRC32C, as used by metadata_csum
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "Ext4Dxe.h"
+
+#if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+
+/**
+   Updates a CRC32C with a buffer, using the CPU's CRC32C instructions.
+   Implemented in assembly (X64/Crc32c.nasm, AArch64/Crc32c.S).
+
+   @param[in]      Crc           CRC to update. Not inverted.
+   @param[in]      Buffer        Pointer to the buffer.
+   @param[in]      Length        Length of the buffer, in bytes.
+
+   @return The updated CRC. Not inverted.
+**/
+UINT32
+EFIAPI
+Ext4Crc32cHw (
+  IN UINT32      Crc,
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  );
+
+  #if defined (MDE_CPU_AARCH64)
+
+/**
+   Reads the ID_AA64ISAR0_EL1 register (implemented in AArch64/Crc32c.S).
+
+   @return The value of the register.
+**/
+UINT64
+EFIAPI
+Ext4ReadIdAA64Isar0 (
+  VOID
+  );
+
+  #endif
+
+//
+// Whether the CRC32C instructions are available (and work), checked on first use.
+//
+STATIC BOOLEAN  mCrc32cHwChecked = FALSE;
+STATIC BOOLEAN  mCrc32cHwUsable  = FALSE;
+
+/**
+   Checks if the CPU supports the CRC32C instructions.
+
+   @return TRUE if the CRC32C instructions can be used, else FALSE.
+**/
+STATIC
+BOOLEAN
+Ext4CpuHasCrc32c (
+  VOID
+  )
+{
+ #if defined (MDE_CPU_X64)
+  UINT32  Ecx;
+
+  // CPUID.01H:ECX.SSE4_2[bit 20]
+  AsmCpuid (1, NULL, NULL, &Ecx, NULL);
+  return (Ecx & BIT20) != 0;
+ #else
+  // ID_AA64ISAR0_EL1.CRC32, bits [19:16]. Mandatory since ARMv8.1, but optional in ARMv8.0.
+  return ((Ext4ReadIdAA64Isar0 () >> 16) & 0xF) != 0;
+ #endif
+}
+
+/**
+   Checks, once, if the hardware CRC32C backend can be used.
+   Its result is compared against the table-driven implementation for a known
+   input, so a broken backend is never used.
+
+   @return TRUE if Ext4Crc32cHw can be used, else FALSE.
+**/
+STATIC
+BOOLEAN
+Ext4CanUseCrc32cHw (
+  VOID
+  )
+{
+  STATIC CONST CHAR8  TestVector[] = "123456789 - ext4 metadata_csum test vector";
+  UINT32              Expected;
+  UINT32              Crc;
+
+  if (mCrc32cHwChecked) {
+    return mCrc32cHwUsable;
+  }
+
+  mCrc32cHwChecked = TRUE;
+
+  if (!Ext4CpuHasCrc32c ()) {
+    DEBUG ((DEBUG_INFO, "[ext4] Using table-driven CRC32C\n"));
+    return FALSE;
+  }
+
+  // Test both the wide and the byte-sized paths, with an unaligned buffer.
+  Expected = ~CalculateCrc32c (TestVector + 1, sizeof (TestVector) - 2, 0);
+  Crc      = Ext4Crc32cHw (~0U, TestVector + 1, sizeof (TestVector) - 2);
+
+  if (Crc != Expected) {
+    DEBUG ((DEBUG_ERROR, "[ext4] CRC32C instructions gave %x instead of %x, not using them\n", Crc, Expected));
+    return FALSE;
+  }
+
+  DEBUG ((DEBUG_INFO, "[ext4] Using CRC32C instructions\n"));
+  mCrc32cHwUsable = TRUE;
+  return TRUE;
+}
+
+#endif
+
+/**
+   Updates a CRC32C with a buffer. Unlike CalculateCrc32c, the CRC isn't inverted
+   before or after, which is what ext4 expects.
+   Uses the CPU's CRC32C instructions if they're available, and falls back to
+   the table-driven implementation in BaseLib if not.
+
+   @param[in]      Buffer        Pointer to the buffer.
+   @param[in]      Length        Length of the buffer, in bytes.
+   @param[in]      InitialValue  Initial value of the CRC.
+
+   @return The updated CRC.
+**/
+UINT32
+Ext4CalculateCrc32c (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length,
+  IN UINT32      InitialValue
+  )
+{
+ #if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+  if (Ext4CanUseCrc32cHw ()) {
+    return Ext4Crc32cHw (InitialValue, Buffer, Length);
+  }
+
+ #endif
+
+  return ~CalculateCrc32c (Buffer, Length, ~InitialValue);
+}
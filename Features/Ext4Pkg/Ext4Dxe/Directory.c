@@ -89,6 +89,91 @@ Ext4ValidDirent (
   return TRUE;
 }
 
+/**
+   Searches a single directory block for a directory entry.
+
+   @param[in]      Partition   Pointer to the ext4 partition.
+   @param[in]      Block       Pointer to the directory block, Partition->BlockSize bytes long.
+   @param[in]      Name        Pointer to the UCS-2 formatted filename.
+   @param[out]     Result      Pointer to the destination directory entry.
+
+   @retval EFI_SUCCESS          The entry was found and copied to Result.
+   @retval EFI_NOT_FOUND        The entry is not in this block.
+   @retval EFI_VOLUME_CORRUPTED The directory block is corrupted.
+   @retval !EFI_SUCCESS         Another error occurred.
+**/
+EFI_STATUS
+Ext4SearchDirBlock (
+  IN  EXT4_PARTITION  *Partition,
+  IN  CONST CHAR8     *Block,
+  IN  CONST CHAR16    *Name,
+  OUT EXT4_DIR_ENTRY  *Result
+  )
+{
+  EFI_STATUS      Status;
+  EXT4_DIR_ENTRY  *Entry;
+  UINTN           RemainingBlock;
+  CHAR16          DirentUcs2Name[EXT4_NAME_MAX + 1];
+  UINTN           ToCopy;
+  UINTN           BlockOffset;
+
+  for (BlockOffset = 0; BlockOffset < Partition->BlockSize; ) {
+    Entry          = (EXT4_DIR_ENTRY *)(Block + BlockOffset);
+    RemainingBlock = Partition->BlockSize - BlockOffset;
+    // Check if the minimum directory entry fits inside [BlockOffset, EndOfBlock]
+    if (RemainingBlock < EXT4_MIN_DIR_ENTRY_LEN) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    if (!Ext4ValidDirent (Entry)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    if ((Entry->name_len > RemainingBlock) || (Entry->rec_len > RemainingBlock)) {
+      // Corrupted filesystem
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    // Unused entry
+    if (Entry->inode == 0) {
+      BlockOffset += Entry->rec_len;
+      continue;
+    }
+
+    Status = Ext4GetUcs2DirentName (Entry, DirentUcs2Name);
+
+    /* In theory, this should never fail.
+     * In reality, it's quite possible that it can fail, considering filenames in
+     * Linux (and probably other nixes) are just null-terminated bags of bytes, and don't
+     * need to form valid ASCII/UTF-8 sequences.
+     */
+    if (EFI_ERROR (Status)) {
+      if (Status == EFI_INVALID_PARAMETER) {
+        // If we error out due to a bad UTF-8 sequence (see Ext4GetUcs2DirentName), skip this entry.
+        // I'm not sure if this is correct behaviour, but I don't think there's a precedent here.
+        BlockOffset += Entry->rec_len;
+        continue;
+      }
+
+      // Other sorts of errors should just error out.
+      return Status;
+    }
+
+    if ((Entry->name_len == StrLen (Name)) &&
+        !Ext4StrCmpInsensitive (DirentUcs2Name, (CHAR16 *)Name))
+    {
+      ToCopy = MIN (Entry->rec_len, sizeof (EXT4_DIR_ENTRY));
+
+      CopyMem (Result, Entry, ToCopy);
+      return EFI_SUCCESS;
+    }
+
+    BlockOffset += Entry->rec_len;
+  }
+
+  return EFI_NOT_FOUND;
+}
+
 /**
    Retrieves a directory entry.
 
@@ -107,18 +192,23 @@ Ext4RetrieveDirent (
   OUT EXT4_DIR_ENTRY  *Result
   )
 {
-  EFI_STATUS      Status;
-  CHAR8           *Buf;
-  UINT64          Off;
-  EXT4_INODE      *Inode;
-  UINT64          DirInoSize;
-  UINT32          BlockRemainder;
-  UINTN           Length;
-  EXT4_DIR_ENTRY  *Entry;
-  UINTN           RemainingBlock;
-  CHAR16          DirentUcs2Name[EXT4_NAME_MAX + 1];
-  UINTN           ToCopy;
-  UINTN           BlockOffset;
+  EFI_STATUS  Status;
+  CHAR8       *Buf;
+  UINT64      Off;
+  EXT4_INODE  *Inode;
+  UINT64      DirInoSize;
+  UINT32      BlockRemainder;
+  UINTN       Length;
+
+  // Try the hash tree first, if the directory has one. Since the name hash is
+  // case-sensitive and EFI lookups are not, a miss doesn't mean the name isn't there
+  // under a different case, so fall back to the linear scan then, and when there's
+  // no usable index. Other errors (e.g. disk errors) are returned as is.
+  Status = Ext4HtreeRetrieveDirent (Directory, Name, Partition, Result);
+
+  if ((Status != EFI_NOT_FOUND) && (Status != EFI_UNSUPPORTED) && (Status != EFI_VOLUME_CORRUPTED)) {
+    return Status;
+  }
 
   Buf = AllocatePool (Partition->BlockSize);
 
@@ -147,63 +237,10 @@ Ext4RetrieveDirent (
       goto Out;
     }
 
-    for (BlockOffset = 0; BlockOffset < Partition->BlockSize; ) {
-      Entry          = (EXT4_DIR_ENTRY *)(Buf + BlockOffset);
-      RemainingBlock = Partition->BlockSize - BlockOffset;
-      // Check if the minimum directory entry fits inside [BlockOffset, EndOfBlock]
-      if (RemainingBlock < EXT4_MIN_DIR_ENTRY_LEN) {
-        Status = EFI_VOLUME_CORRUPTED;
-        goto Out;
-      }
-
-      if (!Ext4ValidDirent (Entry)) {
-        Status = EFI_VOLUME_CORRUPTED;
-        goto Out;
-      }
-
-      if ((Entry->name_len > RemainingBlock) || (Entry->rec_len > RemainingBlock)) {
-        // Corrupted filesystem
-        Status = EFI_VOLUME_CORRUPTED;
-        goto Out;
-      }
-
-      // Unused entry
-      if (Entry->inode == 0) {
-        BlockOffset += Entry->rec_len;
-        continue;
-      }
-
-      Status = Ext4GetUcs2DirentName (Entry, DirentUcs2Name);
-
-      /* In theory, this should never fail.
-       * In reality, it's quite possible that it can fail, considering filenames in
-       * Linux (and probably other nixes) are just null-terminated bags of bytes, and don't
-       * need to form valid ASCII/UTF-8 sequences.
-       */
-      if (EFI_ERROR (Status)) {
-        if (Status == EFI_INVALID_PARAMETER) {
-          // If we error out due to a bad UTF-8 sequence (see Ext4GetUcs2DirentName), skip this entry.
-          // I'm not sure if this is correct behaviour, but I don't think there's a precedent here.
-          BlockOffset += Entry->rec_len;
-          continue;
-        }
-
-        // Other sorts of errors should just error out.
-        FreePool (Buf);
-        return Status;
-      }
-
-      if ((Entry->name_len == StrLen (Name)) &&
-          !Ext4StrCmpInsensitive (DirentUcs2Name, (CHAR16 *)Name))
-      {
-        ToCopy = MIN (Entry->rec_len, sizeof (EXT4_DIR_ENTRY));
-
-        CopyMem (Result, Entry, ToCopy);
-        Status = EFI_SUCCESS;
-        goto Out;
-      }
+    Status = Ext4SearchDirBlock (Partition, Buf, Name, Result);
 
-      BlockOffset += Entry->rec_len;
+    if (Status != EFI_NOT_FOUND) {
+      goto Out;
     }
 
     Off += Partition->BlockSize;
@@ -217,68 +254,36 @@ Out:
 }
 
 /**
-   Opens a file using a directory entry.
+   Opens a file using its dentry.
 
    @param[in]      Partition   Pointer to the ext4 partition.
-   @param[in]      OpenMode    Mode in which the file is supposed to be open.
    @param[out]     OutFile     Pointer to the newly opened file.
-   @param[in]      Entry       Directory entry to be used.
-   @param[in]      Directory   Pointer to the opened directory.
+   @param[in]      Dentry      Dentry to be used. The caller's reference is
+                               passed to the file (or dropped on failure).
+   @param[in]      InodeNum    Inode number of the file.
 
    @retval EFI_STATUS          Result of the operation
 **/
+STATIC
 EFI_STATUS
-Ext4OpenDirent (
+Ext4OpenDentry (
   IN  EXT4_PARTITION  *Partition,
-  IN  UINT64          OpenMode,
   OUT EXT4_FILE       **OutFile,
-  IN  EXT4_DIR_ENTRY  *Entry,
-  IN  EXT4_FILE       *Directory
+  IN  EXT4_DENTRY     *Dentry,
+  IN  EXT4_INO_NR     InodeNum
   )
 {
   EFI_STATUS  Status;
-  CHAR16      FileName[EXT4_NAME_MAX + 1];
   EXT4_FILE   *File;
 
   File = AllocateZeroPool (sizeof (EXT4_FILE));
 
   if (File == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-    goto Error;
-  }
-
-  Status = Ext4GetUcs2DirentName (Entry, FileName);
-
-  if (EFI_ERROR (Status)) {
-    goto Error;
+    Ext4UnrefDentry (Dentry);
+    return EFI_OUT_OF_RESOURCES;
   }
 
-  if (StrCmp (FileName, L".") == 0) {
-    // We're using the parent directory's dentry
-    File->Dentry = Directory->Dentry;
-
-    ASSERT (File->Dentry != NULL);
-
-    Ext4RefDentry (File->Dentry);
-  } else if (StrCmp (FileName, L"..") == 0) {
-    // Using the parent's parent's dentry
-    File->Dentry = Directory->Dentry->Parent;
-
-    if (!File->Dentry) {
-      // Someone tried .. on root, so direct them to /
-      // This is an illegal EFI Open() but is possible to hit from a variety of internal code
-      File->Dentry = Directory->Dentry;
-    }
-
-    Ext4RefDentry (File->Dentry);
-  } else {
-    File->Dentry = Ext4CreateDentry (FileName, Directory->Dentry);
-
-    if (File->Dentry == NULL) {
-      Status = EFI_OUT_OF_RESOURCES;
-      goto Error;
-    }
-  }
+  File->Dentry = Dentry;
 
   Status = Ext4InitExtentsMap (File);
 
@@ -286,11 +291,11 @@ Ext4OpenDirent (
     goto Error;
   }
 
-  File->InodeNum = Entry->inode;
+  File->InodeNum = InodeNum;
 
   Ext4SetupFile (File, Partition);
 
-  Status = Ext4ReadInode (Partition, Entry->inode, &File->Inode);
+  Status = Ext4ReadInode (Partition, InodeNum, &File->Inode);
 
   if (EFI_ERROR (Status)) {
     goto Error;
@@ -303,19 +308,72 @@ Ext4OpenDirent (
   return EFI_SUCCESS;
 
 Error:
-  if (File != NULL) {
-    if (File->Dentry != NULL) {
-      Ext4UnrefDentry (File->Dentry);
+  Ext4UnrefDentry (File->Dentry);
+  Ext4FreeExtentsMap (File);
+  FreePool (File);
+
+  return Status;
+}
+
+/**
+   Opens a file using a directory entry.
+
+   @param[in]      Partition   Pointer to the ext4 partition.
+   @param[in]      OpenMode    Mode in which the file is supposed to be open.
+   @param[out]     OutFile     Pointer to the newly opened file.
+   @param[in]      Entry       Directory entry to be used.
+   @param[in]      Directory   Pointer to the opened directory.
+
+   @retval EFI_STATUS          Result of the operation
+**/
+EFI_STATUS
+Ext4OpenDirent (
+  IN  EXT4_PARTITION  *Partition,
+  IN  UINT64          OpenMode,
+  OUT EXT4_FILE       **OutFile,
+  IN  EXT4_DIR_ENTRY  *Entry,
+  IN  EXT4_FILE       *Directory
+  )
+{
+  EFI_STATUS   Status;
+  CHAR16       FileName[EXT4_NAME_MAX + 1];
+  EXT4_DENTRY  *Dentry;
+
+  Status = Ext4GetUcs2DirentName (Entry, FileName);
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (StrCmp (FileName, L".") == 0) {
+    // We're using the parent directory's dentry
+    Dentry = Directory->Dentry;
+
+    ASSERT (Dentry != NULL);
+
+    Ext4RefDentry (Dentry);
+  } else if (StrCmp (FileName, L"..") == 0) {
+    // Using the parent's parent's dentry
+    Dentry = Directory->Dentry->Parent;
+
+    if (!Dentry) {
+      // Someone tried .. on root, so direct them to /
+      // This is an illegal EFI Open() but is possible to hit from a variety of internal code
+      Dentry = Directory->Dentry;
     }
 
-    if (File->ExtentsMap != NULL) {
-      OrderedCollectionUninit (File->ExtentsMap);
+    Ext4RefDentry (Dentry);
+  } else {
+    Dentry = Ext4CreateDentry (FileName, Directory->Dentry);
+
+    if (Dentry == NULL) {
+      return EFI_OUT_OF_RESOURCES;
     }
 
-    FreePool (File);
+    Dentry->Inode = Entry->inode;
   }
 
-  return Status;
+  return Ext4OpenDentry (Partition, OutFile, Dentry, Entry->inode);
 }
 
 /**
@@ -340,9 +398,25 @@ Ext4OpenFile (
 {
   EXT4_DIR_ENTRY  Entry;
   EFI_STATUS      Status;
+  EXT4_DENTRY     *Child;
+
+  // Repeated path walks (bootloaders opening lots of files in the same directories)
+  // are mostly answered by the directory's name cache, without touching the disk.
+  if (Ext4LookupDentryCache (Directory->Dentry, Name, &Child) == EFI_SUCCESS) {
+    if (Child == NULL) {
+      return EFI_NOT_FOUND;
+    }
+
+    Ext4RefDentry (Child);
+    return Ext4OpenDentry (Partition, OutFile, Child, Child->Inode);
+  }
 
   Status = Ext4RetrieveDirent (Directory, Name, Partition, &Entry);
 
+  if (Status == EFI_NOT_FOUND) {
+    Ext4InsertDentryCache (Directory->Dentry, Name, NULL);
+  }
+
   if (EFI_ERROR (Status)) {
     return Status;
   }
@@ -352,7 +426,14 @@ Ext4OpenFile (
     return EFI_NOT_FOUND;
   }
 
-  return Ext4OpenDirent (Partition, OpenMode, OutFile, &Entry, Directory);
+  Status = Ext4OpenDirent (Partition, OpenMode, OutFile, &Entry, Directory);
+
+  // Only cache real children; "." and ".." reuse existing dentries.
+  if (!EFI_ERROR (Status) && ((*OutFile)->Dentry->Parent == Directory->Dentry)) {
+    Ext4InsertDentryCache (Directory->Dentry, Name, (*OutFile)->Dentry);
+  }
+
+  return Status;
 }
 
 /**
@@ -664,6 +745,244 @@ Ext4RefDentry (
   ASSERT (OldRef < Dentry->RefCount);
 }
 
+//
+// A dentry name cache entry. The looked up name (a NULL-terminated CHAR16 string)
+// immediately follows the structure, in the same pool allocation.
+//
+typedef struct {
+  // Child dentry (we hold a reference to it), or NULL for negative entries
+  EXT4_DENTRY    *Child;
+} EXT4_DENTRY_CACHE_ENTRY;
+
+#define EXT4_DENTRY_CACHE_ENTRY_NAME(Entry)  ((CHAR16 *)((Entry) + 1))
+
+/**
+  Compare two EXT4_DENTRY_CACHE_ENTRY structs.
+  Used in the dentry name cache's ORDERED_COLLECTION. Names are compared
+  case-insensitively, like name lookups do.
+
+  @param[in] UserStruct1  Pointer to the first user structure.
+
+  @param[in] UserStruct2  Pointer to the second user structure.
+
+  @retval <0  If UserStruct1 compares less than UserStruct2.
+
+  @retval  0  If UserStruct1 compares equal to UserStruct2.
+
+  @retval >0  If UserStruct1 compares greater than UserStruct2.
+**/
+STATIC
+INTN
+EFIAPI
+Ext4DentryCacheStructCompare (
+  IN CONST VOID  *UserStruct1,
+  IN CONST VOID  *UserStruct2
+  )
+{
+  CONST EXT4_DENTRY_CACHE_ENTRY  *Entry1;
+  CONST EXT4_DENTRY_CACHE_ENTRY  *Entry2;
+
+  Entry1 = UserStruct1;
+  Entry2 = UserStruct2;
+
+  return Ext4StrCmpInsensitive (EXT4_DENTRY_CACHE_ENTRY_NAME (Entry1), EXT4_DENTRY_CACHE_ENTRY_NAME (Entry2));
+}
+
+/**
+  Compare a standalone key against a EXT4_DENTRY_CACHE_ENTRY containing an embedded key.
+  Used in the dentry name cache's ORDERED_COLLECTION. Names are compared
+  case-insensitively, like name lookups do.
+
+  @param[in] StandaloneKey  Pointer to the bare key (a CHAR16 string).
+
+  @param[in] UserStruct     Pointer to the user structure with the embedded
+                            key.
+
+  @retval <0  If StandaloneKey compares less than UserStruct's key.
+
+  @retval  0  If StandaloneKey compares equal to UserStruct's key.
+
+  @retval >0  If StandaloneKey compares greater than UserStruct's key.
+**/
+STATIC
+INTN
+EFIAPI
+Ext4DentryCacheKeyCompare (
+  IN CONST VOID  *StandaloneKey,
+  IN CONST VOID  *UserStruct
+  )
+{
+  CONST EXT4_DENTRY_CACHE_ENTRY  *Entry;
+
+  Entry = UserStruct;
+
+  return Ext4StrCmpInsensitive ((CHAR16 *)StandaloneKey, EXT4_DENTRY_CACHE_ENTRY_NAME (Entry));
+}
+
+/**
+   Empties a dentry's name cache, dropping the references held by its entries.
+
+   @param[in out]            Dentry    Pointer to a valid EXT4_DENTRY.
+**/
+STATIC
+VOID
+Ext4DropDentryCache (
+  IN OUT EXT4_DENTRY  *Dentry
+  )
+{
+  ORDERED_COLLECTION_ENTRY  *MapEntry;
+  EXT4_DENTRY_CACHE_ENTRY   *Entry;
+  VOID                      *UserStruct;
+
+  if (Dentry->ChildCache == NULL) {
+    return;
+  }
+
+  while ((MapEntry = OrderedCollectionMin (Dentry->ChildCache)) != NULL) {
+    OrderedCollectionDelete (Dentry->ChildCache, MapEntry, &UserStruct);
+    Entry = UserStruct;
+
+    if (Entry->Child != NULL) {
+      Ext4UnrefDentry (Entry->Child);
+    }
+
+    FreePool (Entry);
+  }
+
+  OrderedCollectionUninit (Dentry->ChildCache);
+  Dentry->ChildCache           = NULL;
+  Dentry->NumberCachedChildren = 0;
+}
+
+/**
+   Looks up a name in a directory dentry's name cache.
+
+   @param[in]      Directory   Pointer to the directory's dentry.
+   @param[in]      Name        Name that's being looked up.
+   @param[out]     Child       Pointer to the cached child's dentry, or NULL
+                               if the name is known not to exist.
+                               No reference is taken.
+
+   @retval EFI_SUCCESS          The name was found in the cache.
+   @retval EFI_NOT_FOUND        The name isn't cached.
+**/
+EFI_STATUS
+Ext4LookupDentryCache (
+  IN  EXT4_DENTRY   *Directory,
+  IN  CONST CHAR16  *Name,
+  OUT EXT4_DENTRY   **Child
+  )
+{
+  ORDERED_COLLECTION_ENTRY  *MapEntry;
+  EXT4_DENTRY_CACHE_ENTRY   *Entry;
+
+  if (Directory->ChildCache == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  MapEntry = OrderedCollectionFind (Directory->ChildCache, Name);
+
+  if (MapEntry == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  Entry  = OrderedCollectionUserStruct (MapEntry);
+  *Child = Entry->Child;
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Adds the result of a name lookup to a directory dentry's name cache.
+   This is best effort; failures are silently ignored.
+
+   @param[in out]  Directory   Pointer to the directory's dentry.
+   @param[in]      Name        Name that was looked up.
+   @param[in]      Child       Pointer to the child's dentry, or NULL if
+                               the name doesn't exist.
+                               A reference is taken if it's cached.
+**/
+VOID
+Ext4InsertDentryCache (
+  IN OUT EXT4_DENTRY  *Directory,
+  IN CONST CHAR16     *Name,
+  IN EXT4_DENTRY      *Child OPTIONAL
+  )
+{
+  EXT4_DENTRY_CACHE_ENTRY  *Entry;
+  UINTN                    NameSize;
+  EFI_STATUS               Status;
+
+  if (FixedPcdGet32 (PcdExt4DentryCacheSize) == 0) {
+    return;
+  }
+
+  if (Directory->NumberCachedChildren >= FixedPcdGet32 (PcdExt4DentryCacheSize)) {
+    // Keep it simple and start over. Flushing the whole subtree makes sure the
+    // children we drop don't stay alive through their own cached children.
+    Ext4FlushDentryCache (Directory);
+  }
+
+  if (Directory->ChildCache == NULL) {
+    Directory->ChildCache = OrderedCollectionInit (Ext4DentryCacheStructCompare, Ext4DentryCacheKeyCompare);
+
+    if (Directory->ChildCache == NULL) {
+      return;
+    }
+  }
+
+  NameSize = StrSize (Name);
+  Entry    = AllocatePool (sizeof (EXT4_DENTRY_CACHE_ENTRY) + NameSize);
+
+  if (Entry == NULL) {
+    return;
+  }
+
+  Entry->Child = Child;
+  CopyMem (EXT4_DENTRY_CACHE_ENTRY_NAME (Entry), Name, NameSize);
+
+  Status = OrderedCollectionInsert (Directory->ChildCache, NULL, Entry);
+
+  if (EFI_ERROR (Status)) {
+    // Either we're out of memory, or the name is somehow already cached.
+    FreePool (Entry);
+    return;
+  }
+
+  if (Child != NULL) {
+    Ext4RefDentry (Child);
+  }
+
+  Directory->NumberCachedChildren++;
+}
+
+/**
+   Flushes the name caches of a dentry and of all of its descendants,
+   dropping the references held by them.
+
+   @param[in out]  Dentry      Pointer to a valid EXT4_DENTRY.
+**/
+VOID
+Ext4FlushDentryCache (
+  IN OUT EXT4_DENTRY  *Dentry
+  )
+{
+  LIST_ENTRY  *Node;
+  LIST_ENTRY  *NextNode;
+
+  // Our children may only be alive because of our cache (and we may only be alive
+  // because of theirs), so keep ourselves alive while we tear the subtree down.
+  Ext4RefDentry (Dentry);
+
+  BASE_LIST_FOR_EACH_SAFE (Node, NextNode, &Dentry->Children) {
+    Ext4FlushDentryCache (EXT4_DENTRY_FROM_DENTRY_LIST (Node));
+  }
+
+  Ext4DropDentryCache (Dentry);
+
+  Ext4UnrefDentry (Dentry);
+}
+
 /**
    Deletes the dentry.
 
@@ -675,6 +994,10 @@ Ext4DeleteDentry (
   IN OUT EXT4_DENTRY  *Dentry
   )
 {
+  // Positive cache entries hold references to us (through their ->Parent),
+  // so only negative ones may be left by now.
+  Ext4DropDentryCache (Dentry);
+
   if (Dentry->Parent) {
     Ext4RemoveDentry (Dentry->Parent, Dentry);
     Ext4UnrefDentry (Dentry->Parent);
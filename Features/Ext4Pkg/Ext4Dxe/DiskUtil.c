@@ -24,6 +24,9 @@ Ext4ReadDiskIo (
   IN UINT64          Offset
   )
 {
+  Partition->NumberDiskReads++;
+  Partition->BytesRead += Length;
+
   return EXT4_DISK_IO (Partition)->ReadDisk (
                                      EXT4_DISK_IO (Partition),
                                      EXT4_MEDIA_ID (Partition),
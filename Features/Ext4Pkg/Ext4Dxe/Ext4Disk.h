@@ -68,7 +68,8 @@
           mostly-list of EXT4_DIR_ENTRY.
        2) Hash tree directories: These are used for larger directories, with
           hundreds of entries, and are designed in a backwards compatible way.
-          These are not yet implemented in the Ext4Dxe driver.
+          Ext4Dxe uses them to speed up lookups, and reads them as linear
+          directories otherwise.
 
   7) Journal
      Ext3/4 filesystems have a journal to help protect the filesystem against
@@ -424,6 +425,69 @@ typedef struct {
 
 #define EXT4_MIN_DIR_ENTRY_LEN  8
 
+// Hash tree (dir_index) directories.
+// The first block of the directory (the dx root) and the interior blocks (dx nodes) of the
+// tree are disguised as directory entries that span the whole block, so that
+// implementations that don't know about hash trees see them as empty directory blocks.
+
+// Hash algorithms, as found in EXT4_DX_ROOT_INFO.hash_version
+#define EXT4_HTREE_LEGACY             0
+#define EXT4_HTREE_HALF_MD4           1
+#define EXT4_HTREE_TEA                2
+#define EXT4_HTREE_LEGACY_UNSIGNED    3
+#define EXT4_HTREE_HALF_MD4_UNSIGNED  4
+#define EXT4_HTREE_TEA_UNSIGNED       5
+#define EXT4_HTREE_SIPHASH            6
+
+// s_flags bits that tell us if the filesystem's hashes were calculated using signed or
+// unsigned chars.
+#define EXT4_FLAGS_SIGNED_HASH    0x1
+#define EXT4_FLAGS_UNSIGNED_HASH  0x2
+
+typedef struct {
+  UINT32    reserved_zero;
+  UINT8     hash_version;
+  // Length of this structure (always 8)
+  UINT8     info_length;
+  // Depth of the tree, not counting the leaves
+  UINT8     indirect_levels;
+  UINT8     unused_flags;
+} EXT4_DX_ROOT_INFO;
+
+// Note: The first EXT4_DX_ENTRY of every node overlaps with this structure
+// (its hash field is replaced by limit + count).
+typedef struct {
+  // Maximum number of EXT4_DX_ENTRY's that fit in this node
+  UINT16    limit;
+  // Number of EXT4_DX_ENTRY's in this node
+  UINT16    count;
+} EXT4_DX_COUNTLIMIT;
+
+typedef struct {
+  UINT32    hash;
+  // Logical block (inside the directory) of the next level of the tree
+  UINT32    block;
+} EXT4_DX_ENTRY;
+
+// Present after the last possible EXT4_DX_ENTRY on metadata_csum filesystems
+typedef struct {
+  UINT32    dt_reserved;
+  // CRC32C of UUID + inode number + igeneration + dx node up to the last used entry + dt_reserved
+  UINT32    dt_checksum;
+} EXT4_DX_TAIL;
+
+// The dx root starts with a "." entry (12 bytes) and a ".." entry's header and name (12 bytes)
+#define EXT4_DX_ROOT_INFO_OFFSET  24
+// A dx node starts with a fake, empty directory entry header
+#define EXT4_DX_NODE_ENTRIES_OFFSET  8
+
+// Only the lower 28 bits of EXT4_DX_ENTRY.block are used
+#define EXT4_DX_BLOCK_MASK  0x0FFFFFFF
+
+// Maximum depth of a hash tree, counting the leaves
+#define EXT4_HTREE_LEVEL_COMPAT  2
+#define EXT4_HTREE_LEVEL         3
+
 // This on-disk structure is present at the bottom of the extent tree
 typedef struct {
   // First logical block
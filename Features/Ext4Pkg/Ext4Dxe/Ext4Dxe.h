@@ -54,6 +54,39 @@
 //
 #define EXT4_LOG_BLOCK_SIZE_MAX  11
 
+//
+// Per-partition cache of metadata blocks (inode tables, directories, extent tree
+// and indirect blocks), looked up by physical block number and evicted in least
+// recently used order. Its size is set by PcdExt4BlockCacheSize.
+//
+typedef struct {
+  // Map of physical block number -> cached block
+  ORDERED_COLLECTION    *Map;
+  // Cached blocks, from most to least recently used
+  LIST_ENTRY            LruList;
+  UINT32                NumberEntries;
+  UINT32                MaxEntries;
+
+  UINT64                Hits;
+  UINT64                Misses;
+} EXT4_BLOCK_CACHE;
+
+//
+// Per-partition cache of verified inodes, looked up by inode number and evicted in least
+// recently used order. Its size is set by PcdExt4InodeCacheSize.
+//
+typedef struct {
+  // Map of inode number -> cached inode
+  ORDERED_COLLECTION    *Map;
+  // Cached inodes, from most to least recently used
+  LIST_ENTRY            LruList;
+  UINT32                NumberEntries;
+  UINT32                MaxEntries;
+
+  UINT64                Hits;
+  UINT64                Misses;
+} EXT4_INODE_CACHE;
+
 /**
    Opens an ext4 partition and installs the Simple File System protocol.
 
@@ -104,16 +137,24 @@ typedef struct _Ext4_PARTITION {
   LIST_ENTRY                         OpenFiles;
 
   EXT4_DENTRY                        *RootDentry;
+
+  EXT4_BLOCK_CACHE                   BlockCache;
+  EXT4_INODE_CACHE                   InodeCache;
+
+  // Disk I/O statistics, reported (along with the caches') when the partition is unmounted.
+  UINT64                             NumberDiskReads;
+  UINT64                             NumberAsyncDiskReads;
+  UINT64                             BytesRead;
 } EXT4_PARTITION;
 
 /**
    This structure represents a directory entry inside our directory entry tree.
-   For now, it will be used as a way to track file names inside our opening
-   code, but it may very well be used as a directory cache in the future.
-   Because it's not being used as a directory cache right now,
-   an EXT4_DENTRY structure is not necessarily unique name-wise in the list of
-   children. Therefore, the dentry tree does not accurately reflect the
-   filesystem structure.
+   It's used as a way to track file names inside our opening code, and as a
+   name lookup cache: each directory dentry remembers the results of recent
+   lookups (see ChildCache).
+   Dentries that aren't cached may be duplicated, so an EXT4_DENTRY structure
+   is not necessarily unique name-wise in the list of children. Therefore, the
+   dentry tree does not accurately reflect the filesystem structure.
  */
 struct _Ext4_Dentry {
   UINTN                  RefCount;
@@ -122,6 +163,13 @@ struct _Ext4_Dentry {
   struct _Ext4_Dentry    *Parent;
   LIST_ENTRY             Children;
   LIST_ENTRY             ListNode;
+
+  // Cache of name lookups done in this directory, keyed by the name that was looked up
+  // (compared case-insensitively, so every spelling of a name shares an entry).
+  // Positive entries hold a reference to the child's dentry (which, in turn, holds one
+  // to us), negative entries remember that the name doesn't exist.
+  ORDERED_COLLECTION     *ChildCache;
+  UINTN                  NumberCachedChildren;
 };
 
 #define EXT4_DENTRY_FROM_DENTRY_LIST(Node)  BASE_CR(Node, EXT4_DENTRY, ListNode)
@@ -164,6 +212,53 @@ Ext4UnrefDentry (
   IN OUT EXT4_DENTRY  *Dentry
   );
 
+/**
+   Looks up a name in a directory dentry's name cache.
+
+   @param[in]      Directory   Pointer to the directory's dentry.
+   @param[in]      Name        Name that's being looked up.
+   @param[out]     Child       Pointer to the cached child's dentry, or NULL
+                               if the name is known not to exist.
+                               No reference is taken.
+
+   @retval EFI_SUCCESS          The name was found in the cache.
+   @retval EFI_NOT_FOUND        The name isn't cached.
+**/
+EFI_STATUS
+Ext4LookupDentryCache (
+  IN  EXT4_DENTRY   *Directory,
+  IN  CONST CHAR16  *Name,
+  OUT EXT4_DENTRY   **Child
+  );
+
+/**
+   Adds the result of a name lookup to a directory dentry's name cache.
+   This is best effort; failures are silently ignored.
+
+   @param[in out]  Directory   Pointer to the directory's dentry.
+   @param[in]      Name        Name that was looked up.
+   @param[in]      Child       Pointer to the child's dentry, or NULL if
+                               the name doesn't exist.
+                               A reference is taken if it's cached.
+**/
+VOID
+Ext4InsertDentryCache (
+  IN OUT EXT4_DENTRY  *Directory,
+  IN CONST CHAR16     *Name,
+  IN EXT4_DENTRY      *Child OPTIONAL
+  );
+
+/**
+   Flushes the name caches of a dentry and of all of its descendants,
+   dropping the references held by them.
+
+   @param[in out]  Dentry      Pointer to a valid EXT4_DENTRY.
+**/
+VOID
+Ext4FlushDentryCache (
+  IN OUT EXT4_DENTRY  *Dentry
+  );
+
 /**
    Opens and parses the superblock.
 
@@ -264,6 +359,119 @@ Ext4AllocAndReadBlocks (
   IN EXT4_BLOCK_NR   BlockNumber
   );
 
+/**
+   Initialises the partition's (empty) metadata block cache.
+   The size of the cache is taken from PcdExt4BlockCacheSize; a size of 0 disables it.
+
+   @param[in out]  Partition   Pointer to the opened partition. Partition->BlockSize
+                               must already be valid.
+
+   @retval EFI_SUCCESS          The cache was initialised.
+   @retval EFI_OUT_OF_RESOURCES Not enough memory to set up the cache.
+**/
+EFI_STATUS
+Ext4InitBlockCache (
+  IN OUT EXT4_PARTITION  *Partition
+  );
+
+/**
+   Frees the partition's metadata block cache, dropping every cached block.
+
+   @param[in out]  Partition   Pointer to the opened partition.
+**/
+VOID
+Ext4FreeBlockCache (
+  IN OUT EXT4_PARTITION  *Partition
+  );
+
+/**
+   Reads from the partition's disk through the metadata block cache.
+   Falls back to reading directly from the disk if the cache is disabled
+   or a block can't be cached.
+
+   @param[in]  Partition      Pointer to the opened ext4 partition.
+   @param[out] Buffer         Pointer to a destination buffer.
+   @param[in]  Length         Length of the destination buffer.
+   @param[in]  Offset         Offset, in bytes, of the location to read.
+
+   @return Success status of the read.
+**/
+EFI_STATUS
+Ext4ReadDiskIoCached (
+  IN EXT4_PARTITION  *Partition,
+  OUT VOID           *Buffer,
+  IN UINTN           Length,
+  IN UINT64          Offset
+  );
+
+/**
+   Reads blocks from the partition's disk through the metadata block cache.
+
+   @param[in]  Partition      Pointer to the opened ext4 partition.
+   @param[out] Buffer         Pointer to a destination buffer.
+   @param[in]  NumberBlocks   Length of the read, in filesystem blocks.
+   @param[in]  BlockNumber    Starting block number.
+
+   @return Success status of the read.
+**/
+EFI_STATUS
+Ext4ReadBlocksCached (
+  IN EXT4_PARTITION  *Partition,
+  OUT VOID           *Buffer,
+  IN UINTN           NumberBlocks,
+  IN EXT4_BLOCK_NR   BlockNumber
+  );
+
+/**
+   Initialises the partition's (empty) inode cache.
+   The size of the cache is taken from PcdExt4InodeCacheSize; a size of 0 disables it.
+
+   @param[in out]  Partition   Pointer to the opened partition. Partition->InodeSize
+                               must already be valid.
+
+   @retval EFI_SUCCESS          The cache was initialised.
+   @retval EFI_OUT_OF_RESOURCES Not enough memory to set up the cache.
+**/
+EFI_STATUS
+Ext4InitInodeCache (
+  IN OUT EXT4_PARTITION  *Partition
+  );
+
+/**
+   Frees the partition's inode cache, dropping every cached inode.
+
+   @param[in out]  Partition   Pointer to the opened partition.
+**/
+VOID
+Ext4FreeInodeCache (
+  IN OUT EXT4_PARTITION  *Partition
+  );
+
+/**
+   Reads an inode through the inode cache. On a miss, the whole inode table block that
+   holds the inode is read and its inodes cached, so looking up the next inodes in the
+   block (as listing a directory usually does) doesn't need any more I/O.
+
+   @param[in]      Partition        Pointer to the opened partition.
+   @param[in]      InodeNum         Inode number.
+   @param[in]      BlockGroupNumber Block group of the inode.
+   @param[in]      InodeTableStart  First block of the block group's inode table.
+   @param[in]      InodeOffset      Index of the inode in the block group.
+   @param[out]     Inode            Pointer to the inode, as allocated by Ext4AllocateInode.
+
+   @retval EFI_SUCCESS        The inode was found in the cache (and is already verified).
+   @retval EFI_NOT_FOUND      The inode could not be cached. The caller needs to read it by itself.
+**/
+EFI_STATUS
+Ext4ReadInodeCached (
+  IN  EXT4_PARTITION  *Partition,
+  IN  EXT4_INO_NR     InodeNum,
+  IN  UINT32          BlockGroupNumber,
+  IN  EXT4_BLOCK_NR   InodeTableStart,
+  IN  UINT64          InodeOffset,
+  OUT EXT4_INODE      *Inode
+  );
+
 /**
    Checks if the opened partition has the 64-bit feature (see
 EXT4_FEATURE_INCOMPAT_64BIT).
@@ -380,7 +588,9 @@ cover.
 will be copied to.
 
    @retval EFI_SUCCESS        Retrieval was successful.
-   @retval EFI_NO_MAPPING     Block has no mapping.
+   @retval EFI_NO_MAPPING     Block has no mapping. If the size of the file hole
+is known, Extent is set to an uninitialized extent that starts at LogicalBlock
+and covers (the start of) the hole. Else, Extent->ee_len is set to 0.
 **/
 EFI_STATUS
 Ext4GetExtent (
@@ -390,6 +600,30 @@ Ext4GetExtent (
   OUT EXT4_EXTENT    *Extent
   );
 
+//
+// Cache of a file's extents: a sorted (by ee_block) array of non-overlapping extents.
+// Sequential reads look up extents in order, so we remember where the last lookup
+// ended up and check there (and right after it) before doing a binary search.
+//
+typedef struct {
+  EXT4_EXTENT    *Extents;
+  UINTN          NumberExtents;
+  UINTN          Capacity;
+  UINTN          LastHit;
+} EXT4_EXTENT_MAP;
+
+// Note: The largest block map path we can take uses up 4 indices
+#define EXT4_MAX_BLOCK_PATH  4
+
+//
+// Indirect block of an ext2/3 block map, as cached in the file.
+// BlockNumber is 0 (never a valid indirect block) if the entry is unused.
+//
+typedef struct {
+  EXT4_BLOCK_NR    BlockNumber;
+  UINT32           *Data;
+} EXT4_BLOCK_MAP_CACHE;
+
 struct _Ext4File {
   EFI_FILE_PROTOCOL     Protocol;
   EXT4_INODE            *Inode;
@@ -401,12 +635,23 @@ struct _Ext4File {
 
   EXT4_PARTITION        *Partition;
 
-  ORDERED_COLLECTION    *ExtentsMap;
+  EXT4_EXTENT_MAP       ExtentsMap;
+
+  // Most recently used indirect block of each level of the block map (ext2/3 only).
+  EXT4_BLOCK_MAP_CACHE  BlockMapCache[EXT4_MAX_BLOCK_PATH - 1];
 
   LIST_ENTRY            OpenFilesListNode;
 
   // Owning reference to this file's directory entry.
   EXT4_DENTRY           *Dentry;
+
+  // Sequential read-ahead window (see PcdExt4ReadAheadSize). It holds
+  // ReadAheadLength bytes of the file, starting at ReadAheadOffset.
+  UINT8                 *ReadAheadBuffer;
+  UINT64                ReadAheadOffset;
+  UINTN                 ReadAheadLength;
+  // Offset right after the end of the last read, used to detect sequential reads.
+  UINT64                NextReadOffset;
 };
 
 #define EXT4_FILE_FROM_THIS(This)  BASE_CR ((This), EXT4_FILE, Protocol)
@@ -432,6 +677,53 @@ Ext4RetrieveDirent (
   OUT EXT4_DIR_ENTRY  *Result
   );
 
+/**
+   Searches a single directory block for a directory entry.
+
+   @param[in]      Partition   Pointer to the ext4 partition.
+   @param[in]      Block       Pointer to the directory block, Partition->BlockSize bytes long.
+   @param[in]      Name        Pointer to the UCS-2 formatted filename.
+   @param[out]     Result      Pointer to the destination directory entry.
+
+   @retval EFI_SUCCESS          The entry was found and copied to Result.
+   @retval EFI_NOT_FOUND        The entry is not in this block.
+   @retval EFI_VOLUME_CORRUPTED The directory block is corrupted.
+   @retval !EFI_SUCCESS         Another error occurred.
+**/
+EFI_STATUS
+Ext4SearchDirBlock (
+  IN EXT4_PARTITION   *Partition,
+  IN CONST CHAR8      *Block,
+  IN CONST CHAR16     *Name,
+  OUT EXT4_DIR_ENTRY  *Result
+  );
+
+/**
+   Retrieves a directory entry using the directory's hash tree.
+
+   Note that the hash of a name is case-sensitive, so this will only find
+   entries whose names match exactly.
+
+   @param[in]      Directory   Pointer to the opened directory.
+   @param[in]      Name        Pointer to the UCS-2 formatted filename.
+   @param[in]      Partition   Pointer to the ext4 partition.
+   @param[out]     Result      Pointer to the destination directory entry.
+
+   @retval EFI_SUCCESS          The entry was found.
+   @retval EFI_UNSUPPORTED      The directory isn't hash tree indexed, or uses an
+                                unsupported hash.
+   @retval EFI_NOT_FOUND        The entry wasn't found.
+   @retval EFI_VOLUME_CORRUPTED The hash tree is corrupted.
+   @retval !EFI_SUCCESS         Another error occurred.
+**/
+EFI_STATUS
+Ext4HtreeRetrieveDirent (
+  IN EXT4_FILE        *Directory,
+  IN CONST CHAR16     *Name,
+  IN EXT4_PARTITION   *Partition,
+  OUT EXT4_DIR_ENTRY  *Result
+  );
+
 /**
    Opens a file.
 
@@ -1057,6 +1349,25 @@ Ext4CalculateChecksum (
   IN UINT32                InitialValue
   );
 
+/**
+   Updates a CRC32C with a buffer. Unlike CalculateCrc32c, the CRC isn't inverted
+   before or after, which is what ext4 expects.
+   Uses the CPU's CRC32C instructions if they're available, and falls back to
+   the table-driven implementation in BaseLib if not.
+
+   @param[in]      Buffer        Pointer to the buffer.
+   @param[in]      Length        Length of the buffer, in bytes.
+   @param[in]      InitialValue  Initial value of the CRC.
+
+   @return The updated CRC.
+**/
+UINT32
+Ext4CalculateCrc32c (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length,
+  IN UINT32      InitialValue
+  );
+
 /**
    Calculates the checksum of the given inode.
    @param[in]      Partition     Pointer to the opened EXT4 partition.
@@ -1252,4 +1563,14 @@ Ext4GetBlocks (
   OUT EXT4_EXTENT     *Extent
   );
 
+/**
+   Frees the indirect blocks cached by Ext4GetBlocks.
+
+   @param[in]      File          Pointer to the opened file.
+**/
+VOID
+Ext4FreeBlockMapCache (
+  IN EXT4_FILE  *File
+  );
+
 #endif
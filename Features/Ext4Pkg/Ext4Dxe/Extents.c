@@ -34,7 +34,7 @@ Ext4CalculateExtentChecksum (
   );
 
 /**
-   Caches a range of extents, by allocating pool memory for each extent and adding it to the tree.
+   Caches a range of extents, by adding them to the file's sorted extents array.
 
    @param[in]      File        Pointer to the open file.
    @param[in]      Extents     Pointer to an array of extents.
@@ -54,6 +54,7 @@ Ext4CacheExtents (
    @param[in]      Block         Block we want to grab.
 
    @return Pointer to the extent, or NULL if it was not found.
+           The pointer is only valid until the next extent is cached.
 **/
 EXT4_EXTENT *
 Ext4GetExtentFromMap (
@@ -61,6 +62,9 @@ Ext4GetExtentFromMap (
   IN UINT32     Block
   );
 
+// Initial capacity of the extents array, grown by doubling.
+#define EXT4_EXTENTS_MAP_MIN_CAPACITY  16
+
 /**
    Retrieves the pointer to the top of the extent tree.
    @param[in]      Inode         Pointer to the inode structure.
@@ -229,6 +233,38 @@ Ext4ExtentIdxLeafBlock (
 // Results of sizeof(i_data) / sizeof(extent) - 1 = 4
 #define EXT4_NR_INLINE_EXTENTS  4
 
+/**
+   Describes a file hole as an uninitialized extent, like Ext4GetBlocks does for block maps.
+
+   @param[in]      LogicalBlock  First block of the hole.
+   @param[in]      EndBlock      Block right after the end of the hole. Must be larger than LogicalBlock.
+   @param[out]     Extent        Pointer to the output extent.
+**/
+STATIC
+VOID
+Ext4GetHoleExtent (
+  IN  UINT32       LogicalBlock,
+  IN  UINT64       EndBlock,
+  OUT EXT4_EXTENT  *Extent
+  )
+{
+  UINT64  Count;
+
+  ASSERT (EndBlock > LogicalBlock);
+
+  Count = EndBlock - LogicalBlock;
+
+  // Longer holes are simply split into multiple (maximum sized) uninitialized extents.
+  if (Count > EXT4_EXTENT_MAX_INITIALIZED - 1) {
+    Count = EXT4_EXTENT_MAX_INITIALIZED - 1;
+  }
+
+  Extent->ee_block    = LogicalBlock;
+  Extent->ee_start_hi = 0;
+  Extent->ee_start_lo = 0;
+  Extent->ee_len      = (UINT16)(EXT4_EXTENT_MAX_INITIALIZED + Count);
+}
+
 /**
    Retrieves an extent from an EXT4 inode.
    @param[in]      Partition     Pointer to the opened EXT4 partition.
@@ -237,7 +273,10 @@ Ext4ExtentIdxLeafBlock (
    @param[out]     Extent        Pointer to the output buffer, where the extent will be copied to.
 
    @retval EFI_SUCCESS        Retrieval was successful.
-   @retval EFI_NO_MAPPING     Block has no mapping.
+   @retval EFI_NO_MAPPING     Block has no mapping. If the size of the file hole is known,
+                              Extent is set to an uninitialized extent that starts at
+                              LogicalBlock and covers (the start of) the hole.
+                              Else, Extent->ee_len is set to 0.
 **/
 EFI_STATUS
 Ext4GetExtent (
@@ -256,11 +295,18 @@ Ext4GetExtent (
   EFI_STATUS          Status;
   UINT32              MaxExtentsPerNode;
   EXT4_BLOCK_NR       BlockNumber;
+  UINT64              HoleEnd;
 
   Inode  = File->Inode;
   Ext    = NULL;
   Buffer = NULL;
 
+  // Unless we find out otherwise, the size of a hole is unknown.
+  Extent->ee_len = 0;
+
+  // Holes extend up to the next mapped block, which we keep track of while walking the tree.
+  HoleEnd = (UINT64)MAX_UINT32 + 1;
+
   DEBUG ((DEBUG_FS, "[ext4] Looking up extent for block %lu\n", LogicalBlock));
 
   // ext4 does not have support for logical block numbers bigger than UINT32_MAX
@@ -315,6 +361,12 @@ Ext4GetExtent (
     Index       = Ext4BinsearchExtentIndex (ExtHeader, LogicalBlock);
     BlockNumber = Ext4ExtentIdxLeafBlock (Index);
 
+    if ((Index + 1 < (EXT4_EXTENT_INDEX *)(ExtHeader + 1) + ExtHeader->eh_entries) &&
+        ((Index + 1)->ei_block < HoleEnd))
+    {
+      HoleEnd = (Index + 1)->ei_block;
+    }
+
     // Check that block isn't file hole
     if (BlockNumber == EXT4_BLOCK_FILE_HOLE) {
       if (Buffer != NULL) {
@@ -333,7 +385,7 @@ Ext4GetExtent (
 
     // Read the leaf block onto the previously-allocated buffer.
 
-    Status = Ext4ReadBlocks (Partition, Buffer, 1, BlockNumber);
+    Status = Ext4ReadBlocksCached (Partition, Buffer, 1, BlockNumber);
     if (EFI_ERROR (Status)) {
       FreePool (Buffer);
       return Status;
@@ -368,6 +420,10 @@ Ext4GetExtent (
   Ext = Ext4BinsearchExtentExt (ExtHeader, LogicalBlock);
 
   if (!Ext) {
+    if (LogicalBlock < HoleEnd) {
+      Ext4GetHoleExtent ((UINT32)LogicalBlock, HoleEnd, Extent);
+    }
+
     if (Buffer != NULL) {
       FreePool (Buffer);
     }
@@ -376,7 +432,19 @@ Ext4GetExtent (
   }
 
   if (!((LogicalBlock >= Ext->ee_block) && (Ext->ee_block + Ext4GetExtentLength (Ext) > LogicalBlock))) {
-    // This extent does not cover the block
+    // This extent does not cover the block. The hole ends where the next extent starts.
+    if (LogicalBlock < Ext->ee_block) {
+      HoleEnd = Ext->ee_block;
+    } else if ((Ext + 1 < (EXT4_EXTENT *)(ExtHeader + 1) + ExtHeader->eh_entries) &&
+               ((Ext + 1)->ee_block < HoleEnd))
+    {
+      HoleEnd = (Ext + 1)->ee_block;
+    }
+
+    if (LogicalBlock < HoleEnd) {
+      Ext4GetHoleExtent ((UINT32)LogicalBlock, HoleEnd, Extent);
+    }
+
     if (Buffer != NULL) {
       FreePool (Buffer);
     }
@@ -394,127 +462,178 @@ Ext4GetExtent (
 }
 
 /**
-  Compare two EXT4_EXTENT structs.
-  Used in the extent map's ORDERED_COLLECTION.
-
-  @param[in] UserStruct1  Pointer to the first user structure.
-
-  @param[in] UserStruct2  Pointer to the second user structure.
-
-  @retval <0  If UserStruct1 compares less than UserStruct2.
+   Initialises the (empty) extents map, that will work as a cache of extents.
 
-  @retval  0  If UserStruct1 compares equal to UserStruct2.
+   @param[in]      File        Pointer to the open file.
 
-  @retval >0  If UserStruct1 compares greater than UserStruct2.
+   @return Result of the operation.
 **/
-STATIC
-INTN
-EFIAPI
-Ext4ExtentsMapStructCompare (
-  IN CONST VOID  *UserStruct1,
-  IN CONST VOID  *UserStruct2
+EFI_STATUS
+Ext4InitExtentsMap (
+  IN EXT4_FILE  *File
   )
 {
-  CONST EXT4_EXTENT  *Extent1;
-  CONST EXT4_EXTENT  *Extent2;
-
-  Extent1 = UserStruct1;
-  Extent2 = UserStruct2;
+  // The array is only allocated when the first extents are cached.
+  ZeroMem (&File->ExtentsMap, sizeof (EXT4_EXTENT_MAP));
 
-  return Extent1->ee_block < Extent2->ee_block ? -1 :
-         Extent1->ee_block > Extent2->ee_block ? 1 : 0;
+  return EFI_SUCCESS;
 }
 
 /**
-  Compare a standalone key against a EXT4_EXTENT containing an embedded key.
-  Used in the extent map's ORDERED_COLLECTION.
+   Frees the extents map, deleting every extent stored.
 
-  @param[in] StandaloneKey  Pointer to the bare key.
+   @param[in]      File        Pointer to the open file.
+**/
+VOID
+Ext4FreeExtentsMap (
+  IN EXT4_FILE  *File
+  )
+{
+  if (File->ExtentsMap.Extents != NULL) {
+    FreePool (File->ExtentsMap.Extents);
+  }
 
-  @param[in] UserStruct     Pointer to the user structure with the embedded
-                            key.
+  ZeroMem (&File->ExtentsMap, sizeof (EXT4_EXTENT_MAP));
+}
 
-  @retval <0  If StandaloneKey compares less than UserStruct's key.
+/**
+   Finds the first extent in the map that starts at or after a given block.
 
-  @retval  0  If StandaloneKey compares equal to UserStruct's key.
+   @param[in]      Map         Pointer to the extents map.
+   @param[in]      Block       Logical block.
 
-  @retval >0  If StandaloneKey compares greater than UserStruct's key.
+   @return Index of the extent, or Map->NumberExtents if there's none.
 **/
 STATIC
-INTN
-EFIAPI
-Ext4ExtentsMapKeyCompare (
-  IN CONST VOID  *StandaloneKey,
-  IN CONST VOID  *UserStruct
+UINTN
+Ext4ExtentsMapLowerBound (
+  IN CONST EXT4_EXTENT_MAP  *Map,
+  IN UINT32                 Block
   )
 {
-  CONST EXT4_EXTENT  *Extent;
-  UINT32             Block;
+  UINTN  l;
+  UINTN  r;
+  UINTN  m;
+
+  l = 0;
+  r = Map->NumberExtents;
 
-  // Note that logical blocks are 32-bits in size so no truncation can happen here
-  // with regards to 32-bit architectures.
-  Extent = UserStruct;
-  Block  = (UINT32)(UINTN)StandaloneKey;
+  while (l < r) {
+    m = l + (r - l) / 2;
 
-  if ((Block >= Extent->ee_block) && (Block - Extent->ee_block < Ext4GetExtentLength (Extent))) {
-    return 0;
+    if (Map->Extents[m].ee_block < Block) {
+      l = m + 1;
+    } else {
+      r = m;
+    }
   }
 
-  return Block < Extent->ee_block ? -1 :
-         Block > Extent->ee_block ? 1 : 0;
+  return l;
 }
 
 /**
-   Initialises the (empty) extents map, that will work as a cache of extents.
+   Makes sure the extents map has room for a number of new extents.
 
-   @param[in]      File        Pointer to the open file.
+   @param[in out]  Map         Pointer to the extents map.
+   @param[in]      Count       Number of extents that will be added.
 
-   @return Result of the operation.
+   @return TRUE if there's enough room, FALSE if we're out of memory.
 **/
-EFI_STATUS
-Ext4InitExtentsMap (
-  IN EXT4_FILE  *File
+STATIC
+BOOLEAN
+Ext4ExtentsMapReserve (
+  IN OUT EXT4_EXTENT_MAP  *Map,
+  IN UINTN                Count
   )
 {
-  File->ExtentsMap = OrderedCollectionInit (Ext4ExtentsMapStructCompare, Ext4ExtentsMapKeyCompare);
-  if (!File->ExtentsMap) {
-    return EFI_OUT_OF_RESOURCES;
+  UINTN        NewCapacity;
+  EXT4_EXTENT  *NewExtents;
+
+  if (Map->NumberExtents + Count <= Map->Capacity) {
+    return TRUE;
   }
 
-  return EFI_SUCCESS;
+  NewCapacity = Map->Capacity == 0 ? EXT4_EXTENTS_MAP_MIN_CAPACITY : Map->Capacity * 2;
+
+  while (NewCapacity < Map->NumberExtents + Count) {
+    NewCapacity *= 2;
+  }
+
+  NewExtents = ReallocatePool (
+                 Map->Capacity * sizeof (EXT4_EXTENT),
+                 NewCapacity * sizeof (EXT4_EXTENT),
+                 Map->Extents
+                 );
+
+  if (NewExtents == NULL) {
+    return FALSE;
+  }
+
+  Map->Extents  = NewExtents;
+  Map->Capacity = NewCapacity;
+  return TRUE;
 }
 
 /**
-   Frees the extents map, deleting every extent stored.
+   Inserts a single extent into the extents map, trimming it so it doesn't overlap
+   with the extents that are already cached.
 
-   @param[in]      File        Pointer to the open file.
+   @param[in out]  Map         Pointer to the extents map.
+   @param[in]      Extent      Pointer to the extent.
 **/
+STATIC
 VOID
-Ext4FreeExtentsMap (
-  IN EXT4_FILE  *File
+Ext4ExtentsMapInsertOne (
+  IN OUT EXT4_EXTENT_MAP  *Map,
+  IN CONST EXT4_EXTENT    *Extent
   )
 {
-  // Keep calling Min(), so we get an arbitrary node we can delete.
-  // If Min() returns NULL, it's empty.
+  UINTN        Index;
+  EXT4_EXTENT  New;
+  UINT64       Length;
+  UINT64       End;
+
+  Index  = Ext4ExtentsMapLowerBound (Map, Extent->ee_block);
+  New    = *Extent;
+  Length = Ext4GetExtentLength (&New);
 
-  ORDERED_COLLECTION_ENTRY  *MinEntry;
-  EXT4_EXTENT               *Ext;
+  if (Length == 0) {
+    return;
+  }
 
-  MinEntry = NULL;
+  // Already covered by the previous extent (or a duplicate)?
+  if ((Index > 0) &&
+      ((UINT64)Map->Extents[Index - 1].ee_block + Ext4GetExtentLength (&Map->Extents[Index - 1]) > New.ee_block))
+  {
+    return;
+  }
 
-  while ((MinEntry = OrderedCollectionMin (File->ExtentsMap)) != NULL) {
-    OrderedCollectionDelete (File->ExtentsMap, MinEntry, (VOID **)&Ext);
-    FreePool (Ext);
+  if (Index < Map->NumberExtents) {
+    if (Map->Extents[Index].ee_block == New.ee_block) {
+      return;
+    }
+
+    // Don't overlap the next extent. This happens when block map lookups return
+    // runs that end where we already had something cached.
+    End = (UINT64)New.ee_block + Length;
+
+    if (End > Map->Extents[Index].ee_block) {
+      Length     = Map->Extents[Index].ee_block - New.ee_block;
+      New.ee_len = (UINT16)(EXT4_EXTENT_IS_UNINITIALIZED (Extent) ? Length + EXT4_EXTENT_MAX_INITIALIZED : Length);
+    }
   }
 
-  ASSERT (OrderedCollectionIsEmpty (File->ExtentsMap));
+  if (!Ext4ExtentsMapReserve (Map, 1)) {
+    return;
+  }
 
-  OrderedCollectionUninit (File->ExtentsMap);
-  File->ExtentsMap = NULL;
+  CopyMem (&Map->Extents[Index + 1], &Map->Extents[Index], (Map->NumberExtents - Index) * sizeof (EXT4_EXTENT));
+  Map->Extents[Index] = New;
+  Map->NumberExtents++;
 }
 
 /**
-   Caches a range of extents, by allocating pool memory for each extent and adding it to the tree.
+   Caches a range of extents, by adding them to the file's sorted extents array.
 
    @param[in]      File        Pointer to the open file.
    @param[in]      Extents     Pointer to an array of extents.
@@ -527,35 +646,59 @@ Ext4CacheExtents (
   IN UINT16             NumberExtents
   )
 {
-  UINT16       Idx;
-  EXT4_EXTENT  *Extent;
-  EFI_STATUS   Status;
+  EXT4_EXTENT_MAP    *Map;
+  UINTN              Index;
+  UINT16             Idx;
+  CONST EXT4_EXTENT  *Last;
 
-  /* Note that any out of memory condition might mean we don't get to cache a whole leaf of extents
-   * in which case, future insertions might fail.
-   */
+  Map = &File->ExtentsMap;
 
-  for (Idx = 0; Idx < NumberExtents; Idx++, Extents++) {
-    Extent = AllocatePool (sizeof (EXT4_EXTENT));
+  if (NumberExtents == 0) {
+    return;
+  }
 
-    if (Extent == NULL) {
+  // Extents in a leaf are sorted and don't overlap, and leaves cover disjoint ranges of the
+  // file, so a whole leaf we haven't seen yet fits in a gap of the array and can be copied at once.
+  Last  = &Extents[NumberExtents - 1];
+  Index = Ext4ExtentsMapLowerBound (Map, Extents[0].ee_block);
+
+  if (((Index == 0) ||
+       ((UINT64)Map->Extents[Index - 1].ee_block + Ext4GetExtentLength (&Map->Extents[Index - 1]) <= Extents[0].ee_block)) &&
+      ((Index == Map->NumberExtents) ||
+       ((UINT64)Last->ee_block + Ext4GetExtentLength (Last) <= Map->Extents[Index].ee_block)))
+  {
+    if (!Ext4ExtentsMapReserve (Map, NumberExtents)) {
       return;
     }
 
-    CopyMem (Extent, Extents, sizeof (EXT4_EXTENT));
-    Status = OrderedCollectionInsert (File->ExtentsMap, NULL, Extent);
+    CopyMem (&Map->Extents[Index + NumberExtents], &Map->Extents[Index], (Map->NumberExtents - Index) * sizeof (EXT4_EXTENT));
+    CopyMem (&Map->Extents[Index], Extents, NumberExtents * sizeof (EXT4_EXTENT));
+    Map->NumberExtents += NumberExtents;
+    return;
+  }
 
-    // EFI_ALREADY_STARTED = already exists in the tree.
-    if (EFI_ERROR (Status)) {
-      FreePool (Extent);
+  // Slow path: (part of) the range is already cached, so insert the extents one by one.
+  for (Idx = 0; Idx < NumberExtents; Idx++) {
+    Ext4ExtentsMapInsertOne (Map, &Extents[Idx]);
+  }
+}
 
-      if (Status == EFI_ALREADY_STARTED) {
-        continue;
-      }
+/**
+   Checks if an extent covers a given block.
 
-      return;
-    }
-  }
+   @param[in]      Extent        Pointer to the extent.
+   @param[in]      Block         Logical block.
+
+   @return TRUE if the extent covers the block, else FALSE.
+**/
+STATIC
+BOOLEAN
+Ext4ExtentCoversBlock (
+  IN CONST EXT4_EXTENT  *Extent,
+  IN UINT32             Block
+  )
+{
+  return (Block >= Extent->ee_block) && (Block - Extent->ee_block < Ext4GetExtentLength (Extent));
 }
 
 /**
@@ -565,6 +708,7 @@ Ext4CacheExtents (
    @param[in]      Block         Block we want to grab.
 
    @return Pointer to the extent, or NULL if it was not found.
+           The pointer is only valid until the next extent is cached.
 **/
 EXT4_EXTENT *
 Ext4GetExtentFromMap (
@@ -572,15 +716,40 @@ Ext4GetExtentFromMap (
   IN UINT32     Block
   )
 {
-  ORDERED_COLLECTION_ENTRY  *Entry;
+  EXT4_EXTENT_MAP  *Map;
+  UINTN            Index;
+
+  Map = &File->ExtentsMap;
+
+  if (Map->NumberExtents == 0) {
+    return NULL;
+  }
 
-  Entry = OrderedCollectionFind (File->ExtentsMap, (CONST VOID *)(UINTN)Block);
+  // Fast path for sequential accesses: the same extent as last time, or the next one.
+  for (Index = Map->LastHit; Index < Map->NumberExtents && Index <= Map->LastHit + 1; Index++) {
+    if (Ext4ExtentCoversBlock (&Map->Extents[Index], Block)) {
+      Map->LastHit = Index;
+      return &Map->Extents[Index];
+    }
+  }
+
+  // Find the last extent that starts at or before Block.
+  Index = Ext4ExtentsMapLowerBound (Map, Block);
+
+  if ((Index == Map->NumberExtents) || (Map->Extents[Index].ee_block != Block)) {
+    if (Index == 0) {
+      return NULL;
+    }
+
+    Index--;
+  }
 
-  if (Entry == NULL) {
+  if (!Ext4ExtentCoversBlock (&Map->Extents[Index], Block)) {
     return NULL;
   }
 
-  return OrderedCollectionUserStruct (Entry);
+  Map->LastHit = Index;
+  return &Map->Extents[Index];
 }
 
 /**
@@ -437,7 +437,13 @@ Ext4CloseInternal (
   RemoveEntryList (&File->OpenFilesListNode);
   FreePool (File->Inode);
   Ext4FreeExtentsMap (File);
+  Ext4FreeBlockMapCache (File);
   Ext4UnrefDentry (File->Dentry);
+
+  if (File->ReadAheadBuffer != NULL) {
+    FreePool (File->ReadAheadBuffer);
+  }
+
   FreePool (File);
   return EFI_SUCCESS;
 }
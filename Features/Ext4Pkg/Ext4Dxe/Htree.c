@@ -0,0 +1,730 @@
+/** @file
+  Hash tree (dir_index) directory lookups
+
+  The hash functions are ports of the ones found in Linux's fs/ext4/hash.c, which
+  need to be bit-for-bit compatible with the ones used to build the tree.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "Ext4Dxe.h"
+
+#include <Library/BaseUcs2Utf8Lib.h>
+
+// Default seed for the half MD4 and TEA hashes, used if the superblock's s_hash_seed is zero.
+STATIC CONST UINT32  mExt4HtreeDefaultSeed[4] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+};
+
+// The largest possible hash value is reserved as an "end of directory" marker in
+// readdir cookies, so it's never returned by the hash function.
+#define EXT4_HTREE_EOF_32BIT  0x7fffffffU
+
+#define EXT4_TEA_DELTA  0x9E3779B9
+
+// Basic MD4 functions: selection, majority, parity
+#define EXT4_MD4_F(x, y, z)  ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT4_MD4_G(x, y, z)  (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT4_MD4_H(x, y, z)  ((x) ^ (y) ^ (z))
+
+#define EXT4_MD4_ROUND(f, a, b, c, d, x, s)                                   \
+  do {                                                                         \
+    (a) += f ((b), (c), (d)) + (x);                                            \
+    (a)  = LRotU32 ((a), (s));                                                 \
+  } while (FALSE)
+
+#define EXT4_MD4_K1  0
+#define EXT4_MD4_K2  013240474631UL
+#define EXT4_MD4_K3  015666365641UL
+
+//
+// One level of the hash tree, as it's traversed.
+//
+typedef struct {
+  // Node block, as read from disk
+  CHAR8            *Block;
+  // First entry of the node (overlaps with the count/limit pair)
+  EXT4_DX_ENTRY    *Entries;
+  // Entry we're currently following
+  EXT4_DX_ENTRY    *At;
+  UINT16           Count;
+} EXT4_HTREE_FRAME;
+
+/**
+   Performs the TEA transform used by the TEA directory hash.
+
+   @param[in out]  Buf     Hash state (4 words; only the first 2 are used).
+   @param[in]      In      Input words (4 words).
+**/
+STATIC
+VOID
+Ext4TeaTransform (
+  IN OUT UINT32    Buf[4],
+  IN CONST UINT32  In[4]
+  )
+{
+  UINT32  Sum;
+  UINT32  B0;
+  UINT32  B1;
+  UINTN   Rounds;
+
+  Sum = 0;
+  B0  = Buf[0];
+  B1  = Buf[1];
+
+  for (Rounds = 0; Rounds < 16; Rounds++) {
+    Sum += EXT4_TEA_DELTA;
+    B0  += ((B1 << 4) + In[0]) ^ (B1 + Sum) ^ ((B1 >> 5) + In[1]);
+    B1  += ((B0 << 4) + In[2]) ^ (B0 + Sum) ^ ((B0 >> 5) + In[3]);
+  }
+
+  Buf[0] += B0;
+  Buf[1] += B1;
+}
+
+/**
+   Performs the cut-down (3 rounds, 8 input words) MD4 transform used by the half MD4 hash.
+
+   @param[in out]  Buf     Hash state (4 words).
+   @param[in]      In      Input words (8 words).
+**/
+STATIC
+VOID
+Ext4HalfMd4Transform (
+  IN OUT UINT32    Buf[4],
+  IN CONST UINT32  In[8]
+  )
+{
+  UINT32  a;
+  UINT32  b;
+  UINT32  c;
+  UINT32  d;
+
+  a = Buf[0];
+  b = Buf[1];
+  c = Buf[2];
+  d = Buf[3];
+
+  // Round 1
+  EXT4_MD4_ROUND (EXT4_MD4_F, a, b, c, d, In[0] + EXT4_MD4_K1, 3);
+  EXT4_MD4_ROUND (EXT4_MD4_F, d, a, b, c, In[1] + EXT4_MD4_K1, 7);
+  EXT4_MD4_ROUND (EXT4_MD4_F, c, d, a, b, In[2] + EXT4_MD4_K1, 11);
+  EXT4_MD4_ROUND (EXT4_MD4_F, b, c, d, a, In[3] + EXT4_MD4_K1, 19);
+  EXT4_MD4_ROUND (EXT4_MD4_F, a, b, c, d, In[4] + EXT4_MD4_K1, 3);
+  EXT4_MD4_ROUND (EXT4_MD4_F, d, a, b, c, In[5] + EXT4_MD4_K1, 7);
+  EXT4_MD4_ROUND (EXT4_MD4_F, c, d, a, b, In[6] + EXT4_MD4_K1, 11);
+  EXT4_MD4_ROUND (EXT4_MD4_F, b, c, d, a, In[7] + EXT4_MD4_K1, 19);
+
+  // Round 2
+  EXT4_MD4_ROUND (EXT4_MD4_G, a, b, c, d, In[1] + EXT4_MD4_K2, 3);
+  EXT4_MD4_ROUND (EXT4_MD4_G, d, a, b, c, In[3] + EXT4_MD4_K2, 5);
+  EXT4_MD4_ROUND (EXT4_MD4_G, c, d, a, b, In[5] + EXT4_MD4_K2, 9);
+  EXT4_MD4_ROUND (EXT4_MD4_G, b, c, d, a, In[7] + EXT4_MD4_K2, 13);
+  EXT4_MD4_ROUND (EXT4_MD4_G, a, b, c, d, In[0] + EXT4_MD4_K2, 3);
+  EXT4_MD4_ROUND (EXT4_MD4_G, d, a, b, c, In[2] + EXT4_MD4_K2, 5);
+  EXT4_MD4_ROUND (EXT4_MD4_G, c, d, a, b, In[4] + EXT4_MD4_K2, 9);
+  EXT4_MD4_ROUND (EXT4_MD4_G, b, c, d, a, In[6] + EXT4_MD4_K2, 13);
+
+  // Round 3
+  EXT4_MD4_ROUND (EXT4_MD4_H, a, b, c, d, In[3] + EXT4_MD4_K3, 3);
+  EXT4_MD4_ROUND (EXT4_MD4_H, d, a, b, c, In[7] + EXT4_MD4_K3, 9);
+  EXT4_MD4_ROUND (EXT4_MD4_H, c, d, a, b, In[2] + EXT4_MD4_K3, 11);
+  EXT4_MD4_ROUND (EXT4_MD4_H, b, c, d, a, In[6] + EXT4_MD4_K3, 15);
+  EXT4_MD4_ROUND (EXT4_MD4_H, a, b, c, d, In[1] + EXT4_MD4_K3, 3);
+  EXT4_MD4_ROUND (EXT4_MD4_H, d, a, b, c, In[5] + EXT4_MD4_K3, 9);
+  EXT4_MD4_ROUND (EXT4_MD4_H, c, d, a, b, In[0] + EXT4_MD4_K3, 11);
+  EXT4_MD4_ROUND (EXT4_MD4_H, b, c, d, a, In[4] + EXT4_MD4_K3, 15);
+
+  Buf[0] += a;
+  Buf[1] += b;
+  Buf[2] += c;
+  Buf[3] += d;
+}
+
+/**
+   Calculates the legacy ("dx hack") directory hash.
+
+   @param[in]  Name        Pointer to the name.
+   @param[in]  Length      Length of the name.
+   @param[in]  Unsigned    TRUE if the name's characters are to be treated as unsigned.
+
+   @return The hash of the name.
+**/
+STATIC
+UINT32
+Ext4LegacyHash (
+  IN CONST CHAR8  *Name,
+  IN UINTN        Length,
+  IN BOOLEAN      Unsigned
+  )
+{
+  UINT32  Hash;
+  UINT32  Hash0;
+  UINT32  Hash1;
+  INT32   Char;
+
+  Hash0 = 0x12a3fe2d;
+  Hash1 = 0x37abe8f9;
+
+  while (Length-- != 0) {
+    Char = Unsigned ? (INT32)(UINT8)*Name : (INT32)(INT8)*Name;
+    Name++;
+
+    Hash = Hash1 + (Hash0 ^ (UINT32)(Char * 7152373));
+
+    if ((Hash & 0x80000000) != 0) {
+      Hash -= 0x7fffffff;
+    }
+
+    Hash1 = Hash0;
+    Hash0 = Hash;
+  }
+
+  return Hash0 << 1;
+}
+
+/**
+   Packs (part of) a name into the input words of the half MD4 and TEA hashes.
+
+   @param[in]  Name        Pointer to the (rest of the) name.
+   @param[in]  Length      Length of the rest of the name.
+   @param[out] Buf         Pointer to the output words.
+   @param[in]  Num         Number of output words.
+   @param[in]  Unsigned    TRUE if the name's characters are to be treated as unsigned.
+**/
+STATIC
+VOID
+Ext4StrToHashBuf (
+  IN CONST CHAR8  *Name,
+  IN UINTN        Length,
+  OUT UINT32      *Buf,
+  IN INTN         Num,
+  IN BOOLEAN      Unsigned
+  )
+{
+  UINT32  Pad;
+  UINT32  Val;
+  UINTN   Index;
+  INT32   Char;
+
+  Pad  = (UINT32)Length | ((UINT32)Length << 8);
+  Pad |= Pad << 16;
+
+  Val = Pad;
+
+  if (Length > (UINTN)Num * 4) {
+    Length = Num * 4;
+  }
+
+  for (Index = 0; Index < Length; Index++) {
+    Char = Unsigned ? (INT32)(UINT8)Name[Index] : (INT32)(INT8)Name[Index];
+    Val  = (UINT32)Char + (Val << 8);
+
+    if ((Index % 4) == 3) {
+      *Buf++ = Val;
+      Val    = Pad;
+      Num--;
+    }
+  }
+
+  if (--Num >= 0) {
+    *Buf++ = Val;
+  }
+
+  while (--Num >= 0) {
+    *Buf++ = Pad;
+  }
+}
+
+/**
+   Calculates the directory hash of a name.
+
+   @param[in]  Partition   Pointer to the opened partition.
+   @param[in]  Name        Pointer to the (UTF-8) name.
+   @param[in]  Length      Length of the name.
+   @param[in]  HashVersion Hash algorithm to use (EXT4_HTREE_*).
+   @param[out] Hash        Pointer to where the hash will be stored.
+
+   @retval EFI_SUCCESS          The hash was calculated.
+   @retval EFI_UNSUPPORTED      The hash algorithm is not supported.
+**/
+STATIC
+EFI_STATUS
+Ext4HtreeHash (
+  IN  CONST EXT4_PARTITION  *Partition,
+  IN  CONST CHAR8           *Name,
+  IN  UINTN                 Length,
+  IN  UINT8                 HashVersion,
+  OUT UINT32                *Hash
+  )
+{
+  UINT32   Buf[4];
+  UINT32   In[8];
+  UINTN    Index;
+  BOOLEAN  Unsigned;
+  INTN     Remaining;
+
+  CopyMem (Buf, mExt4HtreeDefaultSeed, sizeof (Buf));
+
+  // A seed of all zeros means the default seed is in use
+  for (Index = 0; Index < ARRAY_SIZE (Buf); Index++) {
+    if (Partition->SuperBlock.s_hash_seed[Index] != 0) {
+      CopyMem (Buf, Partition->SuperBlock.s_hash_seed, sizeof (Buf));
+      break;
+    }
+  }
+
+  Remaining = (INTN)Length;
+
+  switch (HashVersion) {
+    case EXT4_HTREE_LEGACY:
+    case EXT4_HTREE_LEGACY_UNSIGNED:
+      *Hash = Ext4LegacyHash (Name, Length, HashVersion == EXT4_HTREE_LEGACY_UNSIGNED);
+      break;
+    case EXT4_HTREE_HALF_MD4:
+    case EXT4_HTREE_HALF_MD4_UNSIGNED:
+      Unsigned = HashVersion == EXT4_HTREE_HALF_MD4_UNSIGNED;
+
+      while (Remaining > 0) {
+        Ext4StrToHashBuf (Name, Remaining, In, 8, Unsigned);
+        Ext4HalfMd4Transform (Buf, In);
+        Remaining -= 32;
+        Name      += 32;
+      }
+
+      *Hash = Buf[1];
+      break;
+    case EXT4_HTREE_TEA:
+    case EXT4_HTREE_TEA_UNSIGNED:
+      Unsigned = HashVersion == EXT4_HTREE_TEA_UNSIGNED;
+
+      while (Remaining > 0) {
+        Ext4StrToHashBuf (Name, Remaining, In, 4, Unsigned);
+        Ext4TeaTransform (Buf, In);
+        Remaining -= 16;
+        Name      += 16;
+      }
+
+      *Hash = Buf[0];
+      break;
+    default:
+      // SipHash is only used by casefolded + encrypted directories, which we can't read anyway.
+      return EFI_UNSUPPORTED;
+  }
+
+  *Hash &= ~1U;
+
+  if (*Hash == (EXT4_HTREE_EOF_32BIT << 1)) {
+    *Hash = (EXT4_HTREE_EOF_32BIT - 1) << 1;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Checks if the checksum of a dx root/node is correct.
+
+   @param[in]  Directory    Pointer to the opened directory.
+   @param[in]  Block        Pointer to the dx block.
+   @param[in]  CountOffset  Offset of the EXT4_DX_COUNTLIMIT inside the block.
+   @param[in]  CountLimit   Pointer to the block's EXT4_DX_COUNTLIMIT.
+
+   @return TRUE if the checksum is correct, FALSE if there is corruption.
+**/
+STATIC
+BOOLEAN
+Ext4CheckDxChecksum (
+  IN CONST EXT4_FILE           *Directory,
+  IN CONST CHAR8               *Block,
+  IN UINTN                     CountOffset,
+  IN CONST EXT4_DX_COUNTLIMIT  *CountLimit
+  )
+{
+  EXT4_PARTITION  *Partition;
+  EXT4_DX_TAIL    *Tail;
+  UINT32          Csum;
+  UINT32          DummyCsum;
+
+  Partition = Directory->Partition;
+
+  if (!EXT4_HAS_METADATA_CSUM (Partition)) {
+    return TRUE;
+  }
+
+  Tail = (EXT4_DX_TAIL *)((EXT4_DX_ENTRY *)CountLimit + CountLimit->limit);
+
+  Csum = Ext4CalculateChecksum (Partition, &Directory->InodeNum, sizeof (EXT4_INO_NR), Partition->InitialSeed);
+  Csum = Ext4CalculateChecksum (
+           Partition,
+           &Directory->Inode->i_generation,
+           sizeof (Directory->Inode->i_generation),
+           Csum
+           );
+  Csum = Ext4CalculateChecksum (Partition, Block, CountOffset + CountLimit->count * sizeof (EXT4_DX_ENTRY), Csum);
+  Csum = Ext4CalculateChecksum (Partition, &Tail->dt_reserved, sizeof (Tail->dt_reserved), Csum);
+
+  // The checksum itself is checksummed as if it were zero
+  DummyCsum = 0;
+  Csum      = Ext4CalculateChecksum (Partition, &DummyCsum, sizeof (DummyCsum), Csum);
+
+  return Tail->dt_checksum == Csum;
+}
+
+/**
+   Reads a directory block, by logical block number.
+
+   @param[in]  Partition    Pointer to the opened partition.
+   @param[in]  Directory    Pointer to the opened directory.
+   @param[in]  Block        Logical block number.
+   @param[out] Buffer       Pointer to the destination buffer, Partition->BlockSize bytes long.
+
+   @return Status of the read.
+**/
+STATIC
+EFI_STATUS
+Ext4HtreeReadBlock (
+  IN  EXT4_PARTITION  *Partition,
+  IN  EXT4_FILE       *Directory,
+  IN  UINT32          Block,
+  OUT CHAR8           *Buffer
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Length;
+
+  Length = Partition->BlockSize;
+
+  Status = Ext4Read (Partition, Directory, Buffer, MultU64x32 (Block, Partition->BlockSize), &Length);
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // A block outside of the directory is a sign of corruption.
+  if (Length != Partition->BlockSize) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Parses and validates a dx root/node, and looks up the entry we need to follow.
+
+   @param[in]      Partition    Pointer to the opened partition.
+   @param[in]      Directory    Pointer to the opened directory.
+   @param[in out]  Frame        Pointer to the frame. Frame->Block must have been read.
+   @param[in]      CountOffset  Offset of the EXT4_DX_COUNTLIMIT inside the block.
+   @param[in]      Hash         Hash of the name we're looking for.
+
+   @retval EFI_SUCCESS          Frame->At was set.
+   @retval EFI_VOLUME_CORRUPTED The node is corrupted.
+**/
+STATIC
+EFI_STATUS
+Ext4HtreeProbeNode (
+  IN     EXT4_PARTITION    *Partition,
+  IN     EXT4_FILE         *Directory,
+  IN OUT EXT4_HTREE_FRAME  *Frame,
+  IN     UINTN             CountOffset,
+  IN     UINT32            Hash
+  )
+{
+  EXT4_DX_COUNTLIMIT  *CountLimit;
+  UINTN               ExpectedLimit;
+  EXT4_DX_ENTRY       *l;
+  EXT4_DX_ENTRY       *r;
+  EXT4_DX_ENTRY       *m;
+
+  CountLimit    = (EXT4_DX_COUNTLIMIT *)(Frame->Block + CountOffset);
+  ExpectedLimit = (Partition->BlockSize - CountOffset) / sizeof (EXT4_DX_ENTRY);
+
+  if (EXT4_HAS_METADATA_CSUM (Partition)) {
+    // The tail takes up the space of a whole entry
+    ExpectedLimit--;
+  }
+
+  if ((CountLimit->limit != ExpectedLimit) || (CountLimit->count == 0) ||
+      (CountLimit->count > CountLimit->limit))
+  {
+    DEBUG ((
+      DEBUG_ERROR,
+      "[ext4] Bad htree node (count %u, limit %u, expected limit %u)\n",
+      CountLimit->count,
+      CountLimit->limit,
+      ExpectedLimit
+      ));
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  if (!Ext4CheckDxChecksum (Directory, Frame->Block, CountOffset, CountLimit)) {
+    DEBUG ((DEBUG_ERROR, "[ext4] Bad htree node checksum\n"));
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Frame->Entries = (EXT4_DX_ENTRY *)CountLimit;
+  Frame->Count   = CountLimit->count;
+
+  // The first entry has no hash (it's where limit and count live) and covers everything
+  // below the second entry's hash. The rest of the entries are sorted, so binary search them.
+  l = Frame->Entries + 1;
+  r = Frame->Entries + Frame->Count - 1;
+
+  while (l <= r) {
+    m = l + (r - l) / 2;
+
+    if (m->hash > Hash) {
+      r = m - 1;
+    } else {
+      l = m + 1;
+    }
+  }
+
+  Frame->At = l - 1;
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Advances the hash tree traversal to the next leaf, if the name we're
+   looking for may be there too (because of hash collisions).
+
+   @param[in]      Partition    Pointer to the opened partition.
+   @param[in]      Directory    Pointer to the opened directory.
+   @param[in out]  Frames       Pointer to the traversal's frames.
+   @param[in]      Levels       Number of frames in use.
+   @param[in]      Hash         Hash of the name we're looking for.
+
+   @retval EFI_SUCCESS          The traversal was advanced to the next leaf.
+   @retval EFI_NOT_FOUND        There are no more leaves that may contain the name.
+   @retval !EFI_SUCCESS         An error occurred.
+**/
+STATIC
+EFI_STATUS
+Ext4HtreeNextLeaf (
+  IN     EXT4_PARTITION    *Partition,
+  IN     EXT4_FILE         *Directory,
+  IN OUT EXT4_HTREE_FRAME  *Frames,
+  IN     UINTN             Levels,
+  IN     UINT32            Hash
+  )
+{
+  UINTN       Level;
+  EFI_STATUS  Status;
+
+  // Find the deepest level that still has entries to the right of the current one
+  Level = Levels - 1;
+
+  while (++Frames[Level].At >= Frames[Level].Entries + Frames[Level].Count) {
+    if (Level == 0) {
+      return EFI_NOT_FOUND;
+    }
+
+    Level--;
+  }
+
+  // The low bit of the hash is set when the previous block's last hash continues
+  // into this block. If it isn't, the name can't be here.
+  if ((Frames[Level].At->hash & ~1U) != Hash) {
+    return EFI_NOT_FOUND;
+  }
+
+  // Go back down, following the leftmost entry of each node.
+  for (Level++; Level < Levels; Level++) {
+    Status = Ext4HtreeReadBlock (
+               Partition,
+               Directory,
+               Frames[Level - 1].At->block & EXT4_DX_BLOCK_MASK,
+               Frames[Level].Block
+               );
+
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Status = Ext4HtreeProbeNode (Partition, Directory, &Frames[Level], EXT4_DX_NODE_ENTRIES_OFFSET, 0);
+
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Frames[Level].At = Frames[Level].Entries;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Retrieves a directory entry using the directory's hash tree.
+
+   Note that the hash of a name is case-sensitive, so this will only find
+   entries whose names match exactly.
+
+   @param[in]      Directory   Pointer to the opened directory.
+   @param[in]      Name        Pointer to the UCS-2 formatted filename.
+   @param[in]      Partition   Pointer to the ext4 partition.
+   @param[out]     Result      Pointer to the destination directory entry.
+
+   @retval EFI_SUCCESS          The entry was found.
+   @retval EFI_UNSUPPORTED      The directory isn't hash tree indexed, or uses an
+                                unsupported hash.
+   @retval EFI_NOT_FOUND        The entry wasn't found.
+   @retval EFI_VOLUME_CORRUPTED The hash tree is corrupted.
+   @retval !EFI_SUCCESS         Another error occurred.
+**/
+EFI_STATUS
+Ext4HtreeRetrieveDirent (
+  IN EXT4_FILE        *Directory,
+  IN CONST CHAR16     *Name,
+  IN EXT4_PARTITION   *Partition,
+  OUT EXT4_DIR_ENTRY  *Result
+  )
+{
+  EFI_STATUS         Status;
+  CHAR8              *Utf8Name;
+  UINTN              NameLength;
+  CHAR8              *Buffer;
+  CHAR8              *Leaf;
+  EXT4_HTREE_FRAME   Frames[EXT4_HTREE_LEVEL];
+  EXT4_DIR_ENTRY     *DotDot;
+  EXT4_DX_ROOT_INFO  *RootInfo;
+  UINT8              HashVersion;
+  UINT32             Hash;
+  UINTN              Levels;
+  UINTN              MaxLevels;
+  UINTN              Level;
+
+  // Note: Hash indexed directories are flagged with EXT4_BTREE_FL (which Linux calls EXT4_INDEX_FL).
+  if (!EXT4_HAS_COMPAT (Partition, EXT4_FEATURE_COMPAT_DIR_INDEX) ||
+      ((Directory->Inode->i_flags & EXT4_BTREE_FL) == 0))
+  {
+    return EFI_UNSUPPORTED;
+  }
+
+  // "." and ".." live in the root block, which isn't a leaf.
+  if ((StrCmp (Name, L".") == 0) || (StrCmp (Name, L"..") == 0)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = UCS2StrToUTF8 ((CHAR16 *)Name, &Utf8Name);
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  NameLength = AsciiStrLen (Utf8Name);
+
+  if (NameLength > EXT4_NAME_MAX) {
+    FreePool (Utf8Name);
+    return EFI_NOT_FOUND;
+  }
+
+  Buffer = AllocatePool (Partition->BlockSize * (EXT4_HTREE_LEVEL + 1));
+
+  if (Buffer == NULL) {
+    FreePool (Utf8Name);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Level = 0; Level < ARRAY_SIZE (Frames); Level++) {
+    Frames[Level].Block = Buffer + Level * Partition->BlockSize;
+  }
+
+  Leaf = Buffer + ARRAY_SIZE (Frames) * Partition->BlockSize;
+
+  Status = Ext4HtreeReadBlock (Partition, Directory, 0, Frames[0].Block);
+
+  if (EFI_ERROR (Status)) {
+    goto Out;
+  }
+
+  DotDot   = (EXT4_DIR_ENTRY *)(Frames[0].Block + 12);
+  RootInfo = (EXT4_DX_ROOT_INFO *)(Frames[0].Block + EXT4_DX_ROOT_INFO_OFFSET);
+
+  MaxLevels = EXT4_HAS_INCOMPAT (Partition, EXT4_FEATURE_INCOMPAT_LARGEDIR) ?
+              EXT4_HTREE_LEVEL : EXT4_HTREE_LEVEL_COMPAT;
+
+  if ((DotDot->rec_len != Partition->BlockSize - 12) || (RootInfo->reserved_zero != 0) ||
+      (RootInfo->info_length != sizeof (EXT4_DX_ROOT_INFO)) ||
+      (RootInfo->indirect_levels >= MaxLevels))
+  {
+    DEBUG ((DEBUG_ERROR, "[ext4] Bad htree root for inode %u\n", Directory->InodeNum));
+    Status = EFI_VOLUME_CORRUPTED;
+    goto Out;
+  }
+
+  HashVersion = RootInfo->hash_version;
+
+  if ((HashVersion <= EXT4_HTREE_TEA) &&
+      ((Partition->SuperBlock.s_flags & EXT4_FLAGS_UNSIGNED_HASH) != 0))
+  {
+    HashVersion += EXT4_HTREE_LEGACY_UNSIGNED;
+  }
+
+  Status = Ext4HtreeHash (Partition, Utf8Name, NameLength, HashVersion, &Hash);
+
+  if (EFI_ERROR (Status)) {
+    goto Out;
+  }
+
+  Levels = RootInfo->indirect_levels + 1;
+
+  // Walk down the tree, from the root to the last level of dx nodes.
+  for (Level = 0; Level < Levels; Level++) {
+    if (Level != 0) {
+      Status = Ext4HtreeReadBlock (
+                 Partition,
+                 Directory,
+                 Frames[Level - 1].At->block & EXT4_DX_BLOCK_MASK,
+                 Frames[Level].Block
+                 );
+
+      if (EFI_ERROR (Status)) {
+        goto Out;
+      }
+    }
+
+    Status = Ext4HtreeProbeNode (
+               Partition,
+               Directory,
+               &Frames[Level],
+               Level == 0 ? EXT4_DX_ROOT_INFO_OFFSET + RootInfo->info_length : EXT4_DX_NODE_ENTRIES_OFFSET,
+               Hash
+               );
+
+    if (EFI_ERROR (Status)) {
+      goto Out;
+    }
+  }
+
+  // Search the leaf (and any leaves that continue its hash range).
+  while (TRUE) {
+    Status = Ext4HtreeReadBlock (
+               Partition,
+               Directory,
+               Frames[Levels - 1].At->block & EXT4_DX_BLOCK_MASK,
+               Leaf
+               );
+
+    if (EFI_ERROR (Status)) {
+      goto Out;
+    }
+
+    Status = Ext4SearchDirBlock (Partition, Leaf, Name, Result);
+
+    if (Status != EFI_NOT_FOUND) {
+      goto Out;
+    }
+
+    Status = Ext4HtreeNextLeaf (Partition, Directory, Frames, Levels, Hash);
+
+    if (EFI_ERROR (Status)) {
+      goto Out;
+    }
+  }
+
+Out:
+  FreePool (Buffer);
+  FreePool (Utf8Name);
+  return Status;
+}
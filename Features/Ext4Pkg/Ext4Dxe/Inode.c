@@ -69,67 +69,210 @@ Ext4CalculateInodeChecksum (
   return Crc;
 }
 
+// Number of disk reads Ext4Read keeps in flight (with DISK_IO2) while it looks up the next run of blocks.
+#define EXT4_READ_MAX_IN_FLIGHT  2
+
+//
+// An asynchronous disk read, issued using the DISK_IO2 protocol.
+//
+typedef struct {
+  EFI_DISK_IO2_TOKEN    Token;
+  BOOLEAN               InFlight;
+} EXT4_READ_REQUEST;
+
 /**
-   Reads from an EXT4 inode.
+   Checks if Ext4Read may issue asynchronous reads.
+
+   We poll for the completion of asynchronous reads, so we need the disk stack's
+   completion callbacks to be able to run while we do that.
+
+   @param[in]      Partition     Pointer to the opened EXT4 partition.
+
+   @return TRUE if asynchronous reads can be used, else FALSE.
+**/
+STATIC
+BOOLEAN
+Ext4CanReadAsync (
+  IN CONST EXT4_PARTITION  *Partition
+  )
+{
+  EFI_TPL  OldTpl;
+
+  if (EXT4_DISK_IO2 (Partition) == NULL) {
+    return FALSE;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  gBS->RestoreTPL (OldTpl);
+
+  return OldTpl == TPL_APPLICATION;
+}
+
+/**
+   Waits for an asynchronous read to complete.
+
+   @param[in out]  Request       Pointer to the request.
+
+   @return Status of the read.
+**/
+STATIC
+EFI_STATUS
+Ext4WaitForRead (
+  IN OUT EXT4_READ_REQUEST  *Request
+  )
+{
+  if (!Request->InFlight) {
+    return EFI_SUCCESS;
+  }
+
+  while (gBS->CheckEvent (Request->Token.Event) == EFI_NOT_READY) {
+    CpuPause ();
+  }
+
+  Request->InFlight = FALSE;
+
+  if (EFI_ERROR (Request->Token.TransactionStatus)) {
+    DEBUG ((DEBUG_ERROR, "[ext4] Asynchronous read failed with %r\n", Request->Token.TransactionStatus));
+  }
+
+  return Request->Token.TransactionStatus;
+}
+
+/**
+   Starts an asynchronous read from the partition's disk, using the DISK_IO2 protocol.
+   If the request slot is still in use, waits for its previous read first.
+   The read is done synchronously if we fail to set it up.
+
+   @param[in]      Partition     Pointer to the opened EXT4 partition.
+   @param[in out]  Request       Pointer to the request slot.
+   @param[out]     Buffer        Pointer to a destination buffer.
+   @param[in]      Length        Length of the destination buffer.
+   @param[in]      Offset        Offset, in bytes, of the location to read.
+
+   @return Status of the submission (or of the read, if done synchronously).
+**/
+STATIC
+EFI_STATUS
+Ext4SubmitRead (
+  IN     EXT4_PARTITION     *Partition,
+  IN OUT EXT4_READ_REQUEST  *Request,
+  OUT    VOID               *Buffer,
+  IN     UINTN              Length,
+  IN     UINT64             Offset
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = Ext4WaitForRead (Request);
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Request->Token.Event == NULL) {
+    Status = gBS->CreateEvent (0, TPL_CALLBACK, NULL, NULL, &Request->Token.Event);
+
+    if (EFI_ERROR (Status)) {
+      Request->Token.Event = NULL;
+      return Ext4ReadDiskIo (Partition, Buffer, Length, Offset);
+    }
+  }
+
+  Status = EXT4_DISK_IO2 (Partition)->ReadDiskEx (
+                                        EXT4_DISK_IO2 (Partition),
+                                        EXT4_MEDIA_ID (Partition),
+                                        Offset,
+                                        &Request->Token,
+                                        Length,
+                                        Buffer
+                                        );
+
+  if (!EFI_ERROR (Status)) {
+    Request->InFlight = TRUE;
+
+    Partition->NumberAsyncDiskReads++;
+    Partition->BytesRead += Length;
+  }
+
+  return Status;
+}
+
+/**
+   Returns the physical block an extent starts at.
+
+   @param[in]      Extent        Pointer to the extent.
+
+   @return The extent's first physical block.
+**/
+STATIC
+EXT4_BLOCK_NR
+Ext4ExtentPhysicalStart (
+  IN CONST EXT4_EXTENT  *Extent
+  )
+{
+  return LShiftU64 (Extent->ee_start_hi, 32) | Extent->ee_start_lo;
+}
+
+/**
+   Reads data from an EXT4 inode, bypassing the read-ahead window.
+
+   Holes are zeroed a whole hole at a time, physically contiguous extents
+   are coalesced into a single disk read and, if the partition supports DISK_IO2,
+   disk reads are done asynchronously while we look up the next run of blocks.
+
    @param[in]      Partition     Pointer to the opened EXT4 partition.
    @param[in]      File          Pointer to the opened file.
    @param[out]     Buffer        Pointer to the buffer.
    @param[in]      Offset        Offset of the read.
-   @param[in out]  Length        Pointer to the length of the buffer, in bytes.
-                                 After a successful read, it's updated to the number of read bytes.
+   @param[in]      Length        Length of the read. Must be inside the file.
 
    @return Status of the read operation.
 **/
+STATIC
 EFI_STATUS
-Ext4Read (
+Ext4ReadUncached (
   IN     EXT4_PARTITION  *Partition,
   IN     EXT4_FILE       *File,
   OUT    VOID            *Buffer,
   IN     UINT64          Offset,
-  IN OUT UINTN           *Length
+  IN     UINTN           Length
   )
 {
-  EXT4_INODE   *Inode;
-  UINT64       InodeSize;
-  UINT64       CurrentSeek;
-  UINTN        RemainingRead;
-  UINTN        BeenRead;
-  UINTN        WasRead;
-  EXT4_EXTENT  Extent;
-  UINT32       BlockOff;
-  EFI_STATUS   Status;
-  BOOLEAN      HasBackingExtent;
-  UINT32       HoleOff;
-  UINT64       HoleLen;
-  UINT64       ExtentStartBytes;
-  UINT64       ExtentLengthBytes;
-  UINT64       ExtentLogicalBytes;
-
-  // Our extent offset is the difference between CurrentSeek and ExtentLogicalBytes
-  UINT64  ExtentOffset;
-  UINTN   ExtentMayRead;
-
-  Inode         = File->Inode;
-  InodeSize     = EXT4_INODE_SIZE (Inode);
-  CurrentSeek   = Offset;
-  RemainingRead = *Length;
-  BeenRead      = 0;
-
-  DEBUG ((DEBUG_FS, "[ext4] Ext4Read(%s, Offset %lu, Length %lu)\n", File->Dentry->Name, Offset, *Length));
+  UINT64             CurrentSeek;
+  UINTN              RemainingRead;
+  UINTN              WasRead;
+  EXT4_EXTENT        Extent;
+  EXT4_EXTENT        NextExtent;
+  UINT32             BlockOff;
+  EFI_STATUS         Status;
+  EFI_STATUS         ReqStatus;
+  BOOLEAN            HasBackingExtent;
+  BOOLEAN            CanReadAsync;
+  UINT64             HoleLen;
+  UINT64             ExtentStartBytes;
+  UINT64             ExtentLogicalBytes;
+  UINT64             RunBytes;
+  UINT64             DiskOffset;
+  EXT4_BLOCK_NR      RunNextPhysical;
+  UINT32             RunNextLogical;
+  EXT4_READ_REQUEST  Requests[EXT4_READ_MAX_IN_FLIGHT];
+  UINTN              NextRequest;
+  UINTN              Index;
 
-  if (Offset > InodeSize) {
-    return EFI_DEVICE_ERROR;
-  }
+  CurrentSeek   = Offset;
+  RemainingRead = Length;
+  Status        = EFI_SUCCESS;
+  NextRequest   = 0;
+  CanReadAsync  = !Ext4FileIsDir (File) && Ext4CanReadAsync (Partition);
 
-  if (RemainingRead > InodeSize - Offset) {
-    RemainingRead = (UINTN)(InodeSize - Offset);
-  }
+  ZeroMem (Requests, sizeof (Requests));
 
   while (RemainingRead != 0) {
     WasRead = 0;
 
     // The algorithm here is to get the extent corresponding to the current block
-    // and then read as much as we can from the current extent.
+    // and then read as much as we can from the current extent (and from the ones
+    // that follow it on disk).
 
     Status = Ext4GetExtent (
                Partition,
@@ -139,60 +282,242 @@ Ext4Read (
                );
 
     if ((Status != EFI_SUCCESS) && (Status != EFI_NO_MAPPING)) {
-      return Status;
+      goto Out;
     }
 
     HasBackingExtent = Status != EFI_NO_MAPPING;
+    Status           = EFI_SUCCESS;
 
-    if (!HasBackingExtent || EXT4_EXTENT_IS_UNINITIALIZED (&Extent)) {
-      HoleOff = BlockOff;
-
-      if (!HasBackingExtent) {
-        HoleLen = Partition->BlockSize - HoleOff;
-      } else {
-        // Uninitialized extents behave exactly the same as file holes, except they have
-        // blocks already allocated to them.
-        HoleLen = MultU64x32 (Ext4GetExtentLength (&Extent), Partition->BlockSize) - HoleOff;
-      }
-
+    if (!HasBackingExtent && (Extent.ee_len == 0)) {
+      // We don't know how long this hole is, so zero up to the end of the block
+      HoleLen = Partition->BlockSize - BlockOff;
+      WasRead = HoleLen > RemainingRead ? RemainingRead : (UINTN)HoleLen;
+      ZeroMem (Buffer, WasRead);
+    } else if (!HasBackingExtent || EXT4_EXTENT_IS_UNINITIALIZED (&Extent)) {
+      // Uninitialized extents behave exactly the same as file holes, except they have
+      // blocks already allocated to them.
+      HoleLen = EXT4_BLOCK_TO_BYTES (Partition, (UINT64)Extent.ee_block + Ext4GetExtentLength (&Extent)) - CurrentSeek;
       WasRead = HoleLen > RemainingRead ? RemainingRead : (UINTN)HoleLen;
-      // Potential improvement: In the future, we could get the file hole's total
-      // size and memset all that
       ZeroMem (Buffer, WasRead);
     } else {
-      ExtentStartBytes = MultU64x32 (
-                           LShiftU64 (Extent.ee_start_hi, 32) |
-                           Extent.ee_start_lo,
-                           Partition->BlockSize
-                           );
-      ExtentLengthBytes  = Extent.ee_len * Partition->BlockSize;
-      ExtentLogicalBytes = MultU64x32 ((UINT64)Extent.ee_block, Partition->BlockSize);
-      ExtentOffset       = CurrentSeek - ExtentLogicalBytes;
-      ExtentMayRead      = (UINTN)(ExtentLengthBytes - ExtentOffset);
-
-      WasRead = ExtentMayRead > RemainingRead ? RemainingRead : ExtentMayRead;
+      ExtentStartBytes   = EXT4_BLOCK_TO_BYTES (Partition, Ext4ExtentPhysicalStart (&Extent));
+      ExtentLogicalBytes = EXT4_BLOCK_TO_BYTES (Partition, (UINT64)Extent.ee_block);
+      RunBytes           = EXT4_BLOCK_TO_BYTES (Partition, (UINT64)Extent.ee_len) - (CurrentSeek - ExtentLogicalBytes);
+      RunNextLogical     = Extent.ee_block + Extent.ee_len;
+      RunNextPhysical    = Ext4ExtentPhysicalStart (&Extent) + Extent.ee_len;
+
+      // Coalesce the following extents into the same disk read, for as long as
+      // they're physically contiguous. Lookup errors are left for the next iteration to report.
+      while (RunBytes < RemainingRead) {
+        Status = Ext4GetExtent (Partition, File, RunNextLogical, &NextExtent);
+
+        if ((Status != EFI_SUCCESS) || EXT4_EXTENT_IS_UNINITIALIZED (&NextExtent) ||
+            (NextExtent.ee_block != RunNextLogical) || (Ext4ExtentPhysicalStart (&NextExtent) != RunNextPhysical))
+        {
+          break;
+        }
+
+        RunBytes        += EXT4_BLOCK_TO_BYTES (Partition, (UINT64)NextExtent.ee_len);
+        RunNextLogical  += NextExtent.ee_len;
+        RunNextPhysical += NextExtent.ee_len;
+      }
 
-      Status = Ext4ReadDiskIo (Partition, Buffer, WasRead, ExtentStartBytes + ExtentOffset);
+      Status     = EFI_SUCCESS;
+      WasRead    = RunBytes > RemainingRead ? RemainingRead : (UINTN)RunBytes;
+      DiskOffset = ExtentStartBytes + (CurrentSeek - ExtentLogicalBytes);
+
+      if (Ext4FileIsDir (File)) {
+        // Directory blocks are metadata, and get looked up over and over again, so cache them.
+        Status = Ext4ReadDiskIoCached (Partition, Buffer, WasRead, DiskOffset);
+      } else if (CanReadAsync && (WasRead < RemainingRead)) {
+        // There's more to do after this run, so let the disk work on it while we do.
+        Status      = Ext4SubmitRead (Partition, &Requests[NextRequest], Buffer, WasRead, DiskOffset);
+        NextRequest = (NextRequest + 1) % EXT4_READ_MAX_IN_FLIGHT;
+      } else {
+        Status = Ext4ReadDiskIo (Partition, Buffer, WasRead, DiskOffset);
+      }
 
       if (EFI_ERROR (Status)) {
         DEBUG ((
           DEBUG_ERROR,
           "[ext4] Error %r reading [%lu, %lu]\n",
           Status,
-          ExtentStartBytes + ExtentOffset,
-          ExtentStartBytes + ExtentOffset + WasRead - 1
+          DiskOffset,
+          DiskOffset + WasRead - 1
           ));
-        return Status;
+        goto Out;
       }
     }
 
     RemainingRead -= WasRead;
     Buffer         = (VOID *)((CHAR8 *)Buffer + WasRead);
-    BeenRead      += WasRead;
     CurrentSeek   += WasRead;
   }
 
-  *Length = BeenRead;
+Out:
+  // The caller's buffer must not be touched after we return, so wait for every
+  // outstanding read, even if we already failed.
+  for (Index = 0; Index < EXT4_READ_MAX_IN_FLIGHT; Index++) {
+    ReqStatus = Ext4WaitForRead (&Requests[Index]);
+
+    if (!EFI_ERROR (Status)) {
+      Status = ReqStatus;
+    }
+
+    if (Requests[Index].Token.Event != NULL) {
+      gBS->CloseEvent (Requests[Index].Token.Event);
+    }
+  }
+
+  return Status;
+}
+
+/**
+   Reads from a file's sequential read-ahead window, refilling it if needed.
+
+   The window is only (re)filled when the file is being read sequentially,
+   so random accesses don't pay for data they won't use.
+
+   @param[in]      Partition     Pointer to the opened EXT4 partition.
+   @param[in]      File          Pointer to the opened file.
+   @param[out]     Buffer        Pointer to the buffer.
+   @param[in]      Offset        Offset of the read.
+   @param[in]      Length        Length of the read. Must be inside the file, and smaller
+                                 than PcdExt4ReadAheadSize.
+
+   @retval EFI_SUCCESS           The read was served from the window.
+   @retval EFI_NOT_FOUND         The read can't be served from the window.
+   @retval !EFI_SUCCESS          The window couldn't be filled.
+**/
+STATIC
+EFI_STATUS
+Ext4ReadFromWindow (
+  IN     EXT4_PARTITION  *Partition,
+  IN     EXT4_FILE       *File,
+  OUT    VOID            *Buffer,
+  IN     UINT64          Offset,
+  IN     UINTN           Length
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      WindowEnd;
+  UINT64      InodeSize;
+  UINTN       Head;
+  UINTN       WindowLength;
+
+  Head      = 0;
+  WindowEnd = File->ReadAheadOffset + File->ReadAheadLength;
+
+  if ((File->ReadAheadLength != 0) && (Offset >= File->ReadAheadOffset) && (Offset < WindowEnd)) {
+    // Copy whatever we already have
+    Head = (UINTN)(WindowEnd - Offset);
+    Head = Head > Length ? Length : Head;
+
+    CopyMem (Buffer, File->ReadAheadBuffer + (Offset - File->ReadAheadOffset), Head);
+
+    if (Head == Length) {
+      return EFI_SUCCESS;
+    }
+
+    Buffer  = (CHAR8 *)Buffer + Head;
+    Offset += Head;
+    Length -= Head;
+  } else if (Offset != File->NextReadOffset) {
+    return EFI_NOT_FOUND;
+  }
+
+  if (File->ReadAheadBuffer == NULL) {
+    File->ReadAheadBuffer = AllocatePool (FixedPcdGet32 (PcdExt4ReadAheadSize));
+
+    if (File->ReadAheadBuffer == NULL) {
+      // Head is always 0 here, as there's no window yet.
+      return EFI_NOT_FOUND;
+    }
+  }
+
+  InodeSize    = EXT4_INODE_SIZE (File->Inode);
+  WindowLength = FixedPcdGet32 (PcdExt4ReadAheadSize);
+
+  if (WindowLength > InodeSize - Offset) {
+    WindowLength = (UINTN)(InodeSize - Offset);
+  }
+
+  Status = Ext4ReadUncached (Partition, File, File->ReadAheadBuffer, Offset, WindowLength);
+
+  if (EFI_ERROR (Status)) {
+    File->ReadAheadLength = 0;
+    return Status;
+  }
+
+  File->ReadAheadOffset = Offset;
+  File->ReadAheadLength = WindowLength;
+
+  CopyMem (Buffer, File->ReadAheadBuffer, Length);
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Reads from an EXT4 inode.
+   @param[in]      Partition     Pointer to the opened EXT4 partition.
+   @param[in]      File          Pointer to the opened file.
+   @param[out]     Buffer        Pointer to the buffer.
+   @param[in]      Offset        Offset of the read.
+   @param[in out]  Length        Pointer to the length of the buffer, in bytes.
+                                 After a successful read, it's updated to the number of read bytes.
+
+   @return Status of the read operation.
+**/
+EFI_STATUS
+Ext4Read (
+  IN     EXT4_PARTITION  *Partition,
+  IN     EXT4_FILE       *File,
+  OUT    VOID            *Buffer,
+  IN     UINT64          Offset,
+  IN OUT UINTN           *Length
+  )
+{
+  UINT64      InodeSize;
+  UINTN       RemainingRead;
+  EFI_STATUS  Status;
+
+  InodeSize     = EXT4_INODE_SIZE (File->Inode);
+  RemainingRead = *Length;
+
+  DEBUG ((DEBUG_FS, "[ext4] Ext4Read(%s, Offset %lu, Length %lu)\n", File->Dentry->Name, Offset, *Length));
+
+  if (Offset > InodeSize) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  if (RemainingRead > InodeSize - Offset) {
+    RemainingRead = (UINTN)(InodeSize - Offset);
+  }
+
+  if (RemainingRead == 0) {
+    *Length = 0;
+    return EFI_SUCCESS;
+  }
+
+  Status = EFI_NOT_FOUND;
+
+  // Small reads of regular files go through the read-ahead window, larger ones
+  // are already big enough to be efficient on their own.
+  // Directories don't need it, as their blocks are in the block cache.
+  if ((RemainingRead < FixedPcdGet32 (PcdExt4ReadAheadSize)) && !Ext4FileIsDir (File)) {
+    Status = Ext4ReadFromWindow (Partition, File, Buffer, Offset, RemainingRead);
+  }
+
+  if (Status == EFI_NOT_FOUND) {
+    Status = Ext4ReadUncached (Partition, File, Buffer, Offset, RemainingRead);
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  File->NextReadOffset = Offset + RemainingRead;
+  *Length              = RemainingRead;
 
   return EFI_SUCCESS;
 }
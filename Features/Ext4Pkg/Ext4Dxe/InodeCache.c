@@ -0,0 +1,417 @@
+/** @file
+  Inode cache
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "Ext4Dxe.h"
+
+//
+// A single cached (and already verified) inode. The on-disk inode (Partition->InodeSize bytes)
+// immediately follows the structure, in the same pool allocation.
+//
+typedef struct {
+  EXT4_INO_NR                 InodeNum;
+  LIST_ENTRY                  LruNode;
+  ORDERED_COLLECTION_ENTRY    *MapEntry;
+} EXT4_INODE_CACHE_ENTRY;
+
+#define EXT4_INODE_CACHE_ENTRY_FROM_LRU_NODE(Node)                             \
+  BASE_CR(Node, EXT4_INODE_CACHE_ENTRY, LruNode)
+
+#define EXT4_INODE_CACHE_ENTRY_DATA(Entry)  ((EXT4_INODE *)((Entry) + 1))
+
+/**
+  Compare two EXT4_INODE_CACHE_ENTRY structs.
+  Used in the inode cache's ORDERED_COLLECTION.
+
+  @param[in] UserStruct1  Pointer to the first user structure.
+
+  @param[in] UserStruct2  Pointer to the second user structure.
+
+  @retval <0  If UserStruct1 compares less than UserStruct2.
+
+  @retval  0  If UserStruct1 compares equal to UserStruct2.
+
+  @retval >0  If UserStruct1 compares greater than UserStruct2.
+**/
+STATIC
+INTN
+EFIAPI
+Ext4InodeCacheStructCompare (
+  IN CONST VOID  *UserStruct1,
+  IN CONST VOID  *UserStruct2
+  )
+{
+  CONST EXT4_INODE_CACHE_ENTRY  *Entry1;
+  CONST EXT4_INODE_CACHE_ENTRY  *Entry2;
+
+  Entry1 = UserStruct1;
+  Entry2 = UserStruct2;
+
+  return Entry1->InodeNum < Entry2->InodeNum ? -1 :
+         Entry1->InodeNum > Entry2->InodeNum ? 1 : 0;
+}
+
+/**
+  Compare a standalone key against a EXT4_INODE_CACHE_ENTRY containing an embedded key.
+  Used in the inode cache's ORDERED_COLLECTION.
+
+  @param[in] StandaloneKey  Pointer to the bare key (an EXT4_INO_NR).
+
+  @param[in] UserStruct     Pointer to the user structure with the embedded
+                            key.
+
+  @retval <0  If StandaloneKey compares less than UserStruct's key.
+
+  @retval  0  If StandaloneKey compares equal to UserStruct's key.
+
+  @retval >0  If StandaloneKey compares greater than UserStruct's key.
+**/
+STATIC
+INTN
+EFIAPI
+Ext4InodeCacheKeyCompare (
+  IN CONST VOID  *StandaloneKey,
+  IN CONST VOID  *UserStruct
+  )
+{
+  CONST EXT4_INODE_CACHE_ENTRY  *Entry;
+  EXT4_INO_NR                   InodeNum;
+
+  Entry    = UserStruct;
+  InodeNum = *(CONST EXT4_INO_NR *)StandaloneKey;
+
+  return InodeNum < Entry->InodeNum ? -1 :
+         InodeNum > Entry->InodeNum ? 1 : 0;
+}
+
+/**
+   Initialises the partition's (empty) inode cache.
+   The size of the cache is taken from PcdExt4InodeCacheSize; a size of 0 disables it.
+
+   @param[in out]  Partition   Pointer to the opened partition. Partition->InodeSize
+                               must already be valid.
+
+   @retval EFI_SUCCESS          The cache was initialised.
+   @retval EFI_OUT_OF_RESOURCES Not enough memory to set up the cache.
+**/
+EFI_STATUS
+Ext4InitInodeCache (
+  IN OUT EXT4_PARTITION  *Partition
+  )
+{
+  EXT4_INODE_CACHE  *Cache;
+
+  Cache = &Partition->InodeCache;
+
+  InitializeListHead (&Cache->LruList);
+  Cache->NumberEntries = 0;
+  Cache->MaxEntries    = FixedPcdGet32 (PcdExt4InodeCacheSize);
+  Cache->Hits          = 0;
+  Cache->Misses        = 0;
+  Cache->Map           = NULL;
+
+  if (Cache->MaxEntries == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Cache->Map = OrderedCollectionInit (Ext4InodeCacheStructCompare, Ext4InodeCacheKeyCompare);
+
+  if (Cache->Map == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Frees the partition's inode cache, dropping every cached inode.
+
+   @param[in out]  Partition   Pointer to the opened partition.
+**/
+VOID
+Ext4FreeInodeCache (
+  IN OUT EXT4_PARTITION  *Partition
+  )
+{
+  EXT4_INODE_CACHE        *Cache;
+  EXT4_INODE_CACHE_ENTRY  *Entry;
+  LIST_ENTRY              *Node;
+  LIST_ENTRY              *NextNode;
+
+  Cache = &Partition->InodeCache;
+
+  if (Cache->Map == NULL) {
+    return;
+  }
+
+  DEBUG ((
+    DEBUG_FS,
+    "[ext4] Inode cache: %lu hits, %lu misses (%u/%u inodes in use)\n",
+    Cache->Hits,
+    Cache->Misses,
+    Cache->NumberEntries,
+    Cache->MaxEntries
+    ));
+
+  BASE_LIST_FOR_EACH_SAFE (Node, NextNode, &Cache->LruList) {
+    Entry = EXT4_INODE_CACHE_ENTRY_FROM_LRU_NODE (Node);
+
+    RemoveEntryList (&Entry->LruNode);
+    OrderedCollectionDelete (Cache->Map, Entry->MapEntry, NULL);
+    FreePool (Entry);
+  }
+
+  ASSERT (OrderedCollectionIsEmpty (Cache->Map));
+
+  OrderedCollectionUninit (Cache->Map);
+  Cache->Map           = NULL;
+  Cache->NumberEntries = 0;
+}
+
+/**
+   Looks up an inode in the inode cache.
+
+   @param[in]      Partition     Pointer to the opened partition.
+   @param[in]      InodeNum      Inode number.
+
+   @return Pointer to the cached inode, or NULL if it isn't cached.
+           The inode is only valid until the next inode cache call.
+**/
+STATIC
+CONST EXT4_INODE *
+Ext4LookupInodeCache (
+  IN EXT4_PARTITION  *Partition,
+  IN EXT4_INO_NR     InodeNum
+  )
+{
+  EXT4_INODE_CACHE          *Cache;
+  EXT4_INODE_CACHE_ENTRY    *Entry;
+  ORDERED_COLLECTION_ENTRY  *MapEntry;
+
+  Cache    = &Partition->InodeCache;
+  MapEntry = OrderedCollectionFind (Cache->Map, &InodeNum);
+
+  if (MapEntry == NULL) {
+    return NULL;
+  }
+
+  Entry = OrderedCollectionUserStruct (MapEntry);
+
+  // Move the inode to the head of the LRU list, as it's now the most recently used one
+  RemoveEntryList (&Entry->LruNode);
+  InsertHeadList (&Cache->LruList, &Entry->LruNode);
+
+  return EXT4_INODE_CACHE_ENTRY_DATA (Entry);
+}
+
+/**
+   Adds a verified inode to the inode cache, evicting the least recently used inode if the cache is full.
+   Failing to cache an inode isn't an error, so this doesn't return anything.
+
+   @param[in]      Partition     Pointer to the opened partition.
+   @param[in]      InodeNum      Inode number.
+   @param[in]      Inode         Pointer to the on-disk inode (Partition->InodeSize bytes).
+**/
+STATIC
+VOID
+Ext4InsertInodeCache (
+  IN EXT4_PARTITION    *Partition,
+  IN EXT4_INO_NR       InodeNum,
+  IN CONST EXT4_INODE  *Inode
+  )
+{
+  EXT4_INODE_CACHE        *Cache;
+  EXT4_INODE_CACHE_ENTRY  *Entry;
+  EFI_STATUS              Status;
+
+  Cache = &Partition->InodeCache;
+
+  if (Cache->NumberEntries < Cache->MaxEntries) {
+    Entry = AllocatePool (sizeof (EXT4_INODE_CACHE_ENTRY) + Partition->InodeSize);
+
+    if (Entry == NULL) {
+      return;
+    }
+  } else {
+    // The cache is full, recycle the least recently used inode (the tail of the list)
+    ASSERT (!IsListEmpty (&Cache->LruList));
+    Entry = EXT4_INODE_CACHE_ENTRY_FROM_LRU_NODE (GetPreviousNode (&Cache->LruList, &Cache->LruList));
+
+    RemoveEntryList (&Entry->LruNode);
+    OrderedCollectionDelete (Cache->Map, Entry->MapEntry, NULL);
+    Cache->NumberEntries--;
+  }
+
+  Entry->InodeNum = InodeNum;
+  CopyMem (EXT4_INODE_CACHE_ENTRY_DATA (Entry), Inode, Partition->InodeSize);
+
+  Status = OrderedCollectionInsert (Cache->Map, &Entry->MapEntry, Entry);
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Entry);
+    return;
+  }
+
+  InsertHeadList (&Cache->LruList, &Entry->LruNode);
+  Cache->NumberEntries++;
+}
+
+/**
+   Reads the whole inode table block that holds an inode, and adds every inode in it that's
+   in use and has a valid checksum to the inode cache.
+
+   @param[in]      Partition        Pointer to the opened partition.
+   @param[in]      BlockGroupNumber Block group of the inode.
+   @param[in]      InodeTableStart  First block of the block group's inode table.
+   @param[in]      InodeOffset      Index of the inode in the block group.
+
+   @return Result of the operation.
+**/
+STATIC
+EFI_STATUS
+Ext4CacheInodeTableBlock (
+  IN EXT4_PARTITION  *Partition,
+  IN UINT32          BlockGroupNumber,
+  IN EXT4_BLOCK_NR   InodeTableStart,
+  IN UINT64          InodeOffset
+  )
+{
+  UINT32       InodesPerBlock;
+  UINT64       FirstOffset;
+  UINT32       Index;
+  UINT8        *Buffer;
+  EXT4_INODE   *Inode;
+  EXT4_INO_NR  InodeNum;
+  EFI_STATUS   Status;
+
+  InodesPerBlock = Partition->BlockSize / Partition->InodeSize;
+
+  if (InodesPerBlock == 0) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  FirstOffset    = InodeOffset - ModU64x32 (InodeOffset, InodesPerBlock);
+
+  Buffer = AllocatePool (Partition->BlockSize);
+
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  // Inodes are checked in a zeroed buffer of at least sizeof (EXT4_INODE) bytes, like the ones
+  // Ext4ReadInode returns, so that fields past InodeSize don't pick up the next inode.
+  Inode = Ext4AllocateInode (Partition);
+
+  if (Inode == NULL) {
+    FreePool (Buffer);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = Ext4ReadBlocksCached (
+             Partition,
+             Buffer,
+             1,
+             InodeTableStart + DivU64x32 (InodeOffset, InodesPerBlock)
+             );
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Inode);
+    FreePool (Buffer);
+    return Status;
+  }
+
+  for (Index = 0; Index < InodesPerBlock; Index++) {
+    if (FirstOffset + Index >= Partition->SuperBlock.s_inodes_per_group) {
+      break;
+    }
+
+    InodeNum = MultU64x32 (BlockGroupNumber, Partition->SuperBlock.s_inodes_per_group) + FirstOffset + Index + 1;
+
+    if (!EXT4_IS_VALID_INODE_NR (Partition, InodeNum)) {
+      break;
+    }
+
+    CopyMem (Inode, Buffer + Index * Partition->InodeSize, Partition->InodeSize);
+
+    // Skip unused inodes, they would just take space in the cache.
+    if (Inode->i_links == 0) {
+      continue;
+    }
+
+    if (OrderedCollectionFind (Partition->InodeCache.Map, &InodeNum) != NULL) {
+      continue;
+    }
+
+    if (!Ext4CheckInodeChecksum (Partition, Inode, InodeNum)) {
+      // Ext4ReadInode will complain about this when (if) the inode is actually read.
+      continue;
+    }
+
+    Ext4InsertInodeCache (Partition, InodeNum, Inode);
+  }
+
+  FreePool (Inode);
+  FreePool (Buffer);
+  return EFI_SUCCESS;
+}
+
+/**
+   Reads an inode through the inode cache. On a miss, the whole inode table block that
+   holds the inode is read and its inodes cached, so looking up the next inodes in the
+   block (as listing a directory usually does) doesn't need any more I/O.
+
+   @param[in]      Partition        Pointer to the opened partition.
+   @param[in]      InodeNum         Inode number.
+   @param[in]      BlockGroupNumber Block group of the inode.
+   @param[in]      InodeTableStart  First block of the block group's inode table.
+   @param[in]      InodeOffset      Index of the inode in the block group.
+   @param[out]     Inode            Pointer to the inode, as allocated by Ext4AllocateInode.
+
+   @retval EFI_SUCCESS        The inode was found in the cache (and is already verified).
+   @retval EFI_NOT_FOUND      The inode could not be cached. The caller needs to read it by itself.
+**/
+EFI_STATUS
+Ext4ReadInodeCached (
+  IN  EXT4_PARTITION  *Partition,
+  IN  EXT4_INO_NR     InodeNum,
+  IN  UINT32          BlockGroupNumber,
+  IN  EXT4_BLOCK_NR   InodeTableStart,
+  IN  UINT64          InodeOffset,
+  OUT EXT4_INODE      *Inode
+  )
+{
+  EXT4_INODE_CACHE  *Cache;
+  CONST EXT4_INODE  *CachedInode;
+  EFI_STATUS        Status;
+
+  Cache = &Partition->InodeCache;
+
+  if (Cache->Map == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  CachedInode = Ext4LookupInodeCache (Partition, InodeNum);
+
+  if (CachedInode != NULL) {
+    Cache->Hits++;
+  } else {
+    Cache->Misses++;
+
+    Status = Ext4CacheInodeTableBlock (Partition, BlockGroupNumber, InodeTableStart, InodeOffset);
+
+    if (EFI_ERROR (Status)) {
+      return EFI_NOT_FOUND;
+    }
+
+    CachedInode = Ext4LookupInodeCache (Partition, InodeNum);
+
+    if (CachedInode == NULL) {
+      return EFI_NOT_FOUND;
+    }
+  }
+
+  CopyMem (Inode, CachedInode, Partition->InodeSize);
+  return EFI_SUCCESS;
+}
@@ -113,18 +113,32 @@ Ext4UnmountAndFreePartition (
   Partition->Unmounting = TRUE;
   Ext4CloseInternal (Partition->Root);
 
+  DEBUG ((
+    DEBUG_FS,
+    "[ext4] Disk I/O: %lu reads, %lu async reads, %lu bytes read\n",
+    Partition->NumberDiskReads,
+    Partition->NumberAsyncDiskReads,
+    Partition->BytesRead
+    ));
+
   BASE_LIST_FOR_EACH_SAFE (Entry, NextEntry, &Partition->OpenFiles) {
     File = EXT4_FILE_FROM_OPEN_FILES_NODE (Entry);
 
     Ext4CloseInternal (File);
   }
 
+  // Cached dentries keep each other alive, so drop the name caches before the last reference.
+  Ext4FlushDentryCache (Partition->RootDentry);
+
   DeletedRootDentry = Ext4UnrefDentry (Partition->RootDentry);
 
   if (!DeletedRootDentry) {
     DEBUG ((DEBUG_ERROR, "[ext4] Failed to delete root dentry - resource leak present.\n"));
   }
 
+  Ext4FreeInodeCache (Partition);
+  Ext4FreeBlockCache (Partition);
+
   FreePool (Partition->BlockGroups);
   FreePool (Partition);
 
@@ -21,7 +21,7 @@ STATIC CONST UINT32  gSupportedIncompatFeat =
   EXT4_FEATURE_INCOMPAT_MMP | EXT4_FEATURE_INCOMPAT_RECOVER | EXT4_FEATURE_INCOMPAT_CSUM_SEED;
 
 // Future features that may be nice additions in the future:
-// 1) Btree support: Required for write support and would speed up lookups in large directories.
+// 1) Btree support: Required for write support. Lookups already use it (see Htree.c).
 // 2) meta_bg: Required to mount meta_bg-enabled partitions.
 
 // Note: We ignore MMP because it's impossible that it's mapped elsewhere,
@@ -255,6 +255,13 @@ Ext4OpenSuperblock (
 
   Partition->BlockSize = (UINT32)LShiftU64 (1024, Sb->s_log_block_size);
 
+  // Inodes can't straddle blocks; the inode table code relies on at least one fitting
+  // in a block.
+  if (Partition->InodeSize > Partition->BlockSize) {
+    DEBUG ((DEBUG_ERROR, "[ext4] Inode size %u is larger than the block size\n", Partition->InodeSize));
+    return EFI_VOLUME_CORRUPTED;
+  }
+
   // The size of a block group can also be calculated as 8 * Partition->BlockSize
   if (Sb->s_blocks_per_group != 8 * Partition->BlockSize) {
     return EFI_UNSUPPORTED;
@@ -312,10 +319,27 @@ Ext4OpenSuperblock (
     }
   }
 
+  Status = Ext4InitBlockCache (Partition);
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Partition->BlockGroups);
+    return Status;
+  }
+
+  Status = Ext4InitInodeCache (Partition);
+
+  if (EFI_ERROR (Status)) {
+    Ext4FreeBlockCache (Partition);
+    FreePool (Partition->BlockGroups);
+    return Status;
+  }
+
   // RootDentry will serve as the basis of our directory entry tree.
   Partition->RootDentry = Ext4CreateDentry (L"\\", NULL);
 
   if (Partition->RootDentry == NULL) {
+    Ext4FreeInodeCache (Partition);
+    Ext4FreeBlockCache (Partition);
     FreePool (Partition->BlockGroups);
     return EFI_OUT_OF_RESOURCES;
   }
@@ -325,6 +349,8 @@ Ext4OpenSuperblock (
 
   if (EFI_ERROR (Status)) {
     Ext4UnrefDentry (Partition->RootDentry);
+    Ext4FreeInodeCache (Partition);
+    Ext4FreeBlockCache (Partition);
     FreePool (Partition->BlockGroups);
   }
 
@@ -355,7 +381,7 @@ Ext4CalculateChecksum (
   switch (Partition->SuperBlock.s_checksum_type) {
     case EXT4_CHECKSUM_CRC32C:
       // For some reason, EXT4 really likes non-inverted CRC32C checksums, so we stick to that here.
-      return ~CalculateCrc32c(Buffer, Length, ~InitialValue);
+      return Ext4CalculateCrc32c (Buffer, Length, InitialValue);
     default:
       ASSERT (FALSE);
       return 0;
@@ -0,0 +1,266 @@
+/** @file
+  Host-based benchmark for Ext4Dxe's CRC32C backends.
+
+  Times BaseLib's table-driven CalculateCrc32c and the CRC32C instructions
+  (Ext4Crc32cHw), if the host has them, over the per-inode checksum's call
+  pattern, and checks both produce the same checksums. Not part of the unit
+  tests (Crc32cUnitTest.c), since its results depend on the host.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <stdio.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../Ext4Dxe.h"
+#include "HostSupport.h"
+
+#define UNIT_TEST_APP_NAME     "Ext4Dxe CRC32C Benchmark"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+//
+// Inode size (mkfs.ext4's default) and number of inode checksums to time.
+//
+#define CRC32C_BENCH_INODE_SIZE  256
+#define CRC32C_BENCH_INODES      (1 << 20)
+
+typedef
+UINT32
+(EFIAPI *CRC32C_UPDATE)(
+  IN UINT32      Crc,
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  );
+
+/**
+   Updates a CRC32C with a buffer, using BaseLib's table-driven
+   implementation, with the same (non-inverted) convention as Ext4Crc32cHw.
+
+   @param[in]      Crc           CRC to update. Not inverted.
+   @param[in]      Buffer        Pointer to the buffer.
+   @param[in]      Length        Length of the buffer, in bytes.
+
+   @return The updated CRC. Not inverted.
+**/
+STATIC
+UINT32
+EFIAPI
+BenchCrc32cSw (
+  IN UINT32      Crc,
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  )
+{
+  return ~CalculateCrc32c (Buffer, Length, ~Crc);
+}
+
+/**
+   Calculates an inode's checksum the way Ext4CalculateInodeChecksum does,
+   with a given backend. The inode has a 32-bit checksum.
+
+   @param[in]      Update       CRC32C backend.
+   @param[in]      Inode        Inode to checksum.
+   @param[in]      InodeNum     Inode number.
+   @param[in]      InitialSeed  Filesystem checksum seed.
+
+   @return The inode's checksum.
+**/
+STATIC
+UINT32
+BenchInodeChecksum (
+  IN CRC32C_UPDATE     Update,
+  IN CONST EXT4_INODE  *Inode,
+  IN EXT4_INO_NR       InodeNum,
+  IN UINT32            InitialSeed
+  )
+{
+  UINT32  Crc;
+  UINT16  Dummy;
+
+  Dummy = 0;
+
+  Crc = Update (InitialSeed, &InodeNum, sizeof (InodeNum));
+  Crc = Update (Crc, &Inode->i_generation, sizeof (Inode->i_generation));
+  Crc = Update (Crc, Inode, OFFSET_OF (EXT4_INODE, i_osd2.data_linux.l_i_checksum_lo));
+  Crc = Update (Crc, &Dummy, sizeof (Dummy));
+  Crc = Update (
+          Crc,
+          &Inode->i_osd2.data_linux.l_i_reserved,
+          OFFSET_OF (EXT4_INODE, i_checksum_hi) - OFFSET_OF (EXT4_INODE, i_osd2.data_linux.l_i_reserved)
+          );
+  Crc = Update (Crc, &Dummy, sizeof (Dummy));
+  Crc = Update (Crc, &Inode->i_ctime_extra, CRC32C_BENCH_INODE_SIZE - EXT4_GOOD_OLD_INODE_SIZE - 4);
+
+  return Crc;
+}
+
+/**
+   Times a backend over CRC32C_BENCH_INODES inode checksums.
+
+   @param[in]      Update       CRC32C backend.
+   @param[in]      Inodes       Inode table to checksum, one block's worth.
+   @param[in]      NumInodes    Number of inodes in Inodes.
+   @param[out]     Checksum     XOR of all the checksums, to compare backends.
+
+   @return Nanoseconds taken.
+**/
+STATIC
+UINT64
+BenchTimeInodeChecksums (
+  IN  CRC32C_UPDATE  Update,
+  IN  CONST UINT8    *Inodes,
+  IN  UINTN          NumInodes,
+  OUT UINT32         *Checksum
+  )
+{
+  UINT64  Start;
+  UINTN   Index;
+  UINT32  Result;
+
+  Result = 0;
+  Start  = HostGetTimeNs ();
+
+  for (Index = 0; Index < CRC32C_BENCH_INODES; Index++) {
+    Result ^= BenchInodeChecksum (
+                Update,
+                (CONST EXT4_INODE *)(Inodes + (Index % NumInodes) * CRC32C_BENCH_INODE_SIZE),
+                (EXT4_INO_NR)(Index + 1),
+                0x5EED5EED
+                );
+  }
+
+  *Checksum = Result;
+  return HostGetTimeNs () - Start;
+}
+
+/**
+   Benchmarks the per-inode checksum with both backends, and checks they
+   produce the same checksums.
+
+   @param[in]  Context    Unused.
+
+   @retval UNIT_TEST_PASSED               The benchmark ran.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The backends disagreed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BenchInodeChecksums (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT8   *Inodes;
+  UINTN   NumInodes;
+  UINTN   Index;
+  UINT32  Random;
+  UINT64  SwNs;
+  UINT32  SwChecksum;
+
+  NumInodes = 4096 / CRC32C_BENCH_INODE_SIZE;
+  Inodes    = AllocatePool (NumInodes * CRC32C_BENCH_INODE_SIZE);
+  UT_ASSERT_NOT_NULL (Inodes);
+
+  // Fixed-seed xorshift, so every run checksums the same inodes.
+  Random = 0x2545F491;
+  for (Index = 0; Index < NumInodes * CRC32C_BENCH_INODE_SIZE; Index++) {
+    Random        ^= Random << 13;
+    Random        ^= Random >> 17;
+    Random        ^= Random << 5;
+    Inodes[Index]  = (UINT8)Random;
+  }
+
+  SwNs = BenchTimeInodeChecksums (BenchCrc32cSw, Inodes, NumInodes, &SwChecksum);
+  printf (
+    "  Inode checksum (%u-byte inodes), table: %llu ns/inode\n",
+    CRC32C_BENCH_INODE_SIZE,
+    (unsigned long long)(SwNs / CRC32C_BENCH_INODES)
+    );
+
+ #if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+  if (HostHasCrc32c ()) {
+    UINT64  HwNs;
+    UINT32  HwChecksum;
+
+    HwNs = BenchTimeInodeChecksums (Ext4Crc32cHw, Inodes, NumInodes, &HwChecksum);
+    printf (
+      "  Inode checksum (%u-byte inodes), instructions: %llu ns/inode (%llux)\n",
+      CRC32C_BENCH_INODE_SIZE,
+      (unsigned long long)(HwNs / CRC32C_BENCH_INODES),
+      (unsigned long long)((HwNs != 0) ? SwNs / HwNs : 0)
+      );
+    UT_ASSERT_EQUAL (HwChecksum, SwChecksum);
+  } else {
+    printf ("  No CRC32C instructions on this host\n");
+  }
+
+ #endif
+
+  FreePool (Inodes);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework and a suite holding the CRC32C
+  benchmark, and run it.
+
+  @retval  EFI_SUCCESS           The benchmark was dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit test framework.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UefiTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      BenchSuite;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&BenchSuite, Framework, "CRC32C benchmark", "Ext4.Crc32cBenchmark", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for the CRC32C benchmark\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (BenchSuite, "Inode checksums", "InodeChecksums", BenchInodeChecksums, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based benchmark execution.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UefiTestMain ();
+}
@@ -0,0 +1,286 @@
+/** @file
+  Host-based unit tests for Ext4Dxe's CRC32C backends.
+
+  The CRC32C instructions (Ext4Crc32cHw, X64/Crc32c.nasm or AArch64/Crc32c.S)
+  are checked against BaseLib's table-driven CalculateCrc32c on known, random
+  and unaligned buffers. Crc32cBenchmark.c times them.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../Ext4Dxe.h"
+#include "HostSupport.h"
+
+#define UNIT_TEST_APP_NAME     "Ext4Dxe CRC32C Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+//
+// Largest buffer used by the random tests, and how many of them to run.
+//
+#define CRC32C_TEST_MAX_LENGTH     4096
+#define CRC32C_TEST_RANDOM_ROUNDS  10000
+
+STATIC UINT32  mRandomState = 0x2545F491;
+
+/**
+   Returns the next value of a fixed-seed xorshift generator, so failures
+   can be reproduced.
+
+   @return A pseudo-random 32-bit value.
+**/
+STATIC
+UINT32
+TestRandom (
+  VOID
+  )
+{
+  mRandomState ^= mRandomState << 13;
+  mRandomState ^= mRandomState >> 17;
+  mRandomState ^= mRandomState << 5;
+  return mRandomState;
+}
+
+/**
+   Fills a buffer with pseudo-random bytes.
+
+   @param[out]     Buffer        Buffer to fill.
+   @param[in]      Length        Length of the buffer, in bytes.
+**/
+STATIC
+VOID
+TestFillRandom (
+  OUT UINT8  *Buffer,
+  IN  UINTN  Length
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < Length; Index++) {
+    Buffer[Index] = (UINT8)TestRandom ();
+  }
+}
+
+/**
+   Updates a CRC32C with a buffer, using BaseLib's table-driven
+   implementation, with the same (non-inverted) convention as Ext4Crc32cHw.
+
+   @param[in]      Crc           CRC to update. Not inverted.
+   @param[in]      Buffer        Pointer to the buffer.
+   @param[in]      Length        Length of the buffer, in bytes.
+
+   @return The updated CRC. Not inverted.
+**/
+STATIC
+UINT32
+EFIAPI
+TestCrc32cSw (
+  IN UINT32      Crc,
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  )
+{
+  return ~CalculateCrc32c (Buffer, Length, ~Crc);
+}
+
+/**
+   Checks Ext4CalculateCrc32c, and the CRC32C instructions if the host has
+   them, against the standard CRC32C check value.
+
+   @param[in]  Context    Unused.
+
+   @retval UNIT_TEST_PASSED               The test passed.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The test failed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+Crc32cKnownAnswer (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  STATIC CONST CHAR8  CheckInput[] = "123456789";
+
+  UT_ASSERT_EQUAL (~Ext4CalculateCrc32c (CheckInput, sizeof (CheckInput) - 1, ~0U), 0xE3069283);
+  UT_ASSERT_EQUAL (~TestCrc32cSw (~0U, CheckInput, sizeof (CheckInput) - 1), 0xE3069283);
+
+ #if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+  if (HostHasCrc32c ()) {
+    UT_ASSERT_EQUAL (~Ext4Crc32cHw (~0U, CheckInput, sizeof (CheckInput) - 1), 0xE3069283);
+    // An empty buffer leaves the CRC alone.
+    UT_ASSERT_EQUAL (Ext4Crc32cHw (0x12345678, CheckInput, 0), 0x12345678);
+  }
+
+ #endif
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+   Checks that both backends agree on random buffers, with random lengths,
+   alignments and initial values, and when a buffer is fed in two pieces
+   (as ext4's checksums are).
+
+   @param[in]  Context    Unused.
+
+   @retval UNIT_TEST_PASSED               The test passed.
+   @retval UNIT_TEST_SKIPPED              The host doesn't have the CRC32C instructions.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The test failed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+Crc32cRandomBuffers (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+ #if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+  UINT8   *Buffer;
+  UINT8   *Start;
+  UINTN   Length;
+  UINTN   Split;
+  UINTN   Round;
+  UINT32  Seed;
+  UINT32  Expected;
+
+  if (!HostHasCrc32c ()) {
+    return UNIT_TEST_SKIPPED;
+  }
+
+  Buffer = AllocatePool (CRC32C_TEST_MAX_LENGTH + 8);
+  UT_ASSERT_NOT_NULL (Buffer);
+
+  for (Round = 0; Round < CRC32C_TEST_RANDOM_ROUNDS; Round++) {
+    Start  = Buffer + (TestRandom () % 8);
+    Length = TestRandom () % (CRC32C_TEST_MAX_LENGTH + 1);
+    Seed   = TestRandom ();
+    TestFillRandom (Start, Length);
+
+    Expected = TestCrc32cSw (Seed, Start, Length);
+    UT_ASSERT_EQUAL (Ext4Crc32cHw (Seed, Start, Length), Expected);
+
+    Split = (Length != 0) ? TestRandom () % Length : 0;
+    UT_ASSERT_EQUAL (
+      Ext4Crc32cHw (Ext4Crc32cHw (Seed, Start, Split), Start + Split, Length - Split),
+      Expected
+      );
+  }
+
+  FreePool (Buffer);
+  return UNIT_TEST_PASSED;
+ #else
+  return UNIT_TEST_SKIPPED;
+ #endif
+}
+
+/**
+   Checks that both backends agree for every combination of start alignment
+   and short length, which covers all the head and tail cases of the
+   instruction loop.
+
+   @param[in]  Context    Unused.
+
+   @retval UNIT_TEST_PASSED               The test passed.
+   @retval UNIT_TEST_SKIPPED              The host doesn't have the CRC32C instructions.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The test failed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+Crc32cUnalignedBuffers (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+ #if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+  UINT8   Buffer[16 + 64];
+  UINTN   Offset;
+  UINTN   Length;
+
+  if (!HostHasCrc32c ()) {
+    return UNIT_TEST_SKIPPED;
+  }
+
+  TestFillRandom (Buffer, sizeof (Buffer));
+
+  for (Offset = 0; Offset < 16; Offset++) {
+    for (Length = 0; Length <= 64; Length++) {
+      UT_ASSERT_EQUAL (
+        Ext4Crc32cHw (~0U, Buffer + Offset, Length),
+        TestCrc32cSw (~0U, Buffer + Offset, Length)
+        );
+    }
+  }
+
+  return UNIT_TEST_PASSED;
+ #else
+  return UNIT_TEST_SKIPPED;
+ #endif
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the
+  CRC32C backends, and run the unit tests.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UefiTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      Crc32cSuite;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&Crc32cSuite, Framework, "CRC32C backends", "Ext4.Crc32c", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for the CRC32C tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (Crc32cSuite, "Known answer", "KnownAnswer", Crc32cKnownAnswer, NULL, NULL, NULL);
+  AddTestCase (Crc32cSuite, "Random buffers", "RandomBuffers", Crc32cRandomBuffers, NULL, NULL, NULL);
+  AddTestCase (Crc32cSuite, "Unaligned buffers", "UnalignedBuffers", Crc32cUnalignedBuffers, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UefiTestMain ();
+}
@@ -0,0 +1,857 @@
+/** @file
+  Host-based benchmark for Ext4Dxe.
+
+  Mounts ext2/3/4 images (see MakeBenchmarkImages.sh) through a fake
+  EFI_DISK_IO_PROTOCOL and times path lookups, directory listing and large
+  sequential reads on each, reporting the disk reads and bytes each one
+  took next to its wall time. Every scenario starts on a fresh mount, so
+  the caches are cold.
+
+  Each image is mounted once with Disk I/O only, and once with a fake
+  EFI_DISK_IO2_PROTOCOL as well, so file reads also go through the
+  asynchronous path. The fake completes every read before returning, so
+  the times show the overhead of that path, not overlap with a real disk.
+
+  Ext4Dxe.c (driver binding) and Collation.c (needs the Unicode Collation
+  protocol and UefiLib) aren't built in; this file stands in for what the
+  rest of the driver needs from them and from boot services.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <stdio.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../Ext4Dxe.h"
+#include "HostSupport.h"
+
+#define UNIT_TEST_APP_NAME     "Ext4Dxe Benchmark"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+//
+// Number of files in /bench/dir and size of /bench/large.bin (which need to
+// match MakeBenchmarkImages.sh), how many files (and missing names) the lookup
+// scenario opens, and the size of each read of large.bin.
+//
+#define BENCH_DIR_FILES        4000
+#define BENCH_LARGE_FILE_SIZE  SIZE_64MB
+#define BENCH_LOOKUPS          1000
+#define BENCH_MISSING          100
+#define BENCH_READ_SIZE        SIZE_1MB
+#define BENCH_DIR_INFO_SIZE    (SIZE_OF_EFI_FILE_INFO + (EXT4_NAME_MAX + 1) * sizeof (CHAR16))
+
+//
+// An image file, loaded in memory, behind fake Disk I/O, Disk I/O 2 and
+// Block I/O protocols.
+//
+typedef struct {
+  EFI_DISK_IO_PROTOCOL     DiskIo;
+  EFI_DISK_IO2_PROTOCOL    DiskIo2;
+  EFI_BLOCK_IO_PROTOCOL    BlockIo;
+  EFI_BLOCK_IO_MEDIA       Media;
+  UINT8                    *Image;
+  UINT64                   ImageSize;
+} HOST_DISK;
+
+#define HOST_DISK_FROM_DISK_IO(This)   BASE_CR (This, HOST_DISK, DiskIo)
+#define HOST_DISK_FROM_DISK_IO2(This)  BASE_CR (This, HOST_DISK, DiskIo2)
+
+//
+// A fake event. Only signalling and checking are supported.
+//
+typedef struct {
+  BOOLEAN    Signaled;
+} HOST_EVENT;
+
+//
+// Per-image benchmark state, mounted before each scenario and unmounted after.
+//
+typedef struct {
+  CONST CHAR8          *ImagePath;
+  BOOLEAN              UseDiskIo2;
+  HOST_DISK            Disk;
+  EXT4_PARTITION       *Partition;
+  EFI_FILE_PROTOCOL    *Root;
+} BENCH_CONTEXT;
+
+EFI_BOOT_SERVICES                       *gBS;
+STATIC EFI_BOOT_SERVICES                mHostBootServices;
+STATIC EFI_SIMPLE_FILE_SYSTEM_PROTOCOL  *mHostFileSystem;
+
+/**
+   Fake InstallMultipleProtocolInterfaces, which only remembers the Simple
+   File System protocol Ext4OpenPartition installs.
+
+   @param[in out]  Handle        Unused.
+   @param[in]      ...           NULL-terminated protocol GUID and interface pairs.
+
+   @retval EFI_SUCCESS           Always.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE  *Handle,
+  ...
+  )
+{
+  VA_LIST   Args;
+  EFI_GUID  *Protocol;
+  VOID      *Interface;
+
+  VA_START (Args, Handle);
+
+  for (Protocol = VA_ARG (Args, EFI_GUID *); Protocol != NULL; Protocol = VA_ARG (Args, EFI_GUID *)) {
+    Interface = VA_ARG (Args, VOID *);
+
+    if (CompareGuid (Protocol, &gEfiSimpleFileSystemProtocolGuid)) {
+      mHostFileSystem = Interface;
+    }
+  }
+
+  VA_END (Args);
+  return EFI_SUCCESS;
+}
+
+/**
+   Fake RaiseTPL. Everything runs at TPL_APPLICATION.
+
+   @param[in]      NewTpl        Unused.
+
+   @return TPL_APPLICATION.
+**/
+STATIC
+EFI_TPL
+EFIAPI
+HostRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  return TPL_APPLICATION;
+}
+
+/**
+   Fake RestoreTPL.
+
+   @param[in]      OldTpl        Unused.
+**/
+STATIC
+VOID
+EFIAPI
+HostRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+}
+
+/**
+   Fake CreateEvent. Notification functions aren't supported.
+
+   @param[in]      Type           Unused.
+   @param[in]      NotifyTpl      Unused.
+   @param[in]      NotifyFunction Must be NULL.
+   @param[in]      NotifyContext  Unused.
+   @param[out]     Event          The new event.
+
+   @retval EFI_SUCCESS            The event was created.
+   @retval EFI_UNSUPPORTED        NotifyFunction isn't NULL.
+   @retval EFI_OUT_OF_RESOURCES   Out of memory.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  if (NotifyFunction != NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  *Event = AllocateZeroPool (sizeof (HOST_EVENT));
+  return (*Event != NULL) ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+/**
+   Fake SignalEvent.
+
+   @param[in]      Event         Event to signal.
+
+   @retval EFI_SUCCESS           Always.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((HOST_EVENT *)Event)->Signaled = TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+   Fake CheckEvent. Clears the event if it was signalled.
+
+   @param[in]      Event         Event to check.
+
+   @retval EFI_SUCCESS           The event was signalled.
+   @retval EFI_NOT_READY         The event isn't signalled.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  if (!((HOST_EVENT *)Event)->Signaled) {
+    return EFI_NOT_READY;
+  }
+
+  ((HOST_EVENT *)Event)->Signaled = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+   Fake CloseEvent.
+
+   @param[in]      Event         Event to free.
+
+   @retval EFI_SUCCESS           Always.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  FreePool (Event);
+  return EFI_SUCCESS;
+}
+
+/**
+   Case-insensitive string comparison, standing in for Collation.c's.
+   Folds case with CharToUpper, which is enough for the benchmark images.
+
+   @param[in]      Str1   Pointer to a null terminated string.
+   @param[in]      Str2   Pointer to a null terminated string.
+
+   @retval 0   Str1 is equivalent to Str2.
+   @retval >0  Str1 is lexically greater than Str2.
+   @retval <0  Str1 is lexically less than Str2.
+**/
+INTN
+Ext4StrCmpInsensitive (
+  IN CHAR16  *Str1,
+  IN CHAR16  *Str2
+  )
+{
+  while ((*Str1 != L'\0') && (CharToUpper (*Str1) == CharToUpper (*Str2))) {
+    Str1++;
+    Str2++;
+  }
+
+  return (INTN)CharToUpper (*Str1) - (INTN)CharToUpper (*Str2);
+}
+
+/**
+   Reads from the in-memory image. Refer to EFI_DISK_IO_PROTOCOL's ReadDisk
+   for more details.
+
+   @param[in]      This          Pointer to the fake protocol.
+   @param[in]      MediaId       Id of the media.
+   @param[in]      Offset        Offset on the disk, in bytes.
+   @param[in]      BufferSize    Size of the read.
+   @param[out]     Buffer        Buffer to read into.
+
+   @retval EFI_SUCCESS            The read succeeded.
+   @retval EFI_MEDIA_CHANGED      MediaId doesn't match.
+   @retval EFI_INVALID_PARAMETER  The read goes past the end of the image.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskRead (
+  IN  EFI_DISK_IO_PROTOCOL  *This,
+  IN  UINT32                MediaId,
+  IN  UINT64                Offset,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  HOST_DISK  *Disk;
+
+  Disk = HOST_DISK_FROM_DISK_IO (This);
+
+  if (MediaId != Disk->Media.MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if ((Offset > Disk->ImageSize) || (BufferSize > Disk->ImageSize - Offset)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  CopyMem (Buffer, Disk->Image + Offset, BufferSize);
+  return EFI_SUCCESS;
+}
+
+/**
+   Reads from the in-memory image, completing the read before returning.
+   Refer to EFI_DISK_IO2_PROTOCOL's ReadDiskEx for more details.
+
+   @param[in]      This          Pointer to the fake protocol.
+   @param[in]      MediaId       Id of the media.
+   @param[in]      Offset        Offset on the disk, in bytes.
+   @param[in out]  Token         Token to complete, or NULL (or with a NULL
+                                 Event) for a blocking read.
+   @param[in]      BufferSize    Size of the read.
+   @param[out]     Buffer        Buffer to read into.
+
+   @retval EFI_SUCCESS            The read was done, and Token's event signalled.
+   @retval EFI_MEDIA_CHANGED      MediaId doesn't match.
+   @retval EFI_INVALID_PARAMETER  The read goes past the end of the image.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskReadEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  HOST_DISK   *Disk;
+  EFI_STATUS  Status;
+
+  Disk   = HOST_DISK_FROM_DISK_IO2 (This);
+  Status = HostDiskRead (&Disk->DiskIo, MediaId, Offset, BufferSize, Buffer);
+
+  if (EFI_ERROR (Status) || (Token == NULL) || (Token->Event == NULL)) {
+    return Status;
+  }
+
+  Token->TransactionStatus = EFI_SUCCESS;
+  return HostSignalEvent (Token->Event);
+}
+
+/**
+   Fake WriteDisk. The benchmark never writes.
+
+   @param[in]      This          Unused.
+   @param[in]      MediaId       Unused.
+   @param[in]      Offset        Unused.
+   @param[in]      BufferSize    Unused.
+   @param[in]      Buffer        Unused.
+
+   @retval EFI_WRITE_PROTECTED    Always.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskWrite (
+  IN EFI_DISK_IO_PROTOCOL  *This,
+  IN UINT32                MediaId,
+  IN UINT64                Offset,
+  IN UINTN                 BufferSize,
+  IN VOID                  *Buffer
+  )
+{
+  return EFI_WRITE_PROTECTED;
+}
+
+/**
+   Loads an image file into a fake disk.
+
+   @param[in]      Path          Path to the image file.
+   @param[out]     Disk          Disk to set up.
+
+   @retval EFI_SUCCESS            The image was loaded.
+   @retval EFI_NOT_FOUND          The image couldn't be opened.
+   @retval EFI_DEVICE_ERROR       The image couldn't be read.
+   @retval EFI_OUT_OF_RESOURCES   Out of memory.
+**/
+STATIC
+EFI_STATUS
+HostDiskLoad (
+  IN  CONST CHAR8  *Path,
+  OUT HOST_DISK    *Disk
+  )
+{
+  FILE  *File;
+  long  Size;
+
+  ZeroMem (Disk, sizeof (*Disk));
+
+  File = fopen (Path, "rb");
+  if (File == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  if ((fseek (File, 0, SEEK_END) != 0) || ((Size = ftell (File)) <= 0) || (fseek (File, 0, SEEK_SET) != 0)) {
+    fclose (File);
+    return EFI_DEVICE_ERROR;
+  }
+
+  Disk->Image = AllocatePool ((UINTN)Size);
+  if (Disk->Image == NULL) {
+    fclose (File);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (fread (Disk->Image, 1, (size_t)Size, File) != (size_t)Size) {
+    fclose (File);
+    FreePool (Disk->Image);
+    return EFI_DEVICE_ERROR;
+  }
+
+  fclose (File);
+
+  Disk->ImageSize          = (UINT64)Size;
+  Disk->Media.MediaId      = 1;
+  Disk->Media.MediaPresent = TRUE;
+  Disk->Media.ReadOnly     = TRUE;
+  Disk->Media.BlockSize    = 512;
+  Disk->Media.LastBlock    = Disk->ImageSize / 512 - 1;
+  Disk->BlockIo.Revision   = EFI_BLOCK_IO_PROTOCOL_REVISION;
+  Disk->BlockIo.Media      = &Disk->Media;
+  Disk->DiskIo.Revision    = EFI_DISK_IO_PROTOCOL_REVISION;
+  Disk->DiskIo.ReadDisk    = HostDiskRead;
+  Disk->DiskIo.WriteDisk   = HostDiskWrite;
+  Disk->DiskIo2.Revision   = EFI_DISK_IO2_PROTOCOL_REVISION;
+  Disk->DiskIo2.ReadDiskEx = HostDiskReadEx;
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Prints a scenario's disk I/O and wall time.
+
+   @param[in]      Bench         Benchmark context.
+   @param[in]      Scenario      Name of the scenario.
+   @param[in]      ElapsedNs     Wall time the scenario took, in nanoseconds.
+**/
+STATIC
+VOID
+BenchReport (
+  IN CONST BENCH_CONTEXT  *Bench,
+  IN CONST CHAR8          *Scenario,
+  IN UINT64               ElapsedNs
+  )
+{
+  printf (
+    "  %s (%s): %s: %llu disk reads, %llu async, %llu bytes read, %llu.%03llu ms\n",
+    Bench->ImagePath,
+    Bench->UseDiskIo2 ? "DiskIo2" : "DiskIo",
+    Scenario,
+    (unsigned long long)Bench->Partition->NumberDiskReads,
+    (unsigned long long)Bench->Partition->NumberAsyncDiskReads,
+    (unsigned long long)Bench->Partition->BytesRead,
+    (unsigned long long)(ElapsedNs / 1000000),
+    (unsigned long long)((ElapsedNs / 1000) % 1000)
+    );
+}
+
+/**
+   Loads and mounts the image, with or without Disk I/O 2, and opens its
+   root directory. The disk I/O counters start at zero once this is done.
+
+   @param[in]  Context    Benchmark context.
+
+   @retval UNIT_TEST_PASSED                        The image is mounted.
+   @retval UNIT_TEST_ERROR_PREREQUISITE_NOT_MET    The image couldn't be mounted.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BenchMount (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  BENCH_CONTEXT  *Bench;
+  EFI_STATUS     Status;
+
+  Bench = (BENCH_CONTEXT *)Context;
+
+  Status = HostDiskLoad (Bench->ImagePath, &Bench->Disk);
+  if (EFI_ERROR (Status)) {
+    UT_LOG_ERROR ("Failed to load %a: %r\n", Bench->ImagePath, Status);
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+
+  mHostFileSystem = NULL;
+  Status          = Ext4OpenPartition (
+                      (EFI_HANDLE)&Bench->Disk,
+                      &Bench->Disk.DiskIo,
+                      Bench->UseDiskIo2 ? &Bench->Disk.DiskIo2 : NULL,
+                      &Bench->Disk.BlockIo
+                      );
+  if (EFI_ERROR (Status) || (mHostFileSystem == NULL)) {
+    UT_LOG_ERROR ("Failed to mount %a: %r\n", Bench->ImagePath, Status);
+    FreePool (Bench->Disk.Image);
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+
+  Bench->Partition = (EXT4_PARTITION *)mHostFileSystem;
+
+  Status = mHostFileSystem->OpenVolume (mHostFileSystem, &Bench->Root);
+  if (EFI_ERROR (Status)) {
+    UT_LOG_ERROR ("Failed to open the root of %a: %r\n", Bench->ImagePath, Status);
+    Ext4UnmountAndFreePartition (Bench->Partition);
+    FreePool (Bench->Disk.Image);
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+
+  Bench->Partition->NumberDiskReads      = 0;
+  Bench->Partition->NumberAsyncDiskReads = 0;
+  Bench->Partition->BytesRead            = 0;
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+   Unmounts and frees the image.
+
+   @param[in]  Context    Benchmark context.
+**/
+STATIC
+VOID
+EFIAPI
+BenchUnmount (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  BENCH_CONTEXT  *Bench;
+
+  Bench = (BENCH_CONTEXT *)Context;
+
+  Bench->Root->Close (Bench->Root);
+  Ext4UnmountAndFreePartition (Bench->Partition);
+  FreePool (Bench->Disk.Image);
+
+  Bench->Root      = NULL;
+  Bench->Partition = NULL;
+}
+
+/**
+   Opens and closes a file by path.
+
+   @param[in]      Root          Root directory.
+   @param[in]      Path          Path of the file.
+
+   @return Status of the open.
+**/
+STATIC
+EFI_STATUS
+BenchOpenClose (
+  IN EFI_FILE_PROTOCOL  *Root,
+  IN CHAR16             *Path
+  )
+{
+  EFI_FILE_PROTOCOL  *File;
+  EFI_STATUS         Status;
+
+  Status = Root->Open (Root, &File, Path, EFI_FILE_MODE_READ, 0);
+  if (!EFI_ERROR (Status)) {
+    File->Close (File);
+  }
+
+  return Status;
+}
+
+/**
+   Writes a four digit decimal number over the last four characters of a path.
+
+   @param[in out]  Path          Path to update.
+   @param[in]      Number        Number to write, below 10000.
+**/
+STATIC
+VOID
+BenchSetPathNumber (
+  IN OUT CHAR16  *Path,
+  IN     UINTN   Number
+  )
+{
+  UINTN  Index;
+
+  Path += StrLen (Path);
+
+  for (Index = 0; Index < 4; Index++) {
+    *--Path = (CHAR16)(L'0' + Number % 10);
+    Number /= 10;
+  }
+}
+
+/**
+   Opens files in a large directory by path, in an order that jumps around
+   the directory, then a deep path, then names that don't exist.
+
+   @param[in]  Context    Benchmark context.
+
+   @retval UNIT_TEST_PASSED               The test passed.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The test failed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BenchOpenByPath (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  BENCH_CONTEXT  *Bench;
+  CHAR16         Path[32];
+  UINT64         Start;
+  UINT64         Elapsed;
+  UINTN          Index;
+
+  Bench = (BENCH_CONTEXT *)Context;
+  Start = HostGetTimeNs ();
+
+  StrCpyS (Path, ARRAY_SIZE (Path), L"\\bench\\dir\\file0000");
+  for (Index = 0; Index < BENCH_LOOKUPS; Index++) {
+    // 997 is prime, so this visits distinct files.
+    BenchSetPathNumber (Path, (Index * 997) % BENCH_DIR_FILES);
+    UT_ASSERT_NOT_EFI_ERROR (BenchOpenClose (Bench->Root, Path));
+  }
+
+  UT_ASSERT_NOT_EFI_ERROR (BenchOpenClose (Bench->Root, L"\\bench\\deep\\d1\\d2\\d3\\d4\\d5\\d6\\d7\\d8\\leaf.txt"));
+
+  StrCpyS (Path, ARRAY_SIZE (Path), L"\\bench\\dir\\nofile0000");
+  for (Index = 0; Index < BENCH_MISSING; Index++) {
+    BenchSetPathNumber (Path, Index);
+    UT_ASSERT_STATUS_EQUAL (BenchOpenClose (Bench->Root, Path), EFI_NOT_FOUND);
+  }
+
+  Elapsed = HostGetTimeNs () - Start;
+  BenchReport (Bench, "open by path", Elapsed);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+   Lists a large directory.
+
+   @param[in]  Context    Benchmark context.
+
+   @retval UNIT_TEST_PASSED               The test passed.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The test failed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BenchListDirectory (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  BENCH_CONTEXT      *Bench;
+  EFI_FILE_PROTOCOL  *Dir;
+  EFI_FILE_INFO      *Info;
+  UINTN              Size;
+  UINTN              Entries;
+  UINT64             Start;
+  UINT64             Elapsed;
+  EFI_STATUS         Status;
+
+  Bench = (BENCH_CONTEXT *)Context;
+  Info  = AllocatePool (BENCH_DIR_INFO_SIZE);
+  UT_ASSERT_NOT_NULL (Info);
+
+  Start = HostGetTimeNs ();
+
+  Status = Bench->Root->Open (Bench->Root, &Dir, L"\\bench\\dir", EFI_FILE_MODE_READ, 0);
+  UT_ASSERT_NOT_EFI_ERROR (Status);
+
+  Entries = 0;
+
+  do {
+    Size   = BENCH_DIR_INFO_SIZE;
+    Status = Dir->Read (Dir, &Size, Info);
+    UT_ASSERT_NOT_EFI_ERROR (Status);
+    Entries += (Size != 0) ? 1 : 0;
+  } while (Size != 0);
+
+  Dir->Close (Dir);
+
+  Elapsed = HostGetTimeNs () - Start;
+
+  FreePool (Info);
+
+  // "." and ".." are listed too.
+  UT_ASSERT_TRUE (Entries >= BENCH_DIR_FILES);
+  BenchReport (Bench, "directory listing", Elapsed);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+   Reads a large file from start to end.
+
+   @param[in]  Context    Benchmark context.
+
+   @retval UNIT_TEST_PASSED               The test passed.
+   @retval UNIT_TEST_ERROR_TEST_FAILED    The test failed.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BenchSequentialRead (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  BENCH_CONTEXT      *Bench;
+  EFI_FILE_PROTOCOL  *File;
+  UINT8              *Buffer;
+  UINTN              Size;
+  UINT64             Total;
+  UINT64             Start;
+  UINT64             Elapsed;
+  EFI_STATUS         Status;
+
+  Bench  = (BENCH_CONTEXT *)Context;
+  Buffer = AllocatePool (BENCH_READ_SIZE);
+  UT_ASSERT_NOT_NULL (Buffer);
+
+  Start = HostGetTimeNs ();
+
+  Status = Bench->Root->Open (Bench->Root, &File, L"\\bench\\large.bin", EFI_FILE_MODE_READ, 0);
+  UT_ASSERT_NOT_EFI_ERROR (Status);
+
+  Total = 0;
+
+  do {
+    Size   = BENCH_READ_SIZE;
+    Status = File->Read (File, &Size, Buffer);
+    UT_ASSERT_NOT_EFI_ERROR (Status);
+    Total += Size;
+  } while (Size != 0);
+
+  File->Close (File);
+
+  Elapsed = HostGetTimeNs () - Start;
+
+  FreePool (Buffer);
+
+  UT_ASSERT_EQUAL (Total, BENCH_LARGE_FILE_SIZE);
+  BenchReport (Bench, "sequential read", Elapsed);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, and suites with the benchmark
+  scenarios for each image, with and without Disk I/O 2, and run them.
+
+  @param[in]  NumImages   Number of images.
+  @param[in]  Images      Paths to the images.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UefiTestMain (
+  IN UINTN  NumImages,
+  IN CHAR8  **Images
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ImageSuite;
+  BENCH_CONTEXT               *Contexts;
+  UINTN                       Index;
+  UINTN                       NumContexts;
+
+  Framework = NULL;
+  Contexts  = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  if (NumImages == 0) {
+    printf ("Usage: %s <image>...\nSee MakeBenchmarkImages.sh for the images.\n", gEfiCallerBaseName);
+    return EFI_SUCCESS;
+  }
+
+  ZeroMem (&mHostBootServices, sizeof (mHostBootServices));
+  mHostBootServices.RaiseTPL                          = HostRaiseTpl;
+  mHostBootServices.RestoreTPL                        = HostRestoreTpl;
+  mHostBootServices.CreateEvent                       = HostCreateEvent;
+  mHostBootServices.SignalEvent                       = HostSignalEvent;
+  mHostBootServices.CheckEvent                        = HostCheckEvent;
+  mHostBootServices.CloseEvent                        = HostCloseEvent;
+  mHostBootServices.InstallMultipleProtocolInterfaces = HostInstallMultipleProtocolInterfaces;
+  gBS                                                 = &mHostBootServices;
+
+  NumContexts = NumImages * 2;
+  Contexts    = AllocateZeroPool (NumContexts * sizeof (BENCH_CONTEXT));
+  if (Contexts == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  for (Index = 0; Index < NumContexts; Index++) {
+    Contexts[Index].ImagePath  = Images[Index / 2];
+    Contexts[Index].UseDiskIo2 = (Index % 2) != 0;
+
+    Status = CreateUnitTestSuite (
+               &ImageSuite,
+               Framework,
+               Contexts[Index].ImagePath,
+               Contexts[Index].UseDiskIo2 ? "Ext4.Benchmark.DiskIo2" : "Ext4.Benchmark.DiskIo",
+               NULL,
+               NULL
+               );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for %a\n", Contexts[Index].ImagePath));
+      Status = EFI_OUT_OF_RESOURCES;
+      goto EXIT;
+    }
+
+    AddTestCase (ImageSuite, "Open by path", "OpenByPath", BenchOpenByPath, BenchMount, BenchUnmount, &Contexts[Index]);
+    AddTestCase (ImageSuite, "Directory listing", "ListDirectory", BenchListDirectory, BenchMount, BenchUnmount, &Contexts[Index]);
+    AddTestCase (ImageSuite, "Sequential read", "SequentialRead", BenchSequentialRead, BenchMount, BenchUnmount, &Contexts[Index]);
+  }
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  FreePool (Contexts);
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+  Takes the paths of the images to benchmark.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UefiTestMain ((UINTN)(argc - 1), argv + 1);
+}
@@ -0,0 +1,91 @@
+/** @file
+  Host-only helpers shared by Ext4Dxe's host-based tests and benchmarks.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#if defined (_MSC_VER)
+  #include <intrin.h>
+#else
+  #include <time.h>
+#endif
+
+#if defined (__linux__) && defined (__aarch64__)
+  #include <sys/auxv.h>
+#endif
+
+#include "HostSupport.h"
+
+#if defined (_MSC_VER)
+
+//
+// From <windows.h>, which can't be included next to the UEFI headers.
+//
+__declspec (dllimport) int __stdcall
+QueryPerformanceCounter (
+  INT64  *PerformanceCount
+  );
+
+__declspec (dllimport) int __stdcall
+QueryPerformanceFrequency (
+  INT64  *Frequency
+  );
+
+#endif
+
+#if defined (__linux__) && defined (__aarch64__) && !defined (HWCAP_CRC32)
+#define HWCAP_CRC32  (1 << 7)
+#endif
+
+/**
+   Checks if the host CPU has the CRC32C instructions Ext4Crc32cHw uses.
+   BaseLib's AsmCpuid is mocked in host builds, and ID_AA64ISAR0_EL1 isn't
+   readable from user mode everywhere, so ask the compiler or the OS instead.
+
+   @return TRUE if Ext4Crc32cHw can run on this host, else FALSE.
+**/
+BOOLEAN
+HostHasCrc32c (
+  VOID
+  )
+{
+ #if defined (MDE_CPU_X64) && defined (_MSC_VER)
+  int  Registers[4];
+
+  // CPUID.01H:ECX.SSE4_2[bit 20]
+  __cpuid (Registers, 1);
+  return (Registers[2] & BIT20) != 0;
+ #elif defined (MDE_CPU_X64)
+  return __builtin_cpu_supports ("sse4.2") != 0;
+ #elif defined (MDE_CPU_AARCH64) && defined (__linux__)
+  return (getauxval (AT_HWCAP) & HWCAP_CRC32) != 0;
+ #else
+  return FALSE;
+ #endif
+}
+
+/**
+   Returns a timestamp from a monotonic clock, for timing benchmarks.
+
+   @return The current time, in nanoseconds from an arbitrary start.
+**/
+UINT64
+HostGetTimeNs (
+  VOID
+  )
+{
+ #if defined (_MSC_VER)
+  INT64  Count;
+  INT64  Frequency;
+
+  QueryPerformanceFrequency (&Frequency);
+  QueryPerformanceCounter (&Count);
+  return (UINT64)(Count / Frequency) * 1000000000ULL +
+         (UINT64)(Count % Frequency) * 1000000000ULL / (UINT64)Frequency;
+ #else
+  struct timespec  Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return (UINT64)Now.tv_sec * 1000000000ULL + (UINT64)Now.tv_nsec;
+ #endif
+}
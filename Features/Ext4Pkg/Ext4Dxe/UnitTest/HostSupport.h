@@ -0,0 +1,54 @@
+/** @file
+  Host-only helpers shared by Ext4Dxe's host-based tests and benchmarks.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef EXT4_HOST_SUPPORT_H_
+#define EXT4_HOST_SUPPORT_H_
+
+#include <Uefi.h>
+
+#if defined (MDE_CPU_X64) || defined (MDE_CPU_AARCH64)
+
+/**
+   Updates a CRC32C with a buffer, using the CPU's CRC32C instructions.
+   Implemented in assembly (X64/Crc32c.nasm, AArch64/Crc32c.S).
+
+   @param[in]      Crc           CRC to update. Not inverted.
+   @param[in]      Buffer        Pointer to the buffer.
+   @param[in]      Length        Length of the buffer, in bytes.
+
+   @return The updated CRC. Not inverted.
+**/
+UINT32
+EFIAPI
+Ext4Crc32cHw (
+  IN UINT32      Crc,
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  );
+
+#endif
+
+/**
+   Checks if the host CPU has the CRC32C instructions Ext4Crc32cHw uses.
+
+   @return TRUE if Ext4Crc32cHw can run on this host, else FALSE.
+**/
+BOOLEAN
+HostHasCrc32c (
+  VOID
+  );
+
+/**
+   Returns a timestamp from a monotonic clock, for timing benchmarks.
+
+   @return The current time, in nanoseconds from an arbitrary start.
+**/
+UINT64
+HostGetTimeNs (
+  VOID
+  );
+
+#endif
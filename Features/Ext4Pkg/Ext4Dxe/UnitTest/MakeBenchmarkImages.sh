@@ -0,0 +1,89 @@
+#!/bin/sh
+## @file
+# Generates the ext2/3/4 images used by Ext4BenchmarkHost.
+#
+# Usage: MakeBenchmarkImages.sh [output directory]
+#
+# Every image has the same tree:
+#   /bench/dir/file0000 ... file3999   A large directory
+#   /bench/deep/d1/.../d8/leaf.txt     A deep path
+#   /bench/large.bin                   A 64 MiB file
+#
+# and differs in how it's laid out on disk:
+#   linear.img      ext4 without dir_index, so directories are linear
+#   htree.img       ext4 with hash tree indexed directories
+#   fragmented.img  htree.img, but large.bin is spread over 64 KiB holes
+#   blockmap.img    ext3 (no extents), so files use block maps
+#
+# Needs mke2fs 1.43 or later (for -d), e2fsck and debugfs.
+#
+# SPDX-License-Identifier: BSD-2-Clause-Patent
+#
+##
+
+set -e
+
+OUT=${1:-.}
+IMAGE_SIZE=256M
+STAGE=$(mktemp -d)
+trap 'rm -rf "$STAGE"' EXIT
+
+mkdir -p "$OUT"
+
+# The tree every image gets.
+mkdir -p "$STAGE/tree/bench/dir" "$STAGE/tree/bench/deep/d1/d2/d3/d4/d5/d6/d7/d8"
+i=0
+while [ $i -lt 4000 ]; do
+  : > "$STAGE/tree/bench/dir/$(printf 'file%04d' $i)"
+  i=$((i + 1))
+done
+echo leaf > "$STAGE/tree/bench/deep/d1/d2/d3/d4/d5/d6/d7/d8/leaf.txt"
+head -c 64M /dev/urandom > "$STAGE/large.bin"
+cp "$STAGE/large.bin" "$STAGE/tree/bench/large.bin"
+
+# mke2fs -d doesn't index directories, so have e2fsck do it. e2fsck exits with
+# 1 when it changed the filesystem, which is expected here.
+index_dirs () {
+  e2fsck -fyD "$1" > /dev/null 2>&1 || [ $? -eq 1 ]
+}
+
+rm -f "$OUT/linear.img" "$OUT/htree.img" "$OUT/fragmented.img" "$OUT/blockmap.img"
+
+mke2fs -q -F -t ext4 -b 4096 -O ^dir_index -d "$STAGE/tree" "$OUT/linear.img" $IMAGE_SIZE > /dev/null
+
+mke2fs -q -F -t ext4 -b 4096 -d "$STAGE/tree" "$OUT/htree.img" $IMAGE_SIZE > /dev/null
+index_dirs "$OUT/htree.img"
+
+mke2fs -q -F -t ext3 -b 4096 -d "$STAGE/tree" "$OUT/blockmap.img" $IMAGE_SIZE > /dev/null
+index_dirs "$OUT/blockmap.img"
+
+# Fill the start of the disk with 64 KiB files, free every other one, and
+# only then write large.bin, so its blocks go into the holes.
+rm "$STAGE/tree/bench/large.bin"
+mkdir "$STAGE/tree/fill"
+# Not zeroes, or mke2fs makes the files sparse.
+head -c 64K /dev/urandom > "$STAGE/fill"
+i=0
+while [ $i -lt 2048 ]; do
+  cp "$STAGE/fill" "$STAGE/tree/fill/$(printf 'f%04d' $i)"
+  i=$((i + 1))
+done
+
+mke2fs -q -F -t ext4 -b 4096 -d "$STAGE/tree" "$OUT/fragmented.img" $IMAGE_SIZE > /dev/null
+index_dirs "$OUT/fragmented.img"
+
+i=0
+: > "$STAGE/debugfs.cmd"
+while [ $i -lt 2048 ]; do
+  printf 'rm /fill/f%04d\n' $i >> "$STAGE/debugfs.cmd"
+  i=$((i + 2))
+done
+echo "write $STAGE/large.bin /bench/large.bin" >> "$STAGE/debugfs.cmd"
+debugfs -w -f "$STAGE/debugfs.cmd" "$OUT/fragmented.img" > /dev/null 2>&1
+
+# Count leaf extents, i.e. entries at the tree's last level.
+for Image in linear htree fragmented; do
+  Extents=$(debugfs -R "ex /bench/large.bin" "$OUT/$Image.img" 2>/dev/null | awk '/^ *[0-9]+\// && $1 + 0 == $2 + 0' | wc -l)
+  echo "$OUT/$Image.img: large.bin has $Extents extents"
+done
+echo "$OUT/blockmap.img: large.bin uses a block map"
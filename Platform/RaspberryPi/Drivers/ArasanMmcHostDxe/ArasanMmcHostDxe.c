@@ -14,10 +14,26 @@
 STATIC BOOLEAN mCardIsPresent = FALSE;
 STATIC CARD_DETECT_STATE mCardDetectState = CardDetectRequired;
 UINT32 LastExecutedCommand = (UINT32) -1;
+STATIC UINT32 mSetBlockCount;
 
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL *mFwProtocol;
 STATIC UINTN mMmcHsBase;
 
+/*
+ * ADMA2 state. With DMA, the block I/O commands are held back until
+ * MMCReadBlockData/MMCWriteBlockData, as the descriptor table must
+ * be set up before the command is issued.
+ */
+STATIC BOOLEAN mUseDma;
+STATIC ADMA2_DESCRIPTOR *mAdmaDescs;
+STATIC EFI_PHYSICAL_ADDRESS mAdmaDescsBusAddress;
+STATIC VOID *mAdmaDescsMapping;
+STATIC EFI_PHYSICAL_ADDRESS mDmaBusOffset;
+STATIC BOOLEAN mCmdPending;
+STATIC MMC_CMD mPendingCmd;
+STATIC UINT32 mPendingArgument;
+STATIC UINT32 mDmaBlockCount;
+
 STATIC
 UINT32
 EFIAPI
@@ -346,6 +362,18 @@ MMCSendCommand (
     return EFI_SUCCESS;
   }
 
+  if (mUseDma && !mCmdPending && !IsAppCmd &&
+      (MmcCmd == MMC_CMD17 || MmcCmd == MMC_CMD18 ||
+       MmcCmd == MMC_CMD24 || MmcCmd == MMC_CMD25)) {
+    /*
+     * Issued by MMCIssuePendingCommand, once the buffer is known.
+     */
+    mPendingCmd = MmcCmd;
+    mPendingArgument = Argument;
+    mCmdPending = TRUE;
+    return EFI_SUCCESS;
+  }
+
   MmcCmd = TranslateCommand (MmcCmd, Argument);
   if (MmcCmd == 0xffffffff) {
     return EFI_UNSUPPORTED;
@@ -387,10 +415,29 @@ MMCSendCommand (
     SdMmioWrite32 (MMCHS_BLK, 8);
   } else if (!IsAppCmd && MmcCmd == CMD6) {
     SdMmioWrite32 (MMCHS_BLK, 64);
+  } else if (IsADTCCmd && mDmaBlockCount != 0) {
+    /*
+     * ADMA2 transfer, the descriptor table is already set up.
+     */
+    SdMmioWrite32 (MMCHS_BLK, BLEN_512BYTES | (mDmaBlockCount << BLOCK_COUNT_SHIFT));
+    MmcCmd |= BCE_ENABLE | DE_ENABLE;
+  } else if (IsADTCCmd &&
+             LastExecutedCommand == CMD23 &&
+             (MmcCmd == CMD18 || MmcCmd == CMD25)) {
+    /*
+     * Pre-defined multiple block transfer: the card stops on its own
+     * after the CMD23 block count, so the controller must count too.
+     */
+    SdMmioWrite32 (MMCHS_BLK, BLEN_512BYTES | (mSetBlockCount << BLOCK_COUNT_SHIFT));
+    MmcCmd |= BCE_ENABLE;
   } else if (IsADTCCmd) {
     SdMmioWrite32 (MMCHS_BLK, BLEN_512BYTES);
   }
 
+  if (MmcCmd == CMD23) {
+    mSetBlockCount = Argument & MAX_BLOCK_COUNT;
+  }
+
   // Set Data timeout counter value to max value.
   SdMmioAndThenOr32 (MMCHS_SYSCTL, (UINT32) ~DTO_MASK, DTO_VAL);
 
@@ -484,6 +531,8 @@ MMCNotifyState (
         return Status;
       }
 
+      mCmdPending = FALSE;
+
       DEBUG ((DEBUG_MMCHOST_SD, "ArasanMMCHost: CAP %X CAPH %X\n", MmioRead32(MMCHS_CAPA),MmioRead32(MMCHS_CUR_CAPA)));
 
       // Lets switch to card detect test mode.
@@ -678,6 +727,193 @@ MMCReceiveResponse (
   return EFI_SUCCESS;
 }
 
+/**
+   Issues the block I/O command held back by MMCSendCommand.
+
+   @param BlockCount  Number of blocks to transfer with ADMA2, or 0
+                      for a PIO transfer.
+**/
+STATIC
+EFI_STATUS
+MMCIssuePendingCommand (
+  IN EFI_MMC_HOST_PROTOCOL    *This,
+  IN UINT32                   BlockCount
+  )
+{
+  EFI_STATUS Status;
+
+  ASSERT (mCmdPending);
+
+  mDmaBlockCount = BlockCount;
+  Status = MMCSendCommand (This, mPendingCmd, mPendingArgument);
+  mDmaBlockCount = 0;
+  mCmdPending = FALSE;
+
+  return Status;
+}
+
+/**
+   Performs the data phase of the pending block I/O command with ADMA2,
+   waiting for a single transfer complete interrupt for the whole run.
+
+   @retval EFI_UNSUPPORTED  The buffer can't be used for DMA. The pending
+                            command is still pending, and the caller
+                            must fall back to PIO.
+**/
+STATIC
+EFI_STATUS
+MMCTransferDma (
+  IN     EFI_MMC_HOST_PROTOCOL  *This,
+  IN     BOOLEAN                IsRead,
+  IN     UINTN                  Length,
+  IN OUT UINT32                 *Buffer
+  )
+{
+  EFI_STATUS Status;
+  EFI_PHYSICAL_ADDRESS BusAddress;
+  VOID *Mapping;
+  UINTN MappedLength;
+  UINTN Offset;
+  UINTN Index;
+  UINTN RetryCount;
+  UINTN MaxRetryCount;
+  UINT32 MmcStatus;
+  UINT32 BlockCount;
+
+  if (Length == 0 ||
+      (Length % BLEN_512BYTES) != 0 ||
+      (Length / BLEN_512BYTES) > MAX_BLOCK_COUNT) {
+    return EFI_UNSUPPORTED;
+  }
+
+  MappedLength = Length;
+  Status = DmaMap (IsRead ? MapOperationBusMasterWrite : MapOperationBusMasterRead,
+             Buffer, &MappedLength, &BusAddress, &Mapping);
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  BusAddress += mDmaBusOffset;
+  if (MappedLength != Length ||
+      (BusAddress & (sizeof (UINT32) - 1)) != 0 ||
+      (BusAddress + Length) > BIT32) {
+    DmaUnmap (Mapping);
+    return EFI_UNSUPPORTED;
+  }
+
+  for (Offset = 0, Index = 0; Offset < Length; Offset += ADMA2_MAX_LENGTH, Index++) {
+    ASSERT (Index < ADMA2_MAX_DESCS);
+    mAdmaDescs[Index].Attributes = ADMA2_VALID | ADMA2_ACT_TRAN;
+    mAdmaDescs[Index].Length = (UINT16)MIN (Length - Offset, ADMA2_MAX_LENGTH);
+    mAdmaDescs[Index].Address = (UINT32)(BusAddress + Offset);
+  }
+  mAdmaDescs[Index - 1].Attributes |= ADMA2_END;
+
+  MemoryFence ();
+  SdMmioWrite32 (MMCHS_ADMA_SAR, (UINT32)mAdmaDescsBusAddress);
+  SdMmioAndThenOr32 (MMCHS_HCTL, (UINT32) ~DMAS_MASK, DMAS_ADMA2_32);
+
+  BlockCount = (UINT32)(Length / BLEN_512BYTES);
+  Status = MMCIssuePendingCommand (This, BlockCount);
+  if (EFI_ERROR (Status)) {
+    DmaUnmap (Mapping);
+    return Status;
+  }
+
+  mFwProtocol->NotifyActivity ();
+
+  MaxRetryCount = MAX_RETRY_COUNT + BlockCount * DMA_RETRY_COUNT_PER_BLOCK;
+  for (RetryCount = 0; RetryCount < MaxRetryCount; RetryCount++) {
+    MmcStatus = MmioRead32 (MMCHS_INT_STAT);
+    if ((MmcStatus & (TC | ERRI)) != 0) {
+      break;
+    }
+
+    gBS->Stall (STALL_AFTER_RETRY_US);
+  }
+
+  if ((MmcStatus & ERRI) != 0) {
+    DEBUG ((DEBUG_ERROR, "%a(%u): %a of %u blocks failed, MMCHS_INT_STAT: %08x ADMA_ES: %08x\n",
+      __FUNCTION__, __LINE__, IsRead ? "read" : "write", BlockCount,
+      MmcStatus, MmioRead32 (MMCHS_ADMA_ES)));
+    SoftReset (SRD);
+    Status = EFI_DEVICE_ERROR;
+  } else if ((MmcStatus & TC) == 0) {
+    DEBUG ((DEBUG_ERROR, "%a(%u): %a of %u blocks timed out, MMCHS_INT_STAT: %08x\n",
+      __FUNCTION__, __LINE__, IsRead ? "read" : "write", BlockCount, MmcStatus));
+    SoftReset (SRD);
+    Status = EFI_TIMEOUT;
+  }
+
+  SdMmioWrite32 (MMCHS_INT_STAT, TC | DMA_INT);
+  DmaUnmap (Mapping);
+
+  return Status;
+}
+
+/**
+   Sets up ADMA2, if the controller supports it.
+**/
+STATIC
+EFI_STATUS
+MMCDmaInitialize (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+  UINTN BufferSize;
+
+  if ((MmioRead32 (MMCHS_CAPA) & ADMA2S) == 0) {
+    DEBUG ((DEBUG_INFO, "ArasanMMCHost: no ADMA2 support\n"));
+    return EFI_UNSUPPORTED;
+  }
+
+  /*
+   * Pick the bus address translation by silicon revision, like the
+   * _DMA method in AcpiTables/Emmc.asl does. DmaLib must be built
+   * with no offset for this driver (see RPi4.dsc), so that it hands
+   * out CPU addresses the translation can be applied to.
+   */
+  if (FixedPcdGet64 (PcdDmaDeviceOffset) != 0) {
+    DEBUG ((DEBUG_ERROR, "ArasanMMCHost: DmaLib has a device offset, not using DMA\n"));
+    return EFI_UNSUPPORTED;
+  }
+
+  if ((MmioRead32 (ID_CHIPREV) & CHIPREV_REVISION_MASK) >= CHIPREV_REVISION_C0) {
+    mDmaBusOffset = 0;
+  } else {
+    mDmaBusOffset = EMMC2_DMA_OFFSET_PRE_C0;
+  }
+  DEBUG ((DEBUG_INFO, "ArasanMMCHost: DMA bus offset 0x%lx\n", mDmaBusOffset));
+
+  Status = DmaAllocateBuffer (EfiBootServicesData, ADMA2_DESC_PAGES,
+             (VOID**)&mAdmaDescs);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "ArasanMMCHost: DmaAllocateBuffer: %r\n", Status));
+    return Status;
+  }
+
+  BufferSize = EFI_PAGES_TO_SIZE (ADMA2_DESC_PAGES);
+  Status = DmaMap (MapOperationBusMasterCommonBuffer, mAdmaDescs, &BufferSize,
+             &mAdmaDescsBusAddress, &mAdmaDescsMapping);
+  mAdmaDescsBusAddress += mDmaBusOffset;
+  if (!EFI_ERROR (Status) &&
+      (BufferSize != EFI_PAGES_TO_SIZE (ADMA2_DESC_PAGES) ||
+       (mAdmaDescsBusAddress + BufferSize) > BIT32)) {
+    DmaUnmap (mAdmaDescsMapping);
+    Status = EFI_UNSUPPORTED;
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "ArasanMMCHost: DmaMap: %r\n", Status));
+    DmaFreeBuffer (ADMA2_DESC_PAGES, mAdmaDescs);
+    mAdmaDescs = NULL;
+    return Status;
+  }
+
+  return EFI_SUCCESS;
+}
+
 EFI_STATUS
 MMCReadBlockData (
   IN EFI_MMC_HOST_PROTOCOL    *This,
@@ -686,6 +922,7 @@ MMCReadBlockData (
   IN UINT32*                  Buffer
   )
 {
+  EFI_STATUS Status;
   UINTN MmcStatus;
   UINTN RemLength;
   UINTN Count;
@@ -703,6 +940,21 @@ MMCReadBlockData (
     return EFI_INVALID_PARAMETER;
   }
 
+  if (mCmdPending) {
+    Status = MMCTransferDma (This, TRUE, Length, Buffer);
+    if (Status != EFI_UNSUPPORTED) {
+      return Status;
+    }
+
+    Status = MMCIssuePendingCommand (This, 0);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  Status = EFI_SUCCESS;
+  mFwProtocol->NotifyActivity ();
+
   RemLength = Length;
   while (RemLength != 0) {
     UINTN RetryCount = 0;
@@ -715,12 +967,9 @@ MMCReadBlockData (
         /*
          * Data is ready.
          */
-        mFwProtocol->SetLed (TRUE);
         for (Count = 0; Count < BlockLen; Count += 4, Buffer++) {
           *Buffer = MmioRead32 (MMCHS_DATA);
         }
-
-        mFwProtocol->SetLed (FALSE);
         break;
       }
 
@@ -731,15 +980,18 @@ MMCReadBlockData (
     if (RetryCount == MAX_RETRY_COUNT) {
       DEBUG ((DEBUG_ERROR, "%a(%u): %lu/%lu MMCHS_INT_STAT: %08x\n",
         __FUNCTION__, __LINE__, Length - RemLength, Length, MmcStatus));
-      return EFI_TIMEOUT;
+      Status = EFI_TIMEOUT;
+      break;
     }
 
     RemLength -= BlockLen;
     gBS->Stall (STALL_AFTER_READ_US);
   }
 
-  SdMmioWrite32 (MMCHS_INT_STAT, BRR);
-  return EFI_SUCCESS;
+  if (!EFI_ERROR (Status)) {
+    SdMmioWrite32 (MMCHS_INT_STAT, BRR);
+  }
+  return Status;
 }
 
 EFI_STATUS
@@ -750,6 +1002,7 @@ MMCWriteBlockData (
   IN UINT32*                  Buffer
   )
 {
+  EFI_STATUS Status;
   UINTN MmcStatus;
   UINTN RemLength;
   UINTN Count;
@@ -767,6 +1020,21 @@ MMCWriteBlockData (
     return EFI_INVALID_PARAMETER;
   }
 
+  if (mCmdPending) {
+    Status = MMCTransferDma (This, FALSE, Length, Buffer);
+    if (Status != EFI_UNSUPPORTED) {
+      return Status;
+    }
+
+    Status = MMCIssuePendingCommand (This, 0);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  Status = EFI_SUCCESS;
+  mFwProtocol->NotifyActivity ();
+
   RemLength = Length;
   while (RemLength != 0) {
     UINTN RetryCount = 0;
@@ -779,12 +1047,9 @@ MMCWriteBlockData (
         /*
          * Can write data.
          */
-        mFwProtocol->SetLed (TRUE);
         for (Count = 0; Count < BlockLen; Count += 4, Buffer++) {
           SdMmioWrite32 (MMCHS_DATA, *Buffer);
         }
-
-        mFwProtocol->SetLed (FALSE);
         break;
       }
 
@@ -795,15 +1060,18 @@ MMCWriteBlockData (
     if (RetryCount == MAX_RETRY_COUNT) {
       DEBUG ((DEBUG_ERROR, "%a(%u): %lu/%lu MMCHS_INT_STAT: %08x\n",
         __FUNCTION__, __LINE__, Length - RemLength, Length, MmcStatus));
-      return EFI_TIMEOUT;
+      Status = EFI_TIMEOUT;
+      break;
     }
 
     RemLength -= BlockLen;
     gBS->Stall (STALL_AFTER_WRITE_US);
   }
 
-  SdMmioWrite32 (MMCHS_INT_STAT, BWR);
-  return EFI_SUCCESS;
+  if (!EFI_ERROR (Status)) {
+    SdMmioWrite32 (MMCHS_INT_STAT, BWR);
+  }
+  return Status;
 }
 
 BOOLEAN
@@ -814,6 +1082,14 @@ MMCIsMultiBlock (
   return TRUE;
 }
 
+UINT32
+MMCGetMaxBlockCount (
+  IN EFI_MMC_HOST_PROTOCOL *This
+  )
+{
+  return MAX_BLOCK_COUNT;
+}
+
 EFI_MMC_HOST_PROTOCOL gMMCHost =
 {
   MMC_HOST_PROTOCOL_REVISION,
@@ -826,7 +1102,8 @@ EFI_MMC_HOST_PROTOCOL gMMCHost =
   MMCReadBlockData,
   MMCWriteBlockData,
   NULL,
-  MMCIsMultiBlock
+  MMCIsMultiBlock,
+  MMCGetMaxBlockCount
 };
 
 EFI_STATUS
@@ -858,6 +1135,15 @@ MMCInitialize (
     return Status;
   }
 
+  /*
+   * Only emmc2 is known to do ADMA2 properly, the capabilities
+   * of the Arasan controller on earlier Pis aren't reliable.
+   */
+  if (PcdGet32 (PcdArasanEnableDma) && mMmcHsBase == MMCHS2_BASE) {
+    mUseDma = !EFI_ERROR (MMCDmaInitialize ());
+  }
+  DEBUG ((DEBUG_INFO, "ArasanMMCHost: using %a\n", mUseDma ? "ADMA2" : "PIO"));
+
   Status = gBS->InstallMultipleProtocolInterfaces (
                   &Handle,
                   &gRaspberryPiMmcHostProtocolGuid,
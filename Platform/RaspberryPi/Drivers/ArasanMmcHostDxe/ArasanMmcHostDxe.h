@@ -27,6 +27,7 @@
 #include <Protocol/RpiMmcHost.h>
 #include <Protocol/RpiFirmware.h>
 
+#include <IndustryStandard/Bcm2711.h>
 #include <IndustryStandard/Bcm2836.h>
 #include <IndustryStandard/Bcm2836Sdio.h>
 #include <IndustryStandard/RpiMbox.h>
@@ -42,4 +43,35 @@
 
 #define MAX_DIVISOR_VALUE 1023
 
+// Block count field of MMCHS_BLK
+#define MAX_BLOCK_COUNT 0xFFFF
+
+// Data transfer timeout for DMA, on top of MAX_RETRY_COUNT
+#define DMA_RETRY_COUNT_PER_BLOCK 50
+
+//
+// ADMA2 (32-bit) descriptor. The table for a whole transfer
+// (MAX_BLOCK_COUNT blocks) fits in ADMA2_DESC_PAGES.
+//
+typedef struct {
+  UINT16 Attributes;
+  UINT16 Length;
+  UINT32 Address;
+} ADMA2_DESCRIPTOR;
+
+#define ADMA2_VALID       BIT0
+#define ADMA2_END         BIT1
+#define ADMA2_ACT_TRAN    (0x2 << 4)
+#define ADMA2_MAX_LENGTH  SIZE_32KB
+#define ADMA2_DESC_PAGES  2
+#define ADMA2_MAX_DESCS   (EFI_PAGES_TO_SIZE (ADMA2_DESC_PAGES) / sizeof (ADMA2_DESCRIPTOR))
+
+//
+// emmc2 sees the low 1GB of RAM at 0xC0000000 on BCM2711 revisions older
+// than C0 (ID_CHIPREV[7:0] < 0x20), and untranslated on C0 and newer.
+//
+#define CHIPREV_REVISION_MASK     0xFF
+#define CHIPREV_REVISION_C0       0x20
+#define EMMC2_DMA_OFFSET_PRE_C0   0xC0000000
+
 #endif
@@ -450,6 +450,13 @@ ApplyVariables (
   UINT32 CustomCpuClock = PcdGet32 (PcdCustomCpuClock);
   UINT32 Rate = 0;
   UINT32 FanOnGpio = PcdGet32 (PcdFanOnGpio);
+  RPI_FW_BATCH *Batch;
+  UINT32 SetRate[3];
+  UINT32 GetRate[2];
+  UINT32 Emmc2ClockState[2];
+  UINT32 EmmcClockState[2];
+  EFI_STATUS SetRateStatus;
+  EFI_STATUS GetRateStatus;
 
   switch (CpuClock) {
   case CHIPSET_CPU_CLOCK_LOW:
@@ -473,22 +480,43 @@ ApplyVariables (
     break;
   }
 
+  //
+  // Set the CPU speed and read it back in one mailbox transaction.
+  // The tag values are { ClockId, ClockRate[, SkipTurbo] }.
+  //
+  Status = mFwProtocol->CreateBatch (&Batch);
+  SetRateStatus = Status;
+  GetRateStatus = Status;
+  if (!EFI_ERROR (Status)) {
+    if (Rate != 0) {
+      DEBUG ((DEBUG_INFO, "Setting CPU speed to %u MHz\n", Rate / FREQ_1_MHZ));
+      SetRate[0] = RPI_MBOX_CLOCK_RATE_ARM;
+      SetRate[1] = Rate;
+      SetRate[2] = 1;
+      mFwProtocol->BatchAddTag (Batch, RPI_MBOX_SET_CLOCK_RATE,
+                     SetRate, sizeof (SetRate), &SetRateStatus);
+    }
+    GetRate[0] = RPI_MBOX_CLOCK_RATE_ARM;
+    GetRate[1] = 0;
+    mFwProtocol->BatchAddTag (Batch, RPI_MBOX_GET_CLOCK_RATE,
+                   GetRate, sizeof (GetRate), &GetRateStatus);
+    mFwProtocol->SubmitBatch (Batch);
+    mFwProtocol->FreeBatch (Batch);
+  }
+
   if (Rate != 0) {
-    DEBUG ((DEBUG_INFO, "Setting CPU speed to %u MHz\n", Rate / FREQ_1_MHZ));
-    Status = mFwProtocol->SetClockRate (RPI_MBOX_CLOCK_RATE_ARM, Rate, 1);
-    if (Status != EFI_SUCCESS) {
-      DEBUG ((DEBUG_ERROR, "Couldn't set the CPU speed: %r\n", Status));
+    if (SetRateStatus != EFI_SUCCESS) {
+      DEBUG ((DEBUG_ERROR, "Couldn't set the CPU speed: %r\n", SetRateStatus));
     } else {
       Status = PcdSet32S (PcdCustomCpuClock, Rate / FREQ_1_MHZ);
       ASSERT_EFI_ERROR (Status);
     }
   }
 
-  Status = mFwProtocol->GetClockRate (RPI_MBOX_CLOCK_RATE_ARM, &Rate);
-  if (Status != EFI_SUCCESS) {
-    DEBUG ((DEBUG_ERROR, "Couldn't get the CPU speed: %r\n", Status));
+  if (GetRateStatus != EFI_SUCCESS) {
+    DEBUG ((DEBUG_ERROR, "Couldn't get the CPU speed: %r\n", GetRateStatus));
   } else {
-    DEBUG ((DEBUG_INFO, "Current CPU speed is %u MHz\n", Rate / FREQ_1_MHZ));
+    DEBUG ((DEBUG_INFO, "Current CPU speed is %u MHz\n", GetRate[1] / FREQ_1_MHZ));
   }
 
   if (mModelFamily >= 4 && PcdGet32 (PcdRamMoreThan3GB) != 0 &&
@@ -619,8 +647,23 @@ ApplyVariables (
                                            TRUE, TRUE); //SD on with wait
       Status = mFwProtocol->SetGpioConfig (RPI_EXP_GPIO_SD_VOLT,
                                            RPI_EXP_GPIO_DIR_OUT, TRUE); //3.3v
-      Status = mFwProtocol->SetClockState (RPI_MBOX_CLOCK_RATE_EMMC2, TRUE);
-      Status = mFwProtocol->SetClockState (RPI_MBOX_CLOCK_RATE_EMMC, TRUE);
+      //
+      // Enable both SD clocks in one mailbox transaction.
+      // The tag values are { ClockId, ClockState }.
+      //
+      Status = mFwProtocol->CreateBatch (&Batch);
+      if (!EFI_ERROR (Status)) {
+        Emmc2ClockState[0] = RPI_MBOX_CLOCK_RATE_EMMC2;
+        Emmc2ClockState[1] = TRUE;
+        EmmcClockState[0] = RPI_MBOX_CLOCK_RATE_EMMC;
+        EmmcClockState[1] = TRUE;
+        mFwProtocol->BatchAddTag (Batch, RPI_MBOX_SET_CLOCK_STATE,
+                       Emmc2ClockState, sizeof (Emmc2ClockState), NULL);
+        mFwProtocol->BatchAddTag (Batch, RPI_MBOX_SET_CLOCK_STATE,
+                       EmmcClockState, sizeof (EmmcClockState), NULL);
+        Status = mFwProtocol->SubmitBatch (Batch);
+        mFwProtocol->FreeBatch (Batch);
+      }
     }
   } else {
     DEBUG ((DEBUG_ERROR, "Model Family %d not supported...\n", mModelFamily));
@@ -24,6 +24,10 @@
                                 (posY) * This->Mode->Info->PixelsPerScanLine * \
                                 PI3_BYTES_PER_PIXEL +                   \
                                 (posX) * PI3_BYTES_PER_PIXEL))
+#define POS_TO_SHADOW(posX, posY) (mShadowFb +                          \
+                               (posY) * This->Mode->Info->PixelsPerScanLine * \
+                               PI3_BYTES_PER_PIXEL +                    \
+                               (posX) * PI3_BYTES_PER_PIXEL)
 
 STATIC
 EFI_STATUS
@@ -112,6 +116,14 @@ STATIC EFI_HANDLE mDevice;
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL *mFwProtocol;
 STATIC EFI_CPU_ARCH_PROTOCOL *mCpu;
 
+/*
+ * Cached copy of the frame buffer, used by Blt when PcdDisplayEnableShadowFb
+ * is set, so that reads (and scrolls) don't have to go to the WT mapped
+ * frame buffer.
+ */
+STATIC UINT8 *mShadowFb;
+STATIC UINTN mShadowFbPages;
+
 STATIC UINTN mLastMode;
 STATIC GOP_MODE_DATA mGopModeTemplate[] = {
   { 800,  600  }, /* Legacy */
@@ -282,10 +294,51 @@ DisplaySetMode (
   This->Mode->FrameBufferSize = Mode->Width * Mode->Height * PI3_BYTES_PER_PIXEL;
   DEBUG((DEBUG_INFO, "Reported Mode->FrameBufferSize is %u\n", This->Mode->FrameBufferSize));
 
+  if (mShadowFb != NULL) {
+    FreePages (mShadowFb, mShadowFbPages);
+    mShadowFb = NULL;
+  }
+
+  if (PcdGet32 (PcdDisplayEnableShadowFb)) {
+    mShadowFbPages = EFI_SIZE_TO_PAGES (This->Mode->FrameBufferSize);
+    mShadowFb = AllocatePages (mShadowFbPages);
+    if (mShadowFb == NULL) {
+      DEBUG ((DEBUG_WARN, "Couldn't allocate shadow frame buffer, not using it\n"));
+    }
+  }
+
   ClearScreen (This);
   return EFI_SUCCESS;
 }
 
+/*
+ * Copy a rectangle of the shadow frame buffer to the frame buffer. Rows
+ * spanning the whole scan line are contiguous, so they are copied in one go.
+ */
+STATIC
+VOID
+FlushShadowFb (
+  IN  EFI_GRAPHICS_OUTPUT_PROTOCOL      *This,
+  IN  UINTN                             X,
+  IN  UINTN                             Y,
+  IN  UINTN                             Width,
+  IN  UINTN                             Height
+  )
+{
+  UINTN i;
+
+  if (X == 0 && Width == This->Mode->Info->PixelsPerScanLine) {
+    CopyMem (POS_TO_FB (0, Y), POS_TO_SHADOW (0, Y),
+      Height * Width * PI3_BYTES_PER_PIXEL);
+    return;
+  }
+
+  for (i = 0; i < Height; i++) {
+    CopyMem (POS_TO_FB (X, Y + i), POS_TO_SHADOW (X, Y + i),
+      Width * PI3_BYTES_PER_PIXEL);
+  }
+}
+
 STATIC
 EFI_STATUS
 EFIAPI
@@ -304,6 +357,7 @@ DisplayBlt (
 {
   UINT8 *VidBuf, *BltBuf, *VidBuf1;
   UINTN i;
+  UINTN Row;
 
   if ((UINTN)BltOperation >= EfiGraphicsOutputBltOperationMax) {
     return EFI_INVALID_PARAMETER;
@@ -313,12 +367,20 @@ DisplayBlt (
     return EFI_INVALID_PARAMETER;
   }
 
+  /*
+   * With a shadow frame buffer, all accesses go to the cached shadow, and
+   * the rectangle written to is then flushed out to the frame buffer.
+   */
   switch (BltOperation) {
   case EfiBltVideoFill:
     BltBuf = (UINT8*)BltBuffer;
 
     for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB (DestinationX, DestinationY + i);
+      if (mShadowFb != NULL) {
+        VidBuf = POS_TO_SHADOW (DestinationX, DestinationY + i);
+      } else {
+        VidBuf = POS_TO_FB (DestinationX, DestinationY + i);
+      }
 
       SetMem32 (VidBuf, Width * PI3_BYTES_PER_PIXEL, *(UINT32*)BltBuf);
     }
@@ -330,7 +392,11 @@ DisplayBlt (
     }
 
     for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB (SourceX, SourceY + i);
+      if (mShadowFb != NULL) {
+        VidBuf = POS_TO_SHADOW (SourceX, SourceY + i);
+      } else {
+        VidBuf = POS_TO_FB (SourceX, SourceY + i);
+      }
 
       BltBuf = (UINT8*)((UINTN)BltBuffer + (DestinationY + i) * Delta +
         DestinationX * PI3_BYTES_PER_PIXEL);
@@ -345,7 +411,11 @@ DisplayBlt (
     }
 
     for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB (DestinationX, DestinationY + i);
+      if (mShadowFb != NULL) {
+        VidBuf = POS_TO_SHADOW (DestinationX, DestinationY + i);
+      } else {
+        VidBuf = POS_TO_FB (DestinationX, DestinationY + i);
+      }
       BltBuf = (UINT8*)((UINTN)BltBuffer + (SourceY + i) * Delta +
         SourceX * PI3_BYTES_PER_PIXEL);
 
@@ -355,8 +425,19 @@ DisplayBlt (
 
   case EfiBltVideoToVideo:
     for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB (SourceX, SourceY + i);
-      VidBuf1 = POS_TO_FB (DestinationX, DestinationY + i);
+      /*
+       * Go bottom-up when moving down, so that overlapping rows are read
+       * before they are overwritten.
+       */
+      Row = (DestinationY > SourceY) ? Height - 1 - i : i;
+
+      if (mShadowFb != NULL) {
+        VidBuf = POS_TO_SHADOW (SourceX, SourceY + Row);
+        VidBuf1 = POS_TO_SHADOW (DestinationX, DestinationY + Row);
+      } else {
+        VidBuf = POS_TO_FB (SourceX, SourceY + Row);
+        VidBuf1 = POS_TO_FB (DestinationX, DestinationY + Row);
+      }
 
       gBS->CopyMem ((VOID*)VidBuf1, (VOID*)VidBuf, Width * PI3_BYTES_PER_PIXEL);
     }
@@ -367,6 +448,10 @@ DisplayBlt (
     break;
   }
 
+  if (mShadowFb != NULL && BltOperation != EfiBltVideoToBltBuffer) {
+    FlushShadowFb (This, DestinationX, DestinationY, Width, Height);
+  }
+
   return EFI_SUCCESS;
 }
 
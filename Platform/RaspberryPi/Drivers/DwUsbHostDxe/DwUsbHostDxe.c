@@ -23,6 +23,26 @@
    */
 #define TimerForTransfer TimerRelative
 
+/*
+ * Periodic start-splits are kept out of the last microframes of a
+ * frame, and get up to three complete-splits before being retried.
+ */
+#define SPLIT_PERIODIC_CSPLITS 3
+#define SPLIT_LAST_PERIODIC_SSPLIT_UFRAME 5
+
+/*
+ * Non-periodic complete-splits the TT keeps answering NYET to are
+ * given up on after 100ms worth of microframes.
+ */
+#define SPLIT_NONPERIODIC_CSPLITS (8 * 100)
+
+/*
+ * HFNUM counts 125us microframes. Waits for a given microframe sleep
+ * through the ones before it, then poll a few times per microframe.
+ */
+#define UFRAME_US 125
+#define UFRAME_POLL_US (UFRAME_US / 8)
+
 /*
  * https://www.quicklogic.com/assets/pdf/data-sheets/QL-Hi-Speed-USB-2.0-OTG-Controller-Data-Sheet.pdf
  */
@@ -40,7 +60,12 @@ typedef enum {
 typedef struct {
   BOOLEAN Splitting;
   BOOLEAN SplitStart;
+  BOOLEAN Periodic;
   UINT32 Tries;
+  /*
+   * Microframe in which the next complete-split may be issued.
+   */
+  UINT32 NextFrame;
 } SPLIT_CONTROL;
 
 EFI_STATUS
@@ -79,6 +104,47 @@ Wait4Bit (
   return EFI_TIMEOUT;
 }
 
+STATIC
+UINT32
+DwHcFrameNumber (
+  IN  DWUSB_OTGHC_DEV *DwHc
+  )
+{
+  return MmioRead32 (DwHc->DwUsbBase + HFNUM) & DWC2_HFNUM_FRNUM_MASK;
+}
+
+/*
+ * Waits for the given (micro)frame to start, accounting for
+ * the frame number wrapping around.
+ */
+STATIC
+EFI_STATUS
+DwHcWaitFrame (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  EFI_EVENT       Timeout,
+  IN  UINT32          Frame
+  )
+{
+  UINT32 Remaining;
+
+  for (;;) {
+    Remaining = (Frame - DwHcFrameNumber (DwHc)) & DWC2_HFNUM_FRNUM_MASK;
+    if (Remaining == 0 || Remaining > (DWC2_HFNUM_FRNUM_MASK >> 1)) {
+      return EFI_SUCCESS;
+    }
+
+    if (!EFI_ERROR (gBS->CheckEvent (Timeout))) {
+      return EFI_TIMEOUT;
+    }
+
+    /*
+     * The current microframe may be about to end, so only sleep
+     * through the whole ones in between.
+     */
+    MicroSecondDelay ((Remaining - 1) * UFRAME_US + UFRAME_POLL_US);
+  }
+}
+
 CHANNEL_HALT_REASON
 Wait4Chhltd (
   IN  DWUSB_OTGHC_DEV *DwHc,
@@ -119,6 +185,11 @@ Wait4Chhltd (
   }
 
   if ((Hcint & DWC2_HCINT_NYET) != 0) {
+    /*
+     * The TT hasn't finished the transaction yet: poll
+     * it again next microframe.
+     */
+    Split->NextFrame = (DwHcFrameNumber (DwHc) + 1) & DWC2_HFNUM_FRNUM_MASK;
     return XFER_CSPLIT;
   }
 
@@ -139,6 +210,12 @@ Wait4Chhltd (
       ((Hcint & DWC2_HCINT_ACK) != 0)) {
     Split->SplitStart = FALSE;
     Split->Tries = 0;
+    /*
+     * Periodic transactions can't complete on the full/low speed
+     * bus before the microframe after next.
+     */
+    Split->NextFrame = (DwHcFrameNumber (DwHc) + (Split->Periodic ? 2 : 1)) &
+                       DWC2_HFNUM_FRNUM_MASK;
     return XFER_CSPLIT;
   }
 
@@ -223,6 +300,103 @@ DwCoreReset (
   return EFI_SUCCESS;
 }
 
+/*
+ * Claims a free host channel. Only the channel ownership is
+ * protected by raising the TPL: the transfer itself runs at the
+ * caller's TPL, so a periodic transfer from DwHcPeriodicHandler
+ * can use another channel while a control or bulk transfer is
+ * still in flight.
+ */
+STATIC
+EFI_STATUS
+DwHcAllocateChannel (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  OUT UINT32          *Channel
+  )
+{
+  UINT32  Index;
+  EFI_TPL Tpl;
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Index = 0; Index < DwHc->NumChannels; Index++) {
+    if (!DwHc->Channels[Index].InUse) {
+      DwHc->Channels[Index].InUse = TRUE;
+      *Channel = Index;
+      break;
+    }
+  }
+  gBS->RestoreTPL (Tpl);
+
+  if (Index == DwHc->NumChannels) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+DwHcFreeChannel (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT32          Channel
+  )
+{
+  EFI_TPL Tpl;
+
+  ASSERT (DwHc->Channels[Channel].InUse);
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  DwHc->Channels[Channel].InUse = FALSE;
+  gBS->RestoreTPL (Tpl);
+}
+
+/*
+ * Maps a bulk transfer chunk for the channel to DMA to or
+ * from directly, saving the copy through the bounce buffer.
+ *
+ * The controller needs DWORD-aligned buffers. For IN
+ * transfers the buffer must also be cache line aligned and
+ * sized, or DmaMap would bounce it anyway (and the cache
+ * maintenance would clobber the neighbouring data).
+ */
+STATIC
+EFI_STATUS
+DwHcMapTransfer (
+  IN  VOID    *Buffer,
+  IN  UINTN   Length,
+  IN  BOOLEAN IsIn,
+  OUT UINTN   *BusAddress,
+  OUT VOID    **Mapping
+  )
+{
+  EFI_STATUS           Status;
+  EFI_PHYSICAL_ADDRESS DeviceAddress;
+  UINTN                MappedLength;
+  UINTN                Alignment;
+
+  Alignment = IsIn ? ArmCacheWritebackGranule () : sizeof (UINT32);
+  if (((UINTN)Buffer & (Alignment - 1)) != 0 ||
+      (IsIn && (Length & (Alignment - 1)) != 0)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  MappedLength = Length;
+  Status = DmaMap (IsIn ? MapOperationBusMasterWrite : MapOperationBusMasterRead,
+             Buffer, &MappedLength, &DeviceAddress, Mapping);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (MappedLength != Length ||
+      (DeviceAddress + Length) > (MAX_UINT32 + 1ULL)) {
+    DmaUnmap (*Mapping);
+    return EFI_UNSUPPORTED;
+  }
+
+  *BusAddress = (UINTN)DeviceAddress;
+  return EFI_SUCCESS;
+}
+
 STATIC
 EFI_STATUS
 DwHcTransfer (
@@ -251,32 +425,50 @@ DwHcTransfer (
   UINT32                          StopTransfer = 0;
   EFI_STATUS                      Status = EFI_SUCCESS;
   SPLIT_CONTROL                   Split = { 0 };
+  DWUSB_CHANNEL                   *Chan = &DwHc->Channels[Channel];
+  UINT32                          MaxTxferLen;
+  UINT32                          Hcchar;
+  UINT32                          Frame;
+  UINTN                           BusAddress;
+  VOID                            *Mapping = NULL;
 
-  EFI_TPL Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  ASSERT (Chan->InUse);
 
   *TransferResult = EFI_USB_NOERROR;
 
+  /*
+   * Largest whole number of packets HCTSIZ can describe.
+   */
+  MaxTxferLen = DWC2_MAX_TRANSFER_SIZE -
+    (DWC2_MAX_TRANSFER_SIZE % MaximumPacketLength);
+
   do {
   RestartXfer:
+    if (Mapping != NULL) {
+      DmaUnmap (Mapping);
+      Mapping = NULL;
+    }
+
     if (DeviceSpeed == EFI_USB_SPEED_LOW ||
         DeviceSpeed == EFI_USB_SPEED_FULL) {
       Split.Splitting = TRUE;
       Split.SplitStart = TRUE;
+      Split.Periodic = (EpType == DWC2_HCCHAR_EPTYPE_INTR);
       Split.Tries = 0;
     }
 
     TxferLen = *DataLength - Done;
 
-    if (TxferLen > DWC2_MAX_TRANSFER_SIZE) {
-      TxferLen = DWC2_MAX_TRANSFER_SIZE - MaximumPacketLength + 1;
-    }
-
-    if (TxferLen > DWC2_DATA_BUF_SIZE) {
-      TxferLen = DWC2_DATA_BUF_SIZE - MaximumPacketLength + 1;
+    if (TxferLen > MaxTxferLen) {
+      TxferLen = MaxTxferLen;
     }
 
     if (Split.Splitting || TxferLen == 0) {
+      /*
+       * A split transaction carries a single packet.
+       */
       NumPackets = 1;
+      TxferLen = MIN (TxferLen, MaximumPacketLength);
     } else {
       NumPackets = (TxferLen + MaximumPacketLength - 1) / MaximumPacketLength;
       if (NumPackets > DWC2_MAX_PACKET_COUNT) {
@@ -287,14 +479,52 @@ DwHcTransfer (
 
     if (TransferDirection) { // in
       TxferLen = NumPackets * MaximumPacketLength;
-    } else {
-      CopyMem (DwHc->AlignedBuffer, Data + Done, TxferLen);
-      ArmDataSynchronizationBarrier ();
     }
 
+    /*
+     * An IN chunk can only land in the caller's buffer if the
+     * whole packets the device may send fit in there. Single
+     * packet splits are cheaper to bounce than to map.
+     */
+    if (EpType != DWC2_HCCHAR_EPTYPE_BULK ||
+        Split.Splitting ||
+        TxferLen > *DataLength - Done ||
+        EFI_ERROR (DwHcMapTransfer (Data + Done, TxferLen,
+                     TransferDirection != 0, &BusAddress, &Mapping))) {
+      ASSERT (TxferLen <= DWC2_DATA_BUF_SIZE);
+      Mapping = NULL;
+      BusAddress = Chan->BufferBusAddress;
+      if (!TransferDirection) { // out
+        CopyMem (Chan->Buffer, Data + Done, TxferLen);
+      }
+    }
+    ArmDataSynchronizationBarrier ();
+
   RestartChannel:
-    MmioWrite32 (DwHc->DwUsbBase + HCDMA (Channel),
-      (UINTN)DwHc->AlignedBufferBusAddress);
+    if (Split.Splitting) {
+      Status = EFI_SUCCESS;
+      if (Split.SplitStart) {
+        /*
+         * Keep periodic start-splits early enough in the frame
+         * for their complete-splits to fit behind them.
+         */
+        Frame = DwHcFrameNumber (DwHc);
+        if (Split.Periodic &&
+            (Frame & 7) > SPLIT_LAST_PERIODIC_SSPLIT_UFRAME) {
+          Status = DwHcWaitFrame (DwHc, Timeout,
+                     ((Frame | 7) + 1) & DWC2_HFNUM_FRNUM_MASK);
+        }
+      } else {
+        Status = DwHcWaitFrame (DwHc, Timeout, Split.NextFrame);
+      }
+
+      if (EFI_ERROR (Status)) {
+        *TransferResult = EFI_USB_ERR_TIMEOUT;
+        break;
+      }
+    }
+
+    MmioWrite32 (DwHc->DwUsbBase + HCDMA (Channel), BusAddress);
 
     DwOtgHcInit (DwHc, Channel, Translator, DeviceSpeed,
       DeviceAddress, EpAddress,
@@ -306,12 +536,22 @@ DwHcTransfer (
       (NumPackets << DWC2_HCTSIZ_PKTCNT_OFFSET) |
       (*Pid << DWC2_HCTSIZ_PID_OFFSET));
 
+    Hcchar = (1 << DWC2_HCCHAR_MULTICNT_OFFSET) | DWC2_HCCHAR_CHEN;
+    if (EpType == DWC2_HCCHAR_EPTYPE_INTR &&
+        (DwHcFrameNumber (DwHc) & 1) == 0) {
+      /*
+       * Periodic channels only go out in (micro)frames of
+       * the selected parity: aim for the next one.
+       */
+      Hcchar |= DWC2_HCCHAR_ODDFRM;
+    }
+
     MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR (Channel),
       ~(DWC2_HCCHAR_MULTICNT_MASK |
+        DWC2_HCCHAR_ODDFRM |
         DWC2_HCCHAR_CHEN |
         DWC2_HCCHAR_CHDIS),
-        ((1 << DWC2_HCCHAR_MULTICNT_OFFSET) |
-          DWC2_HCCHAR_CHEN));
+      Hcchar);
 
     Ret = Wait4Chhltd (DwHc, Timeout, Channel, &Sub, Pid, IgnoreAck, &Split);
 
@@ -340,11 +580,29 @@ DwHcTransfer (
     } else if (Ret == XFER_CSPLIT) {
       ASSERT (Split.Splitting);
 
-      if (Split.Tries++ < 3) {
+      /*
+       * Non-periodic complete-splits are retried, once per
+       * microframe, up to SPLIT_NONPERIODIC_CSPLITS times. A
+       * periodic transaction the TT hasn't finished within its
+       * budget is lost, so it is started over.
+       */
+      if (Split.Periodic) {
+        if (Split.Tries++ < SPLIT_PERIODIC_CSPLITS) {
+          goto RestartChannel;
+        }
+
+        goto RestartXfer;
+      }
+
+      if (Split.Tries++ < SPLIT_NONPERIODIC_CSPLITS) {
         goto RestartChannel;
       }
 
-      goto RestartXfer;
+      DEBUG ((DEBUG_ERROR, "Channel %u: TT still busy after %u complete-splits\n",
+        Channel, Split.Tries));
+      *TransferResult = EFI_USB_ERR_TIMEOUT;
+      Status = EFI_TIMEOUT;
+      break;
     } else if (Ret == XFER_ERROR) {
       *TransferResult =
         EFI_USB_ERR_CRC |
@@ -369,7 +627,9 @@ DwHcTransfer (
     if (TransferDirection) { // in
       ArmDataSynchronizationBarrier ();
       TxferLen -= Sub;
-      CopyMem (Data + Done, DwHc->AlignedBuffer, TxferLen);
+      if (Mapping == NULL) {
+        CopyMem (Data + Done, Chan->Buffer, TxferLen);
+      }
       if (Sub) {
         StopTransfer = 1;
       }
@@ -378,13 +638,15 @@ DwHcTransfer (
     Done += TxferLen;
   } while (Done < *DataLength && !StopTransfer);
 
+  if (Mapping != NULL) {
+    DmaUnmap (Mapping);
+  }
+
   MmioWrite32 (DwHc->DwUsbBase + HCINTMSK (Channel), 0);
   MmioWrite32 (DwHc->DwUsbBase + HCINT (Channel), 0xFFFFFFFF);
 
   *DataLength = Done;
 
-  gBS->RestoreTPL (Tpl);
-
   ASSERT (!EFI_ERROR (Status) || *TransferResult != EFI_USB_NOERROR);
 
   return Status;
@@ -421,6 +683,15 @@ DwHcDeferredTransfer (
 {
   EFI_STATUS Status;
   EFI_EVENT TimeoutEvt = NULL;
+  UINT32 Channel;
+
+  /*
+   * All channels busy: try again on the next polling interval.
+   */
+  Status = DwHcAllocateChannel (Req->DwHc, &Channel);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
 
   Status = gBS->CreateEvent (EVT_TIMER, 0, NULL, NULL, &TimeoutEvt);
   ASSERT_EFI_ERROR (Status);
@@ -437,13 +708,20 @@ DwHcDeferredTransfer (
 
   Req->TransferResult = EFI_USB_NOERROR;
   Status = DwHcTransfer (Req->DwHc, TimeoutEvt,
-             Req->Channel, Req->Translator,
+             Channel, Req->Translator,
              Req->DeviceSpeed, Req->DeviceAddress,
              Req->MaximumPacketLength, &Req->Pid,
              Req->TransferDirection, Req->Data, &Req->DataLength,
              Req->EpAddress, Req->EpType, &Req->TransferResult,
              Req->IgnoreAck);
 
+  /*
+   * Release the channel before invoking the callback, which may
+   * itself issue transfers.
+   */
+  DwHcFreeChannel (Req->DwHc, Channel);
+  Channel = MAX_UINT32;
+
   if (Req->EpType == DWC2_HCCHAR_EPTYPE_INTR &&
       Status == EFI_DEVICE_ERROR &&
       Req->TransferResult == EFI_USB_ERR_NAK) {
@@ -457,6 +735,10 @@ DwHcDeferredTransfer (
          Req->CallbackContext,
          Req->TransferResult);
 Exit:
+  if (Channel != MAX_UINT32) {
+    DwHcFreeChannel (Req->DwHc, Channel);
+  }
+
   if (TimeoutEvt != NULL) {
     gBS->CloseEvent (TimeoutEvt);
   }
@@ -834,6 +1116,7 @@ DwHcControlTransfer (
   UINTN                   Length;
   EFI_USB_DATA_DIRECTION  StatusDirection;
   UINT32                  Direction;
+  UINT32                  Channel = MAX_UINT32;
   EFI_EVENT TimeoutEvt = NULL;
 
   if ((Request == NULL) || (TransferResult == NULL)) {
@@ -880,10 +1163,16 @@ DwHcControlTransfer (
     goto Exit;
   }
 
+  Status = DwHcAllocateChannel (DwHc, &Channel);
+  if (EFI_ERROR (Status)) {
+    *TransferResult = EFI_USB_ERR_SYSTEM;
+    goto Exit;
+  }
+
   Pid = DWC2_HC_PID_SETUP;
   Length = 8;
   Status = DwHcTransfer (DwHc, TimeoutEvt,
-             DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+             Channel, Translator, DeviceSpeed,
              DeviceAddress, MaximumPacketLength, &Pid, 0,
              Request, &Length, 0, DWC2_HCCHAR_EPTYPE_CONTROL,
              TransferResult, 1);
@@ -904,7 +1193,7 @@ DwHcControlTransfer (
     }
 
     Status = DwHcTransfer (DwHc, TimeoutEvt,
-               DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+               Channel, Translator, DeviceSpeed,
                DeviceAddress, MaximumPacketLength, &Pid,
                Direction, Data, DataLength, 0,
                DWC2_HCCHAR_EPTYPE_CONTROL,
@@ -927,7 +1216,7 @@ DwHcControlTransfer (
   Pid = DWC2_HC_PID_DATA1;
   Length = 0;
   Status = DwHcTransfer (DwHc, TimeoutEvt,
-             DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+             Channel, Translator, DeviceSpeed,
              DeviceAddress, MaximumPacketLength, &Pid,
              StatusDirection, DwHc->StatusBuffer, &Length, 0,
              DWC2_HCCHAR_EPTYPE_CONTROL, TransferResult, 1);
@@ -939,6 +1228,10 @@ DwHcControlTransfer (
   }
 
 Exit:
+  if (Channel != MAX_UINT32) {
+    DwHcFreeChannel (DwHc, Channel);
+  }
+
   if (TimeoutEvt != NULL) {
     gBS->CloseEvent (TimeoutEvt);
   }
@@ -975,6 +1268,7 @@ DwHcBulkTransfer (
   UINT8                   TransferDirection;
   UINT8                   EpAddress;
   UINT32                  Pid;
+  UINT32                  Channel = MAX_UINT32;
   EFI_EVENT TimeoutEvt = NULL;
 
   if ((Data == NULL) || (Data[0] == NULL) ||
@@ -1011,13 +1305,18 @@ DwHcBulkTransfer (
     goto Exit;
   }
 
-  Status = EFI_DEVICE_ERROR;
+  Status = DwHcAllocateChannel (DwHc, &Channel);
+  if (EFI_ERROR (Status)) {
+    *TransferResult = EFI_USB_ERR_SYSTEM;
+    goto Exit;
+  }
+
   TransferDirection = (EndPointAddress >> 7) & 0x01;
   EpAddress = EndPointAddress & 0x0F;
   Pid = (*DataToggle << 1);
 
   Status = DwHcTransfer (DwHc, TimeoutEvt,
-             DWC2_HC_CHANNEL_BULK, Translator, DeviceSpeed,
+             Channel, Translator, DeviceSpeed,
              DeviceAddress, MaximumPacketLength, &Pid,
              TransferDirection, Data[0], DataLength, EpAddress,
              DWC2_HCCHAR_EPTYPE_BULK, TransferResult, 1);
@@ -1025,6 +1324,10 @@ DwHcBulkTransfer (
   *DataToggle = (Pid >> 1);
 
 Exit:
+  if (Channel != MAX_UINT32) {
+    DwHcFreeChannel (DwHc, Channel);
+  }
+
   if (TimeoutEvt != NULL) {
     gBS->CloseEvent (TimeoutEvt);
   }
@@ -1130,7 +1433,6 @@ DwHcAsyncInterruptTransfer (
     NewReq->FrameInterval;
 
   NewReq->DwHc = DwHc;
-  NewReq->Channel = DWC2_HC_CHANNEL_ASYNC;
   NewReq->Translator = Translator;
   NewReq->DeviceSpeed = DeviceSpeed;
   NewReq->DeviceAddress = DeviceAddress;
@@ -1187,6 +1489,7 @@ DwHcSyncInterruptTransfer (
   UINT8 TransferDirection;
   UINT8 EpAddress;
   UINT32 Pid;
+  UINT32 Channel = MAX_UINT32;
 
   DwHc = DWHC_FROM_THIS (This);
 
@@ -1222,11 +1525,17 @@ DwHcSyncInterruptTransfer (
     goto Exit;
   }
 
+  Status = DwHcAllocateChannel (DwHc, &Channel);
+  if (EFI_ERROR (Status)) {
+    *TransferResult = EFI_USB_ERR_SYSTEM;
+    goto Exit;
+  }
+
   TransferDirection = (EndPointAddress >> 7) & 0x01;
   EpAddress = EndPointAddress & 0x0F;
   Pid = (*DataToggle << 1);
   Status = DwHcTransfer (DwHc, TimeoutEvt,
-             DWC2_HC_CHANNEL_SYNC, Translator,
+             Channel, Translator,
              DeviceSpeed, DeviceAddress,
              MaximumPacketLength,
              &Pid, TransferDirection, Data,
@@ -1236,6 +1545,10 @@ DwHcSyncInterruptTransfer (
   *DataToggle = (Pid >> 1);
 
 Exit:
+  if (Channel != MAX_UINT32) {
+    DwHcFreeChannel (DwHc, Channel);
+  }
+
   if (TimeoutEvt != NULL) {
     gBS->CloseEvent (TimeoutEvt);
   }
@@ -1344,7 +1657,7 @@ DwHcInit (
   UINT32 NpTxFifoSz = 0;
   UINT32 pTxFifoSz = 0;
   UINT32 Hprt0 = 0;
-  INT32  i, Status, NumChannels;
+  INT32  i, Status;
 
   MmioWrite32 (DwHc->DwUsbBase + PCGCCTL, 0);
 
@@ -1366,18 +1679,12 @@ DwHcInit (
   DwFlushTxFifo (DwHc, Timeout, 0x10);
   DwFlushRxFifo (DwHc, Timeout);
 
-  NumChannels = MmioRead32 (DwHc->DwUsbBase + GHWCFG2);
-  NumChannels &= DWC2_HWCFG2_NUM_HOST_CHAN_MASK;
-  NumChannels >>= DWC2_HWCFG2_NUM_HOST_CHAN_OFFSET;
-  NumChannels += 1;
-  DEBUG ((DEBUG_INFO, "Host has %u channels\n", NumChannels));
-
-  for (i = 0; i < NumChannels; i++)
+  for (i = 0; i < DwHc->NumChannels; i++)
     MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR (i),
       ~(DWC2_HCCHAR_CHEN | DWC2_HCCHAR_EPDIR),
       DWC2_HCCHAR_CHDIS);
 
-  for (i = 0; i < NumChannels; i++) {
+  for (i = 0; i < DwHc->NumChannels; i++) {
     MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR (i),
       ~DWC2_HCCHAR_EPDIR,
       (DWC2_HCCHAR_CHEN | DWC2_HCCHAR_CHDIS));
@@ -1457,6 +1764,7 @@ DestroyDwUsbHc (
   )
 {
   UINT32 Pages;
+  UINT32 Index;
   EFI_TPL PreviousTpl;
 
   if (DwHc == NULL) {
@@ -1474,8 +1782,15 @@ DestroyDwUsbHc (
   }
 
   Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
-  DmaUnmap (DwHc->AlignedBufferMapping);
-  DmaFreeBuffer (Pages, DwHc->AlignedBuffer);
+  for (Index = 0; Index < DwHc->NumChannels; Index++) {
+    if (DwHc->Channels[Index].BufferMapping != NULL) {
+      DmaUnmap (DwHc->Channels[Index].BufferMapping);
+    }
+
+    if (DwHc->Channels[Index].Buffer != NULL) {
+      DmaFreeBuffer (Pages, DwHc->Channels[Index].Buffer);
+    }
+  }
 
   Pages = EFI_SIZE_TO_PAGES (DWC2_STATUS_BUF_SIZE);
   FreePages (DwHc->StatusBuffer, Pages);
@@ -1504,9 +1819,7 @@ FramesPassed (
   )
 {
   UINT32 MicroFrameStart = DwHc->LastMicroFrame;
-  UINT32 MicroFrameEnd =
-    MmioRead32 (DwHc->DwUsbBase + HFNUM) &
-    DWC2_HFNUM_FRNUM_MASK;
+  UINT32 MicroFrameEnd = DwHcFrameNumber (DwHc);
   UINT32 MicroFramesPassed;
 
   DwHc->LastMicroFrame = (UINT16)MicroFrameEnd;
@@ -1563,8 +1876,10 @@ CreateDwUsbHc (
 {
   DWUSB_OTGHC_DEV *DwHc;
   UINT32          Pages;
+  UINT32          Index;
   UINTN           BufferSize;
   EFI_STATUS      Status;
+  DWUSB_CHANNEL   *Chan;
 
   DwHc = AllocateZeroPool (sizeof (DWUSB_OTGHC_DEV));
   if (DwHc == NULL) {
@@ -1596,19 +1911,29 @@ CreateDwUsbHc (
     return EFI_OUT_OF_RESOURCES;
   }
 
+  DwHc->NumChannels = MmioRead32 (DwHc->DwUsbBase + GHWCFG2);
+  DwHc->NumChannels &= DWC2_HWCFG2_NUM_HOST_CHAN_MASK;
+  DwHc->NumChannels >>= DWC2_HWCFG2_NUM_HOST_CHAN_OFFSET;
+  DwHc->NumChannels += 1;
+  DEBUG ((DEBUG_INFO, "Host has %u channels\n", DwHc->NumChannels));
+
   Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
-  Status = DmaAllocateBuffer (EfiBootServicesData, Pages, (VOID**)&DwHc->AlignedBuffer);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "CreateDwUsbHc: DmaAllocateBuffer: %r\n", Status));
-    return Status;
-  }
+  for (Index = 0; Index < DwHc->NumChannels; Index++) {
+    Chan = &DwHc->Channels[Index];
 
-  BufferSize = EFI_PAGES_TO_SIZE (Pages);
-  Status = DmaMap (MapOperationBusMasterCommonBuffer, DwHc->AlignedBuffer, &BufferSize,
-             &DwHc->AlignedBufferBusAddress, &DwHc->AlignedBufferMapping);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "CreateDwUsbHc: DmaMap: %r\n", Status));
-    return Status;
+    Status = DmaAllocateBuffer (EfiBootServicesData, Pages, (VOID**)&Chan->Buffer);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "CreateDwUsbHc: DmaAllocateBuffer: %r\n", Status));
+      return Status;
+    }
+
+    BufferSize = EFI_PAGES_TO_SIZE (Pages);
+    Status = DmaMap (MapOperationBusMasterCommonBuffer, Chan->Buffer, &BufferSize,
+               &Chan->BufferBusAddress, &Chan->BufferMapping);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "CreateDwUsbHc: DmaMap: %r\n", Status));
+      return Status;
+    }
   }
 
   InitializeListHead (&DwHc->DeferredList);
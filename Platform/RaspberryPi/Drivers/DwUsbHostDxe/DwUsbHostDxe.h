@@ -36,6 +36,8 @@
 #include <Library/DmaLib.h>
 #include <Library/ArmLib.h>
 
+#include "DwcHw.h"
+
 #define MAX_DEVICE                      16
 #define MAX_ENDPOINT                    16
 
@@ -74,7 +76,6 @@ typedef struct {
 typedef struct _DWUSB_DEFERRED_REQ {
   IN OUT LIST_ENTRY                         List;
   IN     struct _DWUSB_OTGHC_DEV            *DwHc;
-  IN     UINT32                             Channel;
   IN     UINT32                             FrameInterval;
   IN     UINT32                             TargetFrame;
   IN     EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator;
@@ -94,6 +95,17 @@ typedef struct _DWUSB_DEFERRED_REQ {
   IN     UINTN                              TimeOut;
 } DWUSB_DEFERRED_REQ;
 
+/*
+ * Each host channel owns a bounce buffer, so that transfers
+ * on different channels can be in flight at the same time.
+ */
+typedef struct {
+  BOOLEAN                         InUse;
+  UINT8                           *Buffer;
+  VOID *                          BufferMapping;
+  UINTN                           BufferBusAddress;
+} DWUSB_CHANNEL;
+
 typedef struct _DWUSB_OTGHC_DEV {
   UINTN                           Signature;
 
@@ -108,9 +120,8 @@ typedef struct _DWUSB_OTGHC_DEV {
   EFI_PHYSICAL_ADDRESS            DwUsbBase;
   UINT8                           *StatusBuffer;
 
-  UINT8                           *AlignedBuffer;
-  VOID *                          AlignedBufferMapping;
-  UINTN                           AlignedBufferBusAddress;
+  UINT32                          NumChannels;
+  DWUSB_CHANNEL                   Channels[DWC2_MAX_CHANNELS];
   LIST_ENTRY                      DeferredList;
   /*
    * 1ms frames.
@@ -107,17 +107,35 @@ MMC_HOST_INSTANCE* CreateMmcHostInstance (
   MmcHostInstance->BlockIo.WriteBlocks = MmcWriteBlocks;
   MmcHostInstance->BlockIo.FlushBlocks = MmcFlushBlocks;
 
+  MmcHostInstance->BlockIo2.Media = MmcHostInstance->BlockIo.Media;
+  MmcHostInstance->BlockIo2.Reset = MmcResetEx;
+  MmcHostInstance->BlockIo2.ReadBlocksEx = MmcReadBlocksEx;
+  MmcHostInstance->BlockIo2.WriteBlocksEx = MmcWriteBlocksEx;
+  MmcHostInstance->BlockIo2.FlushBlocksEx = MmcFlushBlocksEx;
+
+  InitializeListHead (&MmcHostInstance->RequestQueue);
+  Status = gBS->CreateEvent (
+                  EVT_NOTIFY_SIGNAL | EVT_TIMER,
+                  TPL_CALLBACK,
+                  MmcQueueCallback,
+                  MmcHostInstance,
+                  &MmcHostInstance->QueueEvent
+                );
+  if (EFI_ERROR (Status)) {
+    goto FREE_MEDIA;
+  }
+
   MmcHostInstance->MmcHost = MmcHost;
 
   // Create DevicePath for the new MMC Host
   Status = MmcHost->BuildDevicePath (MmcHost, &NewDevicePathNode);
   if (EFI_ERROR (Status)) {
-    goto FREE_MEDIA;
+    goto CLOSE_EVENT;
   }
 
   DevicePath = (EFI_DEVICE_PATH_PROTOCOL*)AllocatePool (END_DEVICE_PATH_LENGTH);
   if (DevicePath == NULL) {
-    goto FREE_MEDIA;
+    goto CLOSE_EVENT;
   }
 
   SetDevicePathEndNode (DevicePath);
@@ -127,6 +145,7 @@ MMC_HOST_INSTANCE* CreateMmcHostInstance (
   Status = gBS->InstallMultipleProtocolInterfaces (
                   &MmcHostInstance->MmcHandle,
                   &gEfiBlockIoProtocolGuid, &MmcHostInstance->BlockIo,
+                  &gEfiBlockIo2ProtocolGuid, &MmcHostInstance->BlockIo2,
                   &gEfiDevicePathProtocolGuid, MmcHostInstance->DevicePath,
                   NULL
                 );
@@ -139,6 +158,9 @@ MMC_HOST_INSTANCE* CreateMmcHostInstance (
 FREE_DEVICE_PATH:
   FreePool (DevicePath);
 
+CLOSE_EVENT:
+  gBS->CloseEvent (MmcHostInstance->QueueEvent);
+
 FREE_MEDIA:
   FreePool (MmcHostInstance->BlockIo.Media);
 
@@ -153,11 +175,19 @@ EFI_STATUS DestroyMmcHostInstance (
   )
 {
   EFI_STATUS Status;
+  EFI_TPL    OldTpl;
+
+  // Complete the outstanding requests, and stop the queue event
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  MmcAbortRequests (MmcHostInstance);
+  gBS->RestoreTPL (OldTpl);
+  gBS->CloseEvent (MmcHostInstance->QueueEvent);
 
   // Uninstall Protocol Interfaces
   Status = gBS->UninstallMultipleProtocolInterfaces (
                   MmcHostInstance->MmcHandle,
                   &gEfiBlockIoProtocolGuid, &(MmcHostInstance->BlockIo),
+                  &gEfiBlockIo2ProtocolGuid, &(MmcHostInstance->BlockIo2),
                   &gEfiDevicePathProtocolGuid, MmcHostInstance->DevicePath,
                   NULL
                 );
@@ -363,6 +393,9 @@ CheckCardsCallback (
     ASSERT (MmcHostInstance != NULL);
 
     if (MmcHostInstance->MmcHost->IsCardPresent (MmcHostInstance->MmcHost) == !MmcHostInstance->Initialized) {
+      // Whatever was queued was for the previous card
+      MmcAbortRequests (MmcHostInstance);
+
       MmcHostInstance->State = MmcHwInitializationState;
       MmcHostInstance->BlockIo.Media->MediaPresent = !MmcHostInstance->Initialized;
       MmcHostInstance->Initialized = !MmcHostInstance->Initialized;
@@ -385,6 +418,17 @@ CheckCardsCallback (
       if (EFI_ERROR (Status)) {
         Print (L"MMC Card: Error reinstalling BlockIo interface\n");
       }
+
+      Status = gBS->ReinstallProtocolInterface (
+                      (MmcHostInstance->MmcHandle),
+                      &gEfiBlockIo2ProtocolGuid,
+                      &(MmcHostInstance->BlockIo2),
+                      &(MmcHostInstance->BlockIo2)
+                    );
+
+      if (EFI_ERROR (Status)) {
+        Print (L"MMC Card: Error reinstalling BlockIo2 interface\n");
+      }
     }
 
     CurrentLink = CurrentLink->ForwardLink;
@@ -7,6 +7,7 @@
  **/
 
 #include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
 
 #include "Mmc.h"
 
@@ -197,6 +198,32 @@ MmcDetectCard (
   }
 }
 
+STATIC
+EFI_STATUS
+MmcSetBlockCount (
+  IN MMC_HOST_INSTANCE *MmcHostInstance,
+  IN UINTN             BlockCount
+  )
+{
+  EFI_STATUS              Status;
+  UINT32                  Response[4];
+  EFI_MMC_HOST_PROTOCOL   *MmcHost = MmcHostInstance->MmcHost;
+
+  // Command 23 - Set block count, so the next CMD18/CMD25
+  // ends on its own, without a CMD12.
+  Status = MmcHost->SendCommand (MmcHost, MMC_CMD23, BlockCount);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = MmcHost->ReceiveResponse (MmcHost, MMC_RESPONSE_TYPE_R1, Response);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return R1TranAndReady (Response);
+}
+
 EFI_STATUS
 MmcStopTransmission (
   EFI_MMC_HOST_PROTOCOL *MmcHost
@@ -230,9 +257,11 @@ MmcTransferBlock (
   MMC_HOST_INSTANCE       *MmcHostInstance;
   EFI_MMC_HOST_PROTOCOL   *MmcHost;
   UINTN                   CmdArg;
+  BOOLEAN                 PreDefined;
 
   MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
   MmcHost = MmcHostInstance->MmcHost;
+  PreDefined = FALSE;
 
   //Set command argument based on the card access mode (Byte mode or Block mode)
   if ((MmcHostInstance->CardInfo.OCRData.AccessMode & MMC_OCR_ACCESS_MASK) ==
@@ -242,6 +271,23 @@ MmcTransferBlock (
     CmdArg = Lba * This->Media->BlockSize;
   }
 
+  if ((Cmd == MMC_CMD18 || Cmd == MMC_CMD25) &&
+      MmcHostInstance->CardInfo.SupportsCmd23 &&
+      MMC_HOST_HAS_GETMAXBLOCKCOUNT (MmcHost)) {
+    Status = MmcSetBlockCount (MmcHostInstance, BufferSize / This->Media->BlockSize);
+    if (EFI_ERROR (Status)) {
+      /*
+       * Not fatal, just fall back to open-ended transfers
+       * terminated with CMD12.
+       */
+      DEBUG ((DEBUG_WARN, "%a(MMC_CMD23): Error %r, not using CMD23 anymore\n",
+        __func__, Status));
+      MmcHostInstance->CardInfo.SupportsCmd23 = FALSE;
+    } else {
+      PreDefined = TRUE;
+    }
+  }
+
   Status = MmcHost->SendCommand (MmcHost, Cmd, CmdArg);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a(MMC_CMD%d): Error %r\n", __func__, MMC_INDX (Cmd), Status));
@@ -262,10 +308,11 @@ MmcTransferBlock (
   }
 
   if (EFI_ERROR (Status) ||
-      BufferSize > This->Media->BlockSize) {
+      (BufferSize > This->Media->BlockSize && !PreDefined)) {
     /*
-     * CMD12 needs to be set for multiblock (to transition from
-     * RECV to PROG) or for errors.
+     * CMD12 needs to be set for open-ended multiblock (to transition
+     * from RECV to PROG) or for errors. Transfers pre-defined with
+     * CMD23 end on their own.
      */
     EFI_STATUS Status2 = MmcStopTransmission (MmcHost);
     if (EFI_ERROR (Status2)) {
@@ -287,10 +334,12 @@ MmcTransferBlock (
   // For reads, should be already in TRAN. For writes, wait
   // until programming finishes.
   //
-  Status = WaitUntilTran (MmcHostInstance);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "WaitUntilTran after write failed\n"));
-    return Status;
+  if (Transfer != MMC_IOBLOCKS_READ) {
+    Status = WaitUntilTran (MmcHostInstance);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "WaitUntilTran after write failed\n"));
+      return Status;
+    }
   }
 
   Status = MmcNotifyState (MmcHostInstance, MmcTransferState);
@@ -311,38 +360,40 @@ MmcTransferBlock (
     *TransferredSize = BufferSize;
   }
 
+  if (!EFI_ERROR (Status)) {
+    MmcHostInstance->InTran = TRUE;
+  }
+
   return Status;
 }
 
+/**
+  Validates a block I/O request, before it gets queued or performed.
+
+  @retval EFI_SUCCESS            The request is valid.
+  @retval others                 The error to complete the request with.
+
+**/
+STATIC
 EFI_STATUS
-MmcIoBlocks (
+MmcCheckIoBlocks (
   IN EFI_BLOCK_IO_PROTOCOL    *This,
   IN UINTN                    Transfer,
   IN UINT32                   MediaId,
   IN EFI_LBA                  Lba,
   IN UINTN                    BufferSize,
-  OUT VOID                    *Buffer
+  IN VOID                     *Buffer
   )
 {
-  EFI_STATUS              Status;
-  UINTN                   Cmd;
   MMC_HOST_INSTANCE       *MmcHostInstance;
-  EFI_MMC_HOST_PROTOCOL   *MmcHost;
-  UINTN                   BytesRemainingToBeTransfered;
-  UINTN                   BlockCount;
-  UINTN                   ConsumeSize;
 
-  BlockCount = 1;
   MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
-  ASSERT (MmcHostInstance != NULL);
-  MmcHost = MmcHostInstance->MmcHost;
-  ASSERT (MmcHost);
 
   if (This->Media->MediaId != MediaId) {
     return EFI_MEDIA_CHANGED;
   }
 
-  if ((MmcHost == NULL) || (Buffer == NULL)) {
+  if ((MmcHostInstance->MmcHost == NULL) || (Buffer == NULL)) {
     return EFI_INVALID_PARAMETER;
   }
 
@@ -351,12 +402,6 @@ MmcIoBlocks (
     return EFI_NO_MEDIA;
   }
 
-  if (PcdGet32 (PcdMmcDisableMulti) == 0 &&
-      MMC_HOST_HAS_ISMULTIBLOCK (MmcHost) &&
-      MmcHost->IsMultiBlock (MmcHost)) {
-    BlockCount = (BufferSize + This->Media->BlockSize - 1) / This->Media->BlockSize;
-  }
-
   // All blocks must be within the device
   if ((Lba + (BufferSize / This->Media->BlockSize)) > (This->Media->LastBlock + 1)) {
     return EFI_INVALID_PARAMETER;
@@ -381,14 +426,69 @@ MmcIoBlocks (
     return EFI_INVALID_PARAMETER;
   }
 
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+MmcIoBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  EFI_STATUS              Status;
+  UINTN                   Cmd;
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+  UINTN                   BytesRemainingToBeTransfered;
+  UINTN                   BlockCount;
+  UINTN                   MaxBlockCount;
+  UINTN                   ConsumeSize;
+
+  MaxBlockCount = 1;
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
+  ASSERT (MmcHostInstance != NULL);
+  MmcHost = MmcHostInstance->MmcHost;
+  ASSERT (MmcHost);
+
+  Status = MmcCheckIoBlocks (This, Transfer, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (PcdGet32 (PcdMmcDisableMulti) == 0 &&
+      MMC_HOST_HAS_ISMULTIBLOCK (MmcHost) &&
+      MmcHost->IsMultiBlock (MmcHost)) {
+    if (MMC_HOST_HAS_GETMAXBLOCKCOUNT (MmcHost)) {
+      MaxBlockCount = MAX (MmcHost->GetMaxBlockCount (MmcHost), 1);
+    } else {
+      MaxBlockCount = MAX_UINTN;
+    }
+  }
+
   BytesRemainingToBeTransfered = BufferSize;
   while (BytesRemainingToBeTransfered > 0) {
-    Status = WaitUntilTran (MmcHostInstance);
-    if (EFI_ERROR (Status)) {
-      DEBUG ((DEBUG_ERROR, "WaitUntilTran before IO failed"));
-      return Status;
+    if (!MmcHostInstance->InTran) {
+      Status = WaitUntilTran (MmcHostInstance);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "WaitUntilTran before IO failed"));
+        return Status;
+      }
     }
 
+    //
+    // Cleared until the transfer completes, so that any
+    // failure gets the card state polled again next time.
+    //
+    MmcHostInstance->InTran = FALSE;
+
+    // Largest run the host can do in one command
+    BlockCount = MIN (BytesRemainingToBeTransfered / This->Media->BlockSize,
+                      MaxBlockCount);
+
     if (Transfer == MMC_IOBLOCKS_READ) {
       if (BlockCount == 1) {
         // Read a single block
@@ -408,9 +508,6 @@ MmcIoBlocks (
     }
 
     ConsumeSize = BlockCount * This->Media->BlockSize;
-    if (BytesRemainingToBeTransfered < ConsumeSize) {
-      ConsumeSize = BytesRemainingToBeTransfered;
-    }
 
     Status = MmcTransferBlock (This, Cmd, Transfer, MediaId, Lba, ConsumeSize, Buffer, &ConsumeSize);
     if (EFI_ERROR (Status)) {
@@ -420,7 +517,7 @@ MmcIoBlocks (
 
     BytesRemainingToBeTransfered -= ConsumeSize;
     if (BytesRemainingToBeTransfered > 0) {
-      Lba += BlockCount;
+      Lba += ConsumeSize / This->Media->BlockSize;
       Buffer = (UINT8*)Buffer + ConsumeSize;
     }
   }
@@ -428,6 +525,218 @@ MmcIoBlocks (
   return EFI_SUCCESS;
 }
 
+/**
+  Performs (part of) a request, with the TPL at TPL_CALLBACK, so that
+  the host is never used from two places at once.
+
+  @param  MmcHostInstance        The MMC host instance.
+  @param  Request                The request, updated to describe what's left.
+  @param  MaxSize                Largest amount of data to transfer.
+
+  @retval EFI_SUCCESS            The request completed successfully.
+  @retval EFI_NOT_READY          The request isn't finished yet.
+  @retval others                 The request failed, with this status.
+
+**/
+STATIC
+EFI_STATUS
+MmcExecuteRequest (
+  IN     MMC_HOST_INSTANCE      *MmcHostInstance,
+  IN OUT MMC_REQUEST            *Request,
+  IN     UINTN                  MaxSize
+  )
+{
+  EFI_STATUS              Status;
+  UINTN                   Size;
+
+  if (Request->Transfer == MMC_IOBLOCKS_FLUSH) {
+    //
+    // Everything queued before is done, and there's no write cache.
+    //
+    if (!MmcHostInstance->BlockIo.Media->MediaPresent) {
+      return EFI_NO_MEDIA;
+    }
+    return EFI_SUCCESS;
+  }
+
+  Size = MIN (Request->BufferSize, MaxSize);
+  Status = MmcIoBlocks (&MmcHostInstance->BlockIo, Request->Transfer,
+             Request->MediaId, Request->Lba, Size, Request->Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Request->BufferSize -= Size;
+  if (Request->BufferSize == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Request->Lba += Size / MmcHostInstance->BlockIo.Media->BlockSize;
+  Request->Buffer = (UINT8*)Request->Buffer + Size;
+  return EFI_NOT_READY;
+}
+
+/**
+  Removes a queued request, and signals its token with Status.
+
+**/
+STATIC
+VOID
+MmcCompleteRequest (
+  IN MMC_REQUEST            *Request,
+  IN EFI_STATUS             Status
+  )
+{
+  RemoveEntryList (&Request->Link);
+  Request->Token->TransactionStatus = Status;
+  gBS->SignalEvent (Request->Token->Event);
+  FreePool (Request);
+}
+
+/**
+  Performs all the queued requests. Must be called at TPL_CALLBACK.
+
+  @param  MmcHostInstance        The MMC host instance.
+
+**/
+STATIC
+VOID
+MmcDrainQueue (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  )
+{
+  MMC_REQUEST             *Request;
+  EFI_STATUS              Status;
+
+  while (!IsListEmpty (&MmcHostInstance->RequestQueue)) {
+    Request = MMC_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->RequestQueue));
+    Status = MmcExecuteRequest (MmcHostInstance, Request, MAX_UINTN);
+    MmcCompleteRequest (Request, Status);
+  }
+}
+
+VOID
+MmcAbortRequests (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  )
+{
+  MMC_REQUEST             *Request;
+
+  while (!IsListEmpty (&MmcHostInstance->RequestQueue)) {
+    Request = MMC_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->RequestQueue));
+    MmcCompleteRequest (Request, EFI_ABORTED);
+  }
+}
+
+/**
+  Queue event, performs the next MMC_REQUEST_SLICE_SIZE of the request
+  at the head of the queue, and re-arms itself while there's more to do.
+
+**/
+VOID
+EFIAPI
+MmcQueueCallback (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  )
+{
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+  MMC_REQUEST             *Request;
+  EFI_STATUS              Status;
+
+  MmcHostInstance = Context;
+
+  if (IsListEmpty (&MmcHostInstance->RequestQueue)) {
+    return;
+  }
+
+  Request = MMC_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->RequestQueue));
+  Status = MmcExecuteRequest (MmcHostInstance, Request, MMC_REQUEST_SLICE_SIZE);
+  if (Status != EFI_NOT_READY) {
+    MmcCompleteRequest (Request, Status);
+  }
+
+  if (!IsListEmpty (&MmcHostInstance->RequestQueue)) {
+    gBS->SetTimer (MmcHostInstance->QueueEvent, TimerRelative, 0);
+  }
+}
+
+/**
+  Common implementation of the BlockIo and BlockIo2 requests.
+
+  Without a Token (or Token->Event), the request is blocking, and is
+  performed right away, after everything that was queued before it.
+  Otherwise, it's queued, and completed later from the queue event.
+
+**/
+STATIC
+EFI_STATUS
+MmcSubmitRequest (
+  IN     MMC_HOST_INSTANCE      *MmcHostInstance,
+  IN     UINTN                  Transfer,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN     UINTN                  BufferSize,
+  IN OUT VOID                   *Buffer,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token OPTIONAL
+  )
+{
+  MMC_REQUEST             *Request;
+  EFI_STATUS              Status;
+  EFI_TPL                 OldTpl;
+  BOOLEAN                 Blocking;
+
+  Blocking = (Token == NULL || Token->Event == NULL);
+
+  if (Transfer == MMC_IOBLOCKS_FLUSH) {
+    if (!MmcHostInstance->BlockIo.Media->MediaPresent) {
+      return EFI_NO_MEDIA;
+    }
+  } else {
+    Status = MmcCheckIoBlocks (&MmcHostInstance->BlockIo, Transfer, MediaId,
+               Lba, BufferSize, Buffer);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  if (!Blocking && Transfer != MMC_IOBLOCKS_FLUSH && BufferSize == 0) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  Request = AllocatePool (sizeof (MMC_REQUEST));
+  if (Request == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Request->Signature = MMC_REQUEST_SIGNATURE;
+  Request->Transfer = Transfer;
+  Request->MediaId = MediaId;
+  Request->Lba = Lba;
+  Request->BufferSize = BufferSize;
+  Request->Buffer = Buffer;
+  Request->Token = Token;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  if (Blocking) {
+    MmcDrainQueue (MmcHostInstance);
+    Status = MmcExecuteRequest (MmcHostInstance, Request, MAX_UINTN);
+    FreePool (Request);
+  } else {
+    if (IsListEmpty (&MmcHostInstance->RequestQueue)) {
+      gBS->SetTimer (MmcHostInstance->QueueEvent, TimerRelative, 0);
+    }
+    InsertTailList (&MmcHostInstance->RequestQueue, &Request->Link);
+    Status = EFI_SUCCESS;
+  }
+
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
 EFI_STATUS
 EFIAPI
 MmcReadBlocks (
@@ -438,7 +747,8 @@ MmcReadBlocks (
   OUT VOID                    *Buffer
   )
 {
-  return MmcIoBlocks (This, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This),
+           MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer, NULL);
 }
 
 EFI_STATUS
@@ -451,7 +761,8 @@ MmcWriteBlocks (
   IN VOID                     *Buffer
   )
 {
-  return MmcIoBlocks (This, MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer);
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This),
+           MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer, NULL);
 }
 
 EFI_STATUS
@@ -460,5 +771,68 @@ MmcFlushBlocks (
   IN EFI_BLOCK_IO_PROTOCOL  *This
   )
 {
-  return EFI_SUCCESS;
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This),
+           MMC_IOBLOCKS_FLUSH, This->Media->MediaId, 0, 0, NULL, NULL);
+}
+
+EFI_STATUS
+EFIAPI
+MmcResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL   *This,
+  IN BOOLEAN                  ExtendedVerification
+  )
+{
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+  EFI_TPL                 OldTpl;
+  EFI_STATUS              Status;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  MmcAbortRequests (MmcHostInstance);
+  Status = MmcReset (&MmcHostInstance->BlockIo, ExtendedVerification);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+EFI_STATUS
+EFIAPI
+MmcReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This),
+           MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer, Token);
+}
+
+EFI_STATUS
+EFIAPI
+MmcWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  )
+{
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This),
+           MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer, Token);
+}
+
+EFI_STATUS
+EFIAPI
+MmcFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token
+  )
+{
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This),
+           MMC_IOBLOCKS_FLUSH, This->Media->MediaId, 0, 0, NULL, Token);
 }
@@ -45,6 +45,8 @@ typedef union {
 
 #define SD_CCC_SWITCH           (1 << 10)
 
+#define SD_SCR_CMD23_SUPPORT    (1 << 1)
+
 #define DEVICE_STATE(x)         (((x) >> 9) & 0xf)
 typedef enum _EMMC_DEVICE_STATE {
   EMMC_IDLE_STATE = 0,
@@ -242,6 +244,9 @@ EmmcIdentificationMode (
 
   // Setup card type
   MmcHostInstance->CardInfo.CardType = EMMC_CARD;
+
+  // CMD23 is mandatory for eMMC
+  MmcHostInstance->CardInfo.SupportsCmd23 = TRUE;
   return EFI_SUCCESS;
 
 FreePageExit:
@@ -670,11 +675,16 @@ InitializeSdMmcDevice (
     return Status;
   }
 
+  ZeroMem (&Scr, sizeof (Scr));
   Status = SdExecuteScr (MmcHostInstance, &Scr);
   if (EFI_ERROR (Status)) {
      return Status;
   }
 
+  MmcHostInstance->CardInfo.SupportsCmd23 = (Scr.CMD_SUPPORT & SD_SCR_CMD23_SUPPORT) != 0;
+  DEBUG ((DEBUG_INFO, "SD Card %a CMD23\n",
+    MmcHostInstance->CardInfo.SupportsCmd23 ? "supports" : "doesn't support"));
+
   if (Scr.SD_SPEC == 2) {
     if (Scr.SD_SPEC3 == 1) {
       if (Scr.SD_SPEC4 == 1) {
@@ -956,6 +966,8 @@ InitializeMmcDevice (
 
   BlockCount = 1;
   MmcHost = MmcHostInstance->MmcHost;
+  MmcHostInstance->CardInfo.SupportsCmd23 = FALSE;
+  MmcHostInstance->InTran = FALSE;
 
   Status = MmcIdentificationMode (MmcHostInstance);
   if (EFI_ERROR (Status)) {
@@ -949,9 +949,13 @@ ProcessorInfoUpdateSmbiosType4 (
   IN UINTN MaxCpus
   )
 {
-  EFI_STATUS Status;
-  UINT32     Rate;
-  UINT64     *ProcessorId;
+  EFI_STATUS   Status;
+  EFI_STATUS   MaxRateStatus;
+  EFI_STATUS   RateStatus;
+  RPI_FW_BATCH *Batch;
+  UINT32       MaxRate[2];
+  UINT32       Rate[2];
+  UINT64       *ProcessorId;
 
   mProcessorInfoType4.CoreCount = (UINT8)MaxCpus;
   mProcessorInfoType4.CoreCount2 = (UINT8)MaxCpus;
@@ -960,20 +964,39 @@ ProcessorInfoUpdateSmbiosType4 (
   mProcessorInfoType4.ThreadCount = (UINT8)MaxCpus;
   mProcessorInfoType4.ThreadCount2 = (UINT8)MaxCpus;
 
-  Status = mFwProtocol->GetMaxClockRate (RPI_MBOX_CLOCK_RATE_ARM, &Rate);
-  if (Status != EFI_SUCCESS) {
-    DEBUG ((DEBUG_ERROR, "Couldn't get the max CPU speed: %r\n", Status));
+  //
+  // Get both CPU speeds in one mailbox transaction.
+  // The tag values are { ClockId, ClockRate }.
+  //
+  MaxRate[0] = RPI_MBOX_CLOCK_RATE_ARM;
+  MaxRate[1] = 0;
+  Rate[0] = RPI_MBOX_CLOCK_RATE_ARM;
+  Rate[1] = 0;
+
+  Status = mFwProtocol->CreateBatch (&Batch);
+  MaxRateStatus = Status;
+  RateStatus = Status;
+  if (!EFI_ERROR (Status)) {
+    mFwProtocol->BatchAddTag (Batch, RPI_MBOX_GET_MAX_CLOCK_RATE,
+                   MaxRate, sizeof (MaxRate), &MaxRateStatus);
+    mFwProtocol->BatchAddTag (Batch, RPI_MBOX_GET_CLOCK_RATE,
+                   Rate, sizeof (Rate), &RateStatus);
+    mFwProtocol->SubmitBatch (Batch);
+    mFwProtocol->FreeBatch (Batch);
+  }
+
+  if (MaxRateStatus != EFI_SUCCESS) {
+    DEBUG ((DEBUG_ERROR, "Couldn't get the max CPU speed: %r\n", MaxRateStatus));
   } else {
-    mProcessorInfoType4.MaxSpeed = Rate / 1000000;
-    DEBUG ((DEBUG_INFO, "Max CPU speed: %uHz\n", Rate));
+    mProcessorInfoType4.MaxSpeed = MaxRate[1] / 1000000;
+    DEBUG ((DEBUG_INFO, "Max CPU speed: %uHz\n", MaxRate[1]));
   }
 
-  Status = mFwProtocol->GetClockRate (RPI_MBOX_CLOCK_RATE_ARM, &Rate);
-  if (Status != EFI_SUCCESS) {
-    DEBUG ((DEBUG_ERROR, "Couldn't get the current CPU speed: %r\n", Status));
+  if (RateStatus != EFI_SUCCESS) {
+    DEBUG ((DEBUG_ERROR, "Couldn't get the current CPU speed: %r\n", RateStatus));
   } else {
-    mProcessorInfoType4.CurrentSpeed = Rate / 1000000;
-    DEBUG ((DEBUG_INFO, "Current CPU speed: %uHz\n", Rate));
+    mProcessorInfoType4.CurrentSpeed = Rate[1] / 1000000;
+    DEBUG ((DEBUG_INFO, "Current CPU speed: %uHz\n", Rate[1]));
   }
 
   AsciiStrCpyS (mCpuName, sizeof (mCpuName), BoardRevisionGetProcessorName (mBoardRevisionCode));
@@ -20,6 +20,7 @@
 #include <Library/DebugLib.h>
 #include <Library/DxeServicesTableLib.h>
 #include <Library/IoLib.h>
+#include <Library/MemoryAllocationLib.h>
 #include <Library/SynchronizationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
@@ -44,6 +45,16 @@ STATIC UINTN mDmaBufferBusAddress;
 
 STATIC SPIN_LOCK mMailboxLock;
 
+//
+// Activity LED state, see RpiFirmwareNotifyActivity
+//
+#define ACTIVITY_LED_PERIOD EFI_TIMER_PERIOD_MILLISECONDS (250)
+
+STATIC EFI_EVENT        mActivityLedEvent;
+STATIC EFI_EVENT        mActivityLedExitBootServicesEvent;
+STATIC volatile BOOLEAN mActivityPending;
+STATIC BOOLEAN          mActivityLedOn;
+
 STATIC
 BOOLEAN
 DrainMailbox (
@@ -93,10 +104,15 @@ MailboxWaitForStatusCleared (
   return FALSE;
 }
 
+/*
+ * Must be called with mMailboxLock held.
+ */
 STATIC
 EFI_STATUS
-MailboxTransaction (
-  IN    UINTN   Length,
+MailboxTransactionBuffer (
+  IN    VOID    *Buffer,
+  IN    UINTN   BufferSize,
+  IN    UINTN   BufferBusAddress,
   IN    UINTN   Channel,
   OUT   UINT32  *Result
   )
@@ -128,7 +144,7 @@ MailboxTransaction (
   // somehow ends up being cached at runtime.
   //
   if (EfiAtRuntime ()) {
-    WriteBackDataCacheRange (mDmaBuffer, mDmaBufferSize);
+    WriteBackDataCacheRange (Buffer, BufferSize);
   }
 
   ArmDataSynchronizationBarrier ();
@@ -137,7 +153,7 @@ MailboxTransaction (
   // Start the mailbox transaction
   //
   MmioWrite32 (mMboxBaseAddress + BCM2836_MBOX_WRITE_OFFSET,
-    (UINT32)((UINTN)mDmaBufferBusAddress | Channel));
+    (UINT32)(BufferBusAddress | Channel));
 
   ArmDataSynchronizationBarrier ();
 
@@ -151,7 +167,7 @@ MailboxTransaction (
   }
 
   if (EfiAtRuntime ()) {
-    InvalidateDataCacheRange (mDmaBuffer, mDmaBufferSize);
+    InvalidateDataCacheRange (Buffer, BufferSize);
   }
 
   //
@@ -164,6 +180,18 @@ MailboxTransaction (
   return EFI_SUCCESS;
 }
 
+STATIC
+EFI_STATUS
+MailboxTransaction (
+  IN    UINTN   Length,
+  IN    UINTN   Channel,
+  OUT   UINT32  *Result
+  )
+{
+  return MailboxTransactionBuffer (mDmaBuffer, mDmaBufferSize,
+           mDmaBufferBusAddress, Channel, Result);
+}
+
 #pragma pack(1)
 typedef struct {
   UINT32    BufferSize;
@@ -1097,10 +1125,12 @@ typedef struct {
 } RPI_FW_SET_GPIO_CMD;
 #pragma pack()
 
+/*
+ * Must be called with mMailboxLock held.
+ */
 STATIC
 VOID
-EFIAPI
-RpiFirmwareSetGpio (
+MailboxSetGpio (
   IN  UINT32  Gpio,
   IN  BOOLEAN State
   )
@@ -1109,11 +1139,6 @@ RpiFirmwareSetGpio (
   EFI_STATUS          Status;
   UINT32              Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
-    return;
-  }
-
   Cmd = mDmaBuffer;
   ZeroMem (Cmd, sizeof (*Cmd));
 
@@ -1137,6 +1162,22 @@ RpiFirmwareSetGpio (
       "%a: mailbox  transaction error: Status == %r, Response == 0x%x\n",
       __FUNCTION__, Status, Cmd->BufferHead.Response));
   }
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareSetGpio (
+  IN  UINT32  Gpio,
+  IN  BOOLEAN State
+  )
+{
+  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+    return;
+  }
+
+  MailboxSetGpio (Gpio, State);
   ReleaseSpinLock (&mMailboxLock);
 }
 
@@ -1150,6 +1191,79 @@ RpiFirmwareSetLed (
   RpiFirmwareSetGpio (RPI_EXP_GPIO_LED, On);
 }
 
+/*
+ * Storage drivers call this for every request, so it must stay cheap:
+ * the mailbox is only touched by RpiFirmwareActivityLedTimer, which
+ * turns the LED on at the first tick that sees activity, and off at
+ * the first one that doesn't. This bounds the number of mailbox
+ * transactions to one per ACTIVITY_LED_PERIOD.
+ */
+STATIC
+VOID
+EFIAPI
+RpiFirmwareNotifyActivity (
+  VOID
+  )
+{
+  mActivityPending = TRUE;
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareActivityLedTimer (
+  IN EFI_EVENT        Event,
+  IN VOID             *Context
+  )
+{
+  BOOLEAN On;
+
+  On = mActivityPending;
+  if (On == mActivityLedOn) {
+    mActivityPending = FALSE;
+    return;
+  }
+
+  /*
+   * The timer may have interrupted a mailbox transaction,
+   * in which case just try again on the next tick.
+   */
+  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
+    return;
+  }
+
+  mActivityPending = FALSE;
+  MailboxSetGpio (RPI_EXP_GPIO_LED, On);
+  mActivityLedOn = On;
+  ReleaseSpinLock (&mMailboxLock);
+}
+
+/*
+ * Stops the activity LED timer, and leaves the LED off for the OS.
+ * Only cancels the timer: closing events (which frees memory) isn't
+ * allowed in an ExitBootServices notification.
+ */
+STATIC
+VOID
+EFIAPI
+RpiFirmwareActivityLedExitBootServices (
+  IN EFI_EVENT        Event,
+  IN VOID             *Context
+  )
+{
+  gBS->SetTimer (mActivityLedEvent, TimerCancel, 0);
+
+  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+    return;
+  }
+
+  mActivityPending = FALSE;
+  MailboxSetGpio (RPI_EXP_GPIO_LED, FALSE);
+  mActivityLedOn = FALSE;
+  ReleaseSpinLock (&mMailboxLock);
+}
+
 #pragma pack()
 typedef struct {
   UINT32                       DeviceAddress;
@@ -1454,6 +1568,245 @@ RpiFirmwareSetRtc (
   return Status;
 }
 
+//
+// Batches start with room for this many tags, and grow as needed
+//
+#define RPI_FW_BATCH_INITIAL_TAGS   8
+
+typedef struct {
+  UINT32                    TagId;
+  VOID                      *Value;
+  UINT32                    ValueSize;
+  EFI_STATUS                *TagStatus;
+} RPI_FW_BATCH_TAG;
+
+struct _RPI_FW_BATCH {
+  RPI_FW_BATCH_TAG          *Tags;
+  UINTN                     TagCount;
+  UINTN                     MaxTags;
+  UINTN                     BufferSize;
+};
+
+STATIC
+EFI_STATUS
+EFIAPI
+RpiFirmwareCreateBatch (
+  OUT   RPI_FW_BATCH  **Batch
+  )
+{
+  RPI_FW_BATCH  *NewBatch;
+
+  if (Batch == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  NewBatch = AllocateZeroPool (sizeof (*NewBatch));
+  if (NewBatch == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewBatch->Tags = AllocatePool (RPI_FW_BATCH_INITIAL_TAGS * sizeof (RPI_FW_BATCH_TAG));
+  if (NewBatch->Tags == NULL) {
+    FreePool (NewBatch);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewBatch->MaxTags    = RPI_FW_BATCH_INITIAL_TAGS;
+  NewBatch->BufferSize = sizeof (RPI_FW_BUFFER_HEAD) + sizeof (UINT32);
+
+  *Batch = NewBatch;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+RpiFirmwareBatchAddTag (
+  IN      RPI_FW_BATCH  *Batch,
+  IN      UINT32        TagId,
+  IN OUT  VOID          *Value,
+  IN      UINT32        ValueSize,
+  OUT     EFI_STATUS    *TagStatus  OPTIONAL
+  )
+{
+  RPI_FW_BATCH_TAG  *Tags;
+  RPI_FW_BATCH_TAG  *Tag;
+
+  if (Batch == NULL || (Value == NULL && ValueSize != 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (TagStatus != NULL) {
+    *TagStatus = EFI_NOT_READY;
+  }
+
+  if (Batch->TagCount == Batch->MaxTags) {
+    Tags = ReallocatePool (Batch->MaxTags * sizeof (RPI_FW_BATCH_TAG),
+             2 * Batch->MaxTags * sizeof (RPI_FW_BATCH_TAG), Batch->Tags);
+    if (Tags == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Batch->Tags = Tags;
+    Batch->MaxTags *= 2;
+  }
+
+  Tag = &Batch->Tags[Batch->TagCount++];
+  Tag->TagId     = TagId;
+  Tag->Value     = Value;
+  Tag->ValueSize = ValueSize;
+  Tag->TagStatus = TagStatus;
+
+  //
+  // Tag values are padded to 32 bits
+  //
+  Batch->BufferSize += sizeof (RPI_FW_TAG_HEAD) + ALIGN_VALUE (ValueSize, sizeof (UINT32));
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+RpiFirmwareSubmitBatch (
+  IN  RPI_FW_BATCH  *Batch
+  )
+{
+  RPI_FW_BUFFER_HEAD    *Head;
+  RPI_FW_TAG_HEAD       *TagHead;
+  RPI_FW_BATCH_TAG      *Tag;
+  UINT8                 *Buffer;
+  UINTN                 BufferPages;
+  UINTN                 MappedSize;
+  EFI_PHYSICAL_ADDRESS  BusAddress;
+  VOID                  *Mapping;
+  EFI_STATUS            Status;
+  EFI_STATUS            TagStatus;
+  UINT32                Result;
+  UINTN                 Index;
+
+  if (Batch == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Batch->TagCount == 0) {
+    return EFI_SUCCESS;
+  }
+
+  //
+  // The property buffer is sized for this batch, rather than carved
+  // out of mDmaBuffer, so batches aren't limited to a page.
+  //
+  BufferPages = EFI_SIZE_TO_PAGES (Batch->BufferSize);
+  Status = DmaAllocateBuffer (EfiBootServicesData, BufferPages, (VOID **)&Buffer);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to allocate DMA buffer (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto Done;
+  }
+
+  MappedSize = EFI_PAGES_TO_SIZE (BufferPages);
+  Status = DmaMap (MapOperationBusMasterCommonBuffer, Buffer, &MappedSize,
+             &BusAddress, &Mapping);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to map DMA buffer (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto FreeBuffer;
+  }
+
+  ASSERT (!(BusAddress & (BCM2836_MBOX_NUM_CHANNELS - 1)));
+
+  ZeroMem (Buffer, Batch->BufferSize);
+
+  Head = (RPI_FW_BUFFER_HEAD *)Buffer;
+  Head->BufferSize = (UINT32)Batch->BufferSize;
+  Head->Response   = 0;
+
+  TagHead = (RPI_FW_TAG_HEAD *)(Head + 1);
+  for (Index = 0; Index < Batch->TagCount; Index++) {
+    Tag = &Batch->Tags[Index];
+    TagHead->TagId        = Tag->TagId;
+    TagHead->TagSize      = ALIGN_VALUE (Tag->ValueSize, sizeof (UINT32));
+    TagHead->TagValueSize = 0;
+    CopyMem (TagHead + 1, Tag->Value, Tag->ValueSize);
+    TagHead = (RPI_FW_TAG_HEAD *)((UINT8 *)(TagHead + 1) + TagHead->TagSize);
+  }
+
+  //
+  // The end tag is already zero
+  //
+
+  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+    Status = EFI_DEVICE_ERROR;
+    goto UnmapBuffer;
+  }
+
+  Status = MailboxTransactionBuffer (Buffer, MappedSize, (UINTN)BusAddress,
+             RPI_MBOX_VC_CHANNEL, &Result);
+
+  ReleaseSpinLock (&mMailboxLock);
+
+  if (EFI_ERROR (Status) ||
+      Head->Response != RPI_MBOX_RESP_SUCCESS) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: mailbox transaction error: Status == %r, Response == 0x%x\n",
+      __FUNCTION__, Status, Head->Response));
+    Status = EFI_DEVICE_ERROR;
+    goto UnmapBuffer;
+  }
+
+  TagHead = (RPI_FW_TAG_HEAD *)(Head + 1);
+  for (Index = 0; Index < Batch->TagCount; Index++) {
+    Tag = &Batch->Tags[Index];
+    if ((TagHead->TagValueSize & RPI_MBOX_VALUE_SIZE_RESPONSE_MASK) != 0) {
+      CopyMem (Tag->Value, TagHead + 1, Tag->ValueSize);
+      TagStatus = EFI_SUCCESS;
+    } else {
+      DEBUG ((DEBUG_ERROR, "%a: no response for tag 0x%x\n",
+        __FUNCTION__, Tag->TagId));
+      TagStatus = EFI_DEVICE_ERROR;
+    }
+
+    if (Tag->TagStatus != NULL) {
+      *Tag->TagStatus = TagStatus;
+    }
+    TagHead = (RPI_FW_TAG_HEAD *)((UINT8 *)(TagHead + 1) + TagHead->TagSize);
+  }
+
+UnmapBuffer:
+  DmaUnmap (Mapping);
+FreeBuffer:
+  DmaFreeBuffer (BufferPages, Buffer);
+Done:
+  if (EFI_ERROR (Status)) {
+    for (Index = 0; Index < Batch->TagCount; Index++) {
+      if (Batch->Tags[Index].TagStatus != NULL) {
+        *Batch->Tags[Index].TagStatus = Status;
+      }
+    }
+  }
+
+  Batch->TagCount = 0;
+  Batch->BufferSize = sizeof (RPI_FW_BUFFER_HEAD) + sizeof (UINT32);
+
+  return Status;
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareFreeBatch (
+  IN  RPI_FW_BATCH  *Batch
+  )
+{
+  if (Batch == NULL) {
+    return;
+  }
+
+  FreePool (Batch->Tags);
+  FreePool (Batch);
+}
+
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mRpiFirmwareProtocol = {
   RpiFirmwareSetPowerState,
   RpiFirmwareGetMacAddress,
@@ -1477,6 +1830,11 @@ STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mRpiFirmwareProtocol = {
   RpiFirmwareNotifyGpioSetCfg,
   RpiFirmwareGetRtc,
   RpiFirmwareSetRtc,
+  RpiFirmwareNotifyActivity,
+  RpiFirmwareCreateBatch,
+  RpiFirmwareBatchAddTag,
+  RpiFirmwareSubmitBatch,
+  RpiFirmwareFreeBatch,
 };
 
 STATIC
@@ -1543,6 +1901,30 @@ RpiFirmwareDxeInitialize (
   //
   ASSERT (!(mDmaBufferBusAddress & (BCM2836_MBOX_NUM_CHANNELS - 1)));
 
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                  RpiFirmwareActivityLedTimer, NULL, &mActivityLedEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to create activity LED event. Status=%r\n",
+            __func__, Status));
+    goto UnmapBuffer;
+  }
+
+  Status = gBS->SetTimer (mActivityLedEvent, TimerPeriodic, ACTIVITY_LED_PERIOD);
+  ASSERT_EFI_ERROR (Status);
+
+  Status = gBS->CreateEventEx (
+                  EVT_NOTIFY_SIGNAL,
+                  TPL_NOTIFY,
+                  RpiFirmwareActivityLedExitBootServices,
+                  NULL,
+                  &gEfiEventExitBootServicesGuid,
+                  &mActivityLedExitBootServicesEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to register for ExitBootServices. Status=%r\n",
+            __func__, Status));
+    goto CloseLedEvent;
+  }
+
   Status = gBS->InstallProtocolInterface (&ImageHandle,
                   &gRaspberryPiFirmwareProtocolGuid, EFI_NATIVE_INTERFACE,
                   &mRpiFirmwareProtocol);
@@ -1550,7 +1932,7 @@ RpiFirmwareDxeInitialize (
     DEBUG ((DEBUG_ERROR,
       "%a: failed to install RPI firmware protocol (Status == %r)\n",
       __FUNCTION__, Status));
-    goto UnmapBuffer;
+    goto CloseExitBootServicesEvent;
   }
 
   AlignedMboxAddress = mMboxBaseAddress & ~(EFI_PAGE_SIZE - 1);
@@ -1563,7 +1945,7 @@ RpiFirmwareDxeInitialize (
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a: AddMemorySpace failed. Status=%r\n",
             __FUNCTION__, Status));
-    goto UnmapBuffer;
+    goto CloseExitBootServicesEvent;
   }
 
   Status = gDS->SetMemorySpaceAttributes (
@@ -1573,7 +1955,7 @@ RpiFirmwareDxeInitialize (
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a: SetMemorySpaceAttributes failed. Status=%r\n",
             __FUNCTION__, Status));
-    goto UnmapBuffer;
+    goto CloseExitBootServicesEvent;
   }
 
   Status = gBS->CreateEventEx (
@@ -1586,11 +1968,15 @@ RpiFirmwareDxeInitialize (
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a: failed to register for virtual address change. Status=%r\n",
             __func__, Status));
-    goto UnmapBuffer;
+    goto CloseExitBootServicesEvent;
   }
 
   return EFI_SUCCESS;
 
+CloseExitBootServicesEvent:
+  gBS->CloseEvent (mActivityLedExitBootServicesEvent);
+CloseLedEvent:
+  gBS->CloseEvent (mActivityLedEvent);
 UnmapBuffer:
   DmaUnmap (mDmaBufferMapping);
 FreeBuffer:
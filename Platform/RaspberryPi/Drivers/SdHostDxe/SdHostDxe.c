@@ -28,8 +28,10 @@
 #include <IndustryStandard/Bcm2836.h>
 #include <IndustryStandard/RpiMbox.h>
 #include <IndustryStandard/Bcm2836SdHost.h>
+#include <IndustryStandard/Bcm2836Dma.h>
 
 #define SDHOST_BLOCK_BYTE_LENGTH            512
+#define SDHOST_MAX_BLOCK_COUNT              0xFFFF
 
 // Driver Timing Parameters
 #define CMD_STALL_AFTER_POLL_US             1
@@ -42,6 +44,15 @@
 
 #define IDENT_MODE_SD_CLOCK_FREQ_HZ         400000 // 400KHz
 
+// DMA Parameters
+#define SDHOST_DMA_CHANNEL                  4 // Not used by the VPU firmware
+#define SDHOST_DMA_REG(X)                   (BCM2836_DMA_CHANNEL_BASE_ADDRESS (SDHOST_DMA_CHANNEL) + (X))
+#define SDHOST_DATA_BUS_ADDRESS             (BCM2836_DMA_PERIPHERAL_BUS_ADDRESS + SDHOST_OFFSET + 0x40)
+#define SDHOST_FIFO_THRESHOLD               4 // In words, for DREQ
+#define SDHOST_DMA_READ_DRAIN_BYTES         (SDHOST_FIFO_THRESHOLD * 4)
+#define DMA_MAX_POLL_COUNT                  1000000
+#define DMA_STALL_AFTER_POLL_US             1
+
 // Macros adopted from MmcDxe internal header
 #define SDHOST_R0_READY_FOR_DATA            BIT8
 #define SDHOST_R0_CURRENTSTATE(Response)    ((Response >> 9) & 0xF)
@@ -52,6 +63,11 @@
 
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL   *mFwProtocol;
 
+STATIC BOOLEAN                          mUseDma;
+STATIC BCM2836_DMA_CONTROL_BLOCK        *mDmaControlBlock;
+STATIC EFI_PHYSICAL_ADDRESS             mDmaControlBlockBusAddress;
+STATIC VOID                             *mDmaControlBlockMapping;
+
 // Per Physical Layer Simplified Specs
 #ifndef NDEBUG
 STATIC CONST CHAR8* mStrSdState[] = { "idle", "ready", "ident", "stby",
@@ -67,6 +83,7 @@ STATIC CONST CHAR8 *mFsmState[] = { "identmode", "datamode", "readdata",
 STATIC BOOLEAN mCardIsPresent = FALSE;
 STATIC CARD_DETECT_STATE mCardDetectState = CardDetectRequired;
 STATIC UINT32 mLastGoodCmd = MMC_GET_INDX (MMC_CMD0);
+STATIC UINT32 mSetBlockCount;
 
 STATIC inline BOOLEAN
 IsAppCmd (
@@ -359,6 +376,21 @@ SdSendCommand (
     } else {
       MmioWrite32 (SDHOST_HBCT, SDHOST_BLOCK_BYTE_LENGTH);
     }
+
+    if (mLastGoodCmd == MMC_CMD23 &&
+        (MmcCmd == MMC_CMD18 || MmcCmd == MMC_CMD25)) {
+      /*
+       * Pre-defined multiple block transfer, the card
+       * stops after the CMD23 block count.
+       */
+      MmioWrite32 (SDHOST_HBLC, mSetBlockCount);
+    } else {
+      MmioWrite32 (SDHOST_HBLC, 0);
+    }
+  }
+
+  if (MmcCmd == MMC_CMD23 && !IsAppCmd ()) {
+    mSetBlockCount = Argument & SDHOST_MAX_BLOCK_COUNT;
   }
 
   DEBUG ((DEBUG_MMCHOST_SD,
@@ -495,6 +527,206 @@ SdReceiveResponse (
   return EFI_SUCCESS;
 }
 
+STATIC EFI_STATUS
+SdHostPioRead (
+  IN  UINTN   NumWords,
+  OUT UINT32  *Buffer
+  )
+{
+  UINTN WordIdx;
+
+  for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
+    UINT32 PollCount = 0;
+    while (PollCount < FIFO_MAX_POLL_COUNT) {
+      UINT32 Hsts = MmioRead32 (SDHOST_HSTS);
+      if ((Hsts & SDHOST_HSTS_DATA_FLAG) != 0) {
+        MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_DATA_FLAG);
+        Buffer[WordIdx] = MmioRead32 (SDHOST_DATA);
+        break;
+      }
+
+      ++PollCount;
+      gBS->Stall (CMD_STALL_AFTER_RETRY_US);
+    }
+
+    if (PollCount == FIFO_MAX_POLL_COUNT) {
+      DEBUG ((DEBUG_MMCHOST_SD_ERROR,
+          "SdHost: SdReadBlockData(): Block Word%d read poll timed-out\n", WordIdx));
+      SdHostDumpStatus ();
+      MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+      return EFI_TIMEOUT;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+SdHostPioWrite (
+  IN UINTN   NumWords,
+  IN UINT32  *Buffer
+  )
+{
+  UINTN WordIdx;
+
+  for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
+    UINT32 PollCount = 0;
+    while (PollCount < FIFO_MAX_POLL_COUNT) {
+      if (MmioRead32 (SDHOST_HSTS) & SDHOST_HSTS_DATA_FLAG) {
+        MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_DATA_FLAG);
+        MmioWrite32 (SDHOST_DATA, Buffer[WordIdx]);
+        break;
+      }
+
+      ++PollCount;
+      gBS->Stall (CMD_STALL_AFTER_RETRY_US);
+    }
+
+    if (PollCount == FIFO_MAX_POLL_COUNT) {
+      DEBUG ((DEBUG_MMCHOST_SD_ERROR,
+        "SdHost: SdWriteBlockData(): Block Word%d write poll timed-out\n", WordIdx));
+      SdHostDumpStatus ();
+      MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+      return EFI_TIMEOUT;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Moves TransferLength bytes between the FIFO and Buffer using the DMA engine,
+   paced by the SdHost DREQ. Buffer is mapped for MapLength bytes, which lets
+   the caller keep the mapping cache line-aligned (and thus bounce-free) while
+   transferring less.
+
+   Returns EFI_UNSUPPORTED without touching the FIFO if the buffer can't
+   be used for DMA, in which case the caller should fall back to PIO.
+**/
+STATIC EFI_STATUS
+SdHostDmaTransfer (
+  IN     BOOLEAN  IsRead,
+  IN     UINTN    MapLength,
+  IN     UINTN    TransferLength,
+  IN OUT UINT32   *Buffer
+  )
+{
+  EFI_STATUS            Status;
+  EFI_PHYSICAL_ADDRESS  BusAddress;
+  VOID                  *Mapping;
+  UINTN                 MappedLength;
+  UINT32                PollCount;
+  UINT32                Cs;
+  UINT32                Debug;
+
+  MappedLength = MapLength;
+  Status = DmaMap (IsRead ? MapOperationBusMasterWrite : MapOperationBusMasterRead,
+             Buffer, &MappedLength, &BusAddress, &Mapping);
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (MappedLength != MapLength ||
+      (BusAddress + MapLength) > BIT32) {
+    DmaUnmap (Mapping);
+    return EFI_UNSUPPORTED;
+  }
+
+  if (IsRead) {
+    mDmaControlBlock->TransferInformation = BCM2836_DMA_TI_SRC_DREQ |
+                                            BCM2836_DMA_TI_DEST_INC;
+    mDmaControlBlock->SourceAddress = SDHOST_DATA_BUS_ADDRESS;
+    mDmaControlBlock->DestinationAddress = (UINT32)BusAddress;
+  } else {
+    mDmaControlBlock->TransferInformation = BCM2836_DMA_TI_DEST_DREQ |
+                                            BCM2836_DMA_TI_SRC_INC;
+    mDmaControlBlock->SourceAddress = (UINT32)BusAddress;
+    mDmaControlBlock->DestinationAddress = SDHOST_DATA_BUS_ADDRESS;
+  }
+  mDmaControlBlock->TransferInformation |= BCM2836_DMA_TI_WAIT_RESP |
+    BCM2836_DMA_TI_PERMAP (BCM2836_DMA_DREQ_SDHOST);
+  mDmaControlBlock->TransferLength = TransferLength;
+  mDmaControlBlock->Stride = 0;
+  mDmaControlBlock->NextControlBlockAddress = 0;
+
+  MemoryFence ();
+  MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_CONBLK_AD), (UINT32)mDmaControlBlockBusAddress);
+  MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_CS), BCM2836_DMA_CS_ACTIVE |
+    BCM2836_DMA_CS_PRIORITY (8) | BCM2836_DMA_CS_PANIC_PRIORITY (15) |
+    BCM2836_DMA_CS_WAIT_FOR_OUTSTANDING_WRITES);
+
+  for (PollCount = 0; PollCount < DMA_MAX_POLL_COUNT; PollCount++) {
+    Cs = MmioRead32 (SDHOST_DMA_REG (BCM2836_DMA_CS));
+    if ((Cs & BCM2836_DMA_CS_ACTIVE) == 0) {
+      break;
+    }
+
+    /*
+     * A failed data transfer won't ever pace the DMA to completion.
+     */
+    if ((MmioRead32 (SDHOST_HSTS) & SDHOST_HSTS_ERROR) != 0) {
+      break;
+    }
+
+    gBS->Stall (DMA_STALL_AFTER_POLL_US);
+  }
+
+  if ((Cs & BCM2836_DMA_CS_ACTIVE) != 0) {
+    DEBUG ((DEBUG_MMCHOST_SD_ERROR,
+      "SdHost: SdHostDmaTransfer(): %a of 0x%x bytes did not complete, CS 0x%x TXFR_LEN 0x%x\n",
+      IsRead ? "read" : "write", TransferLength, Cs,
+      MmioRead32 (SDHOST_DMA_REG (BCM2836_DMA_TXFR_LEN))));
+    SdHostDumpStatus ();
+    MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_CS), BCM2836_DMA_CS_RESET);
+    MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+    Status = EFI_TIMEOUT;
+  } else if ((Cs & BCM2836_DMA_CS_ERROR) != 0) {
+    Debug = MmioRead32 (SDHOST_DMA_REG (BCM2836_DMA_DEBUG));
+    DEBUG ((DEBUG_MMCHOST_SD_ERROR,
+      "SdHost: SdHostDmaTransfer(): DMA error, CS 0x%x DEBUG 0x%x\n", Cs, Debug));
+    MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_DEBUG), Debug & BCM2836_DMA_DEBUG_ERRORS);
+    MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_CS), BCM2836_DMA_CS_RESET);
+    Status = EFI_DEVICE_ERROR;
+  } else {
+    Status = EFI_SUCCESS;
+  }
+
+  MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_CS), BCM2836_DMA_CS_END | BCM2836_DMA_CS_INT);
+  DmaUnmap (Mapping);
+
+  return Status;
+}
+
+STATIC EFI_STATUS
+SdHostDmaInitialize (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+  UINTN      BufferSize;
+
+  Status = DmaAllocateBuffer (EfiBootServicesData, 1, (VOID**)&mDmaControlBlock);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "SdHost: DmaAllocateBuffer: %r\n", Status));
+    return Status;
+  }
+
+  BufferSize = EFI_PAGES_TO_SIZE (1);
+  Status = DmaMap (MapOperationBusMasterCommonBuffer, mDmaControlBlock, &BufferSize,
+             &mDmaControlBlockBusAddress, &mDmaControlBlockMapping);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "SdHost: DmaMap: %r\n", Status));
+    DmaFreeBuffer (1, mDmaControlBlock);
+    mDmaControlBlock = NULL;
+    return Status;
+  }
+
+  MmioOr32 (BCM2836_DMA_ENABLE, 1 << SDHOST_DMA_CHANNEL);
+  MmioWrite32 (SDHOST_DMA_REG (BCM2836_DMA_CS), BCM2836_DMA_CS_RESET);
+
+  return EFI_SUCCESS;
+}
+
 STATIC EFI_STATUS
 SdReadBlockData (
   IN EFI_MMC_HOST_PROTOCOL    *This,
@@ -509,38 +741,24 @@ SdReadBlockData (
   ASSERT (Buffer != NULL);
   ASSERT (Length % 4 == 0);
 
-  EFI_STATUS Status = EFI_SUCCESS;
-
-  mFwProtocol->SetLed (TRUE);
-  {
-    UINT32 NumWords = Length / 4;
-    UINT32 WordIdx;
-
-    for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
-      UINT32 PollCount = 0;
-      while (PollCount < FIFO_MAX_POLL_COUNT) {
-        UINT32 Hsts = MmioRead32 (SDHOST_HSTS);
-        if ((Hsts & SDHOST_HSTS_DATA_FLAG) != 0) {
-          MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_DATA_FLAG);
-          Buffer[WordIdx] = MmioRead32 (SDHOST_DATA);
-          break;
-        }
-
-        ++PollCount;
-        gBS->Stall (CMD_STALL_AFTER_RETRY_US);
-      }
-
-      if (PollCount == FIFO_MAX_POLL_COUNT) {
-        DEBUG ((DEBUG_MMCHOST_SD_ERROR,
-            "SdHost: SdReadBlockData(): Block Word%d read poll timed-out\n", WordIdx));
-        SdHostDumpStatus ();
-        MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_CLEAR);
-        Status = EFI_TIMEOUT;
-        break;
-      }
+  EFI_STATUS Status = EFI_UNSUPPORTED;
+
+  mFwProtocol->NotifyActivity ();
+  if (mUseDma && Length >= SDHOST_BLOCK_BYTE_LENGTH) {
+    /*
+     * The last few words never raise the DREQ, so leave
+     * them out of the DMA and drain them from the FIFO.
+     */
+    Status = SdHostDmaTransfer (TRUE, Length, Length - SDHOST_DMA_READ_DRAIN_BYTES, Buffer);
+    if (!EFI_ERROR (Status)) {
+      Status = SdHostPioRead (SDHOST_DMA_READ_DRAIN_BYTES / 4,
+                 Buffer + (Length - SDHOST_DMA_READ_DRAIN_BYTES) / 4);
     }
   }
-  mFwProtocol->SetLed (FALSE);
+
+  if (Status == EFI_UNSUPPORTED) {
+    Status = SdHostPioRead (Length / 4, Buffer);
+  }
 
   return Status;
 }
@@ -560,37 +778,16 @@ SdWriteBlockData (
   ASSERT (Buffer != NULL);
   ASSERT (Length % SDHOST_BLOCK_BYTE_LENGTH == 0);
 
-  EFI_STATUS Status = EFI_SUCCESS;
+  EFI_STATUS Status = EFI_UNSUPPORTED;
 
-  mFwProtocol->SetLed (TRUE);
-  {
-    UINT32 NumWords = Length / 4;
-    UINT32 WordIdx;
-
-    for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
-      UINT32 PollCount = 0;
-      while (PollCount < FIFO_MAX_POLL_COUNT) {
-        if (MmioRead32 (SDHOST_HSTS) & SDHOST_HSTS_DATA_FLAG) {
-          MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_DATA_FLAG);
-          MmioWrite32 (SDHOST_DATA, Buffer[WordIdx]);
-          break;
-        }
-
-        ++PollCount;
-        gBS->Stall (CMD_STALL_AFTER_RETRY_US);
-      }
+  mFwProtocol->NotifyActivity ();
+  if (mUseDma) {
+    Status = SdHostDmaTransfer (FALSE, Length, Length, Buffer);
+  }
 
-      if (PollCount == FIFO_MAX_POLL_COUNT) {
-        DEBUG ((DEBUG_MMCHOST_SD_ERROR,
-          "SdHost: SdWriteBlockData(): Block Word%d write poll timed-out\n", WordIdx));
-        SdHostDumpStatus ();
-        MmioWrite32 (SDHOST_HSTS, SDHOST_HSTS_CLEAR);
-        Status = EFI_TIMEOUT;
-        break;
-      }
-    }
+  if (Status == EFI_UNSUPPORTED) {
+    Status = SdHostPioWrite (Length / 4, Buffer);
   }
-  mFwProtocol->SetLed (FALSE);
 
   return Status;
 }
@@ -672,6 +869,16 @@ SdNotifyState (
     Hcfg |= SDHOST_HCFG_SLOW_CARD; // Use all bits of CDIV in DataMode
     MmioWrite32 (SDHOST_HCFG, Hcfg);
 
+    if (mUseDma) {
+      // FIFO fill levels at which the DMA DREQ is raised
+      UINT32 Edm = MmioRead32 (SDHOST_EDM);
+      Edm &= ~(SDHOST_EDM_READ_THRESHOLD (SDHOST_EDM_THRESHOLD_MASK) |
+               SDHOST_EDM_WRITE_THRESHOLD (SDHOST_EDM_THRESHOLD_MASK));
+      Edm |= SDHOST_EDM_READ_THRESHOLD (SDHOST_FIFO_THRESHOLD) |
+             SDHOST_EDM_WRITE_THRESHOLD (SDHOST_FIFO_THRESHOLD);
+      MmioWrite32 (SDHOST_EDM, Edm);
+    }
+
     // Set default clock frequency
     EFI_STATUS Status = SdHostSetClockFrequency (IDENT_MODE_SD_CLOCK_FREQ_HZ);
     if (EFI_ERROR (Status)) {
@@ -787,6 +994,14 @@ SdIsMultiBlock (
   return TRUE;
 }
 
+UINT32
+SdGetMaxBlockCount (
+  IN EFI_MMC_HOST_PROTOCOL *This
+  )
+{
+  return SDHOST_MAX_BLOCK_COUNT;
+}
+
 EFI_MMC_HOST_PROTOCOL gMmcHost =
   {
     MMC_HOST_PROTOCOL_REVISION,
@@ -799,7 +1014,8 @@ EFI_MMC_HOST_PROTOCOL gMmcHost =
     SdReadBlockData,
     SdWriteBlockData,
     SdSetIos,
-    SdIsMultiBlock
+    SdIsMultiBlock,
+    SdGetMaxBlockCount
   };
 
 EFI_STATUS
@@ -831,6 +1047,16 @@ SdHostInitialize (
   DEBUG ((DEBUG_MMCHOST_SD, " - CMD_MAX_RETRY_COUNT=%d\n", CMD_MAX_RETRY_COUNT));
   DEBUG ((DEBUG_MMCHOST_SD, " - CMD_STALL_AFTER_RETRY_US=%dus\n", CMD_STALL_AFTER_RETRY_US));
 
+  if (PcdGet32 (PcdSdHostEnableDma)) {
+    Status = SdHostDmaInitialize ();
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "SdHost: Couldn't set up DMA, using PIO: %r\n", Status));
+    } else {
+      mUseDma = TRUE;
+    }
+  }
+  DEBUG ((DEBUG_MMCHOST_SD_INFO, "SdHost: Using %a\n", mUseDma ? "DMA" : "PIO"));
+
   Status = gBS->InstallMultipleProtocolInterfaces (
     &Handle,
     &gRaspberryPiMmcHostProtocolGuid,
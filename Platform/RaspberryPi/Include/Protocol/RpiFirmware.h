@@ -26,6 +26,12 @@ typedef enum {
 	RpiRtcBatteryVoltage,
 } RASPBERRY_PI_RTC_REGISTER;
 
+/*
+ * A list of property tags, submitted to the VideoCore in a single
+ * mailbox transaction. Only usable before ExitBootServices ().
+ */
+typedef struct _RPI_FW_BATCH RPI_FW_BATCH;
+
 typedef
 EFI_STATUS
 (EFIAPI *SET_POWER_STATE) (
@@ -106,6 +112,17 @@ VOID
   BOOLEAN On
   );
 
+/*
+ * Signals I/O activity, to be shown on the activity LED. This doesn't
+ * touch the mailbox, and can be called for every I/O request: the LED
+ * is updated asynchronously, at most a few times per second.
+ */
+typedef
+VOID
+(EFIAPI *NOTIFY_ACTIVITY) (
+  VOID
+  );
+
 typedef
 EFI_STATUS
 (EFIAPI *GET_SERIAL) (
@@ -167,6 +184,45 @@ EFI_STATUS
   IN   UINT32                     Value
   );
 
+typedef
+EFI_STATUS
+(EFIAPI *BATCH_CREATE) (
+  OUT  RPI_FW_BATCH  **Batch
+  );
+
+/*
+ * Queues a property tag. Value holds ValueSize bytes of request data, and
+ * receives the response when the batch is submitted, so it must remain
+ * valid until then. If TagStatus is not NULL, it is EFI_NOT_READY until the
+ * batch is submitted, and then EFI_SUCCESS if the firmware handled this tag,
+ * or an error if not.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *BATCH_ADD_TAG) (
+  IN      RPI_FW_BATCH  *Batch,
+  IN      UINT32        TagId,
+  IN OUT  VOID          *Value,
+  IN      UINT32        ValueSize,
+  OUT     EFI_STATUS    *TagStatus  OPTIONAL
+  );
+
+/*
+ * Submits all the queued tags in one transaction, and empties the batch
+ * so it can be reused.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *BATCH_SUBMIT) (
+  IN  RPI_FW_BATCH  *Batch
+  );
+
+typedef
+VOID
+(EFIAPI *BATCH_FREE) (
+  IN  RPI_FW_BATCH  *Batch
+  );
+
 typedef struct {
   SET_POWER_STATE        SetPowerState;
   GET_MAC_ADDRESS        GetMacAddress;
@@ -190,6 +246,11 @@ typedef struct {
   GPIO_SET_CFG           SetGpioConfig;
   GET_RTC                GetRtc;
   SET_RTC                SetRtc;
+  NOTIFY_ACTIVITY        NotifyActivity;
+  BATCH_CREATE           CreateBatch;
+  BATCH_ADD_TAG          BatchAddTag;
+  BATCH_SUBMIT           SubmitBatch;
+  BATCH_FREE             FreeBatch;
 } RASPBERRY_PI_FIRMWARE_PROTOCOL;
 
 extern EFI_GUID gRaspberryPiFirmwareProtocolGuid;
@@ -178,6 +178,18 @@ BOOLEAN
   IN  EFI_MMC_HOST_PROTOCOL     *This
   );
 
+/*
+ * Returns the largest number of blocks the host can move with
+ * a single CMD18/CMD25. Hosts implementing this also honour a
+ * preceding CMD23 (SET_BLOCK_COUNT), so that the transfer ends
+ * without a CMD12.
+ */
+typedef
+UINT32
+(EFIAPI *MMC_GETMAXBLOCKCOUNT) (
+  IN  EFI_MMC_HOST_PROTOCOL     *This
+  );
+
 struct _EFI_MMC_HOST_PROTOCOL {
   UINT32                  Revision;
   MMC_ISCARDPRESENT       IsCardPresent;
@@ -194,13 +206,19 @@ struct _EFI_MMC_HOST_PROTOCOL {
 
   MMC_SETIOS              SetIos;
   MMC_ISMULTIBLOCK        IsMultiBlock;
+
+  MMC_GETMAXBLOCKCOUNT    GetMaxBlockCount;
 };
 
-#define MMC_HOST_PROTOCOL_REVISION    0x00010002    // 1.2
+#define MMC_HOST_PROTOCOL_REVISION_1_2  0x00010002    // 1.2
+#define MMC_HOST_PROTOCOL_REVISION_1_3  0x00010003    // 1.3
+#define MMC_HOST_PROTOCOL_REVISION      MMC_HOST_PROTOCOL_REVISION_1_3
 
-#define MMC_HOST_HAS_SETIOS(Host)       (Host->Revision >= MMC_HOST_PROTOCOL_REVISION && \
+#define MMC_HOST_HAS_SETIOS(Host)       (Host->Revision >= MMC_HOST_PROTOCOL_REVISION_1_2 && \
                                          Host->SetIos != NULL)
-#define MMC_HOST_HAS_ISMULTIBLOCK(Host) (Host->Revision >= MMC_HOST_PROTOCOL_REVISION && \
+#define MMC_HOST_HAS_ISMULTIBLOCK(Host) (Host->Revision >= MMC_HOST_PROTOCOL_REVISION_1_2 && \
                                          Host->IsMultiBlock != NULL)
+#define MMC_HOST_HAS_GETMAXBLOCKCOUNT(Host) (Host->Revision >= MMC_HOST_PROTOCOL_REVISION_1_3 && \
+                                             Host->GetMaxBlockCount != NULL)
 
 #endif /* __RASPBERRY_PI_MMC_HOST_PROTOCOL_H__ */
@@ -0,0 +1,78 @@
+/** @file
+ *
+ *  BCM283x DMA controller registers and control block layout.
+ *
+ *  Copyright (c) 2026, edk2-platforms contributors. All rights reserved.
+ *
+ *  SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ **/
+
+#ifndef __BCM2836_DMA_H__
+#define __BCM2836_DMA_H__
+
+#include <IndustryStandard/Bcm2836.h>
+
+/* DMA controller constants, for the full (non-lite) channels 0-6 */
+
+#define BCM2836_DMA_CHANNEL_BASE_ADDRESS(Channel)           (BCM2836_DMA0_BASE_ADDRESS + \
+                                                             (Channel) * BCM2836_DMA_CHANNEL_LENGTH)
+
+#define BCM2836_DMA_CS                                      0x00000000
+#define BCM2836_DMA_CONBLK_AD                               0x00000004
+#define BCM2836_DMA_TI                                      0x00000008
+#define BCM2836_DMA_SOURCE_AD                               0x0000000c
+#define BCM2836_DMA_DEST_AD                                 0x00000010
+#define BCM2836_DMA_TXFR_LEN                                0x00000014
+#define BCM2836_DMA_STRIDE                                  0x00000018
+#define BCM2836_DMA_NEXTCONBK                               0x0000001c
+#define BCM2836_DMA_DEBUG                                   0x00000020
+
+#define BCM2836_DMA_ENABLE                                  (BCM2836_DMA_CTRL_BASE_ADDRESS + 0x10)
+
+/* CS */
+#define BCM2836_DMA_CS_ACTIVE                               BIT0
+#define BCM2836_DMA_CS_END                                  BIT1
+#define BCM2836_DMA_CS_INT                                  BIT2
+#define BCM2836_DMA_CS_ERROR                                BIT8
+#define BCM2836_DMA_CS_PRIORITY(X)                          (((X) & 0xf) << 16)
+#define BCM2836_DMA_CS_PANIC_PRIORITY(X)                    (((X) & 0xf) << 20)
+#define BCM2836_DMA_CS_WAIT_FOR_OUTSTANDING_WRITES          BIT28
+#define BCM2836_DMA_CS_ABORT                                BIT30
+#define BCM2836_DMA_CS_RESET                                BIT31
+
+/* TI */
+#define BCM2836_DMA_TI_INTEN                                BIT0
+#define BCM2836_DMA_TI_WAIT_RESP                            BIT3
+#define BCM2836_DMA_TI_DEST_INC                             BIT4
+#define BCM2836_DMA_TI_DEST_DREQ                            BIT6
+#define BCM2836_DMA_TI_SRC_INC                              BIT8
+#define BCM2836_DMA_TI_SRC_DREQ                             BIT10
+#define BCM2836_DMA_TI_PERMAP(X)                            (((X) & 0x1f) << 16)
+
+/* DEBUG, write 1 to clear */
+#define BCM2836_DMA_DEBUG_READ_LAST_NOT_SET_ERROR           BIT0
+#define BCM2836_DMA_DEBUG_FIFO_ERROR                        BIT1
+#define BCM2836_DMA_DEBUG_READ_ERROR                        BIT2
+#define BCM2836_DMA_DEBUG_ERRORS                            (BCM2836_DMA_DEBUG_READ_LAST_NOT_SET_ERROR | \
+                                                             BCM2836_DMA_DEBUG_FIFO_ERROR | \
+                                                             BCM2836_DMA_DEBUG_READ_ERROR)
+
+/* Peripheral DREQ lines, for BCM2836_DMA_TI_PERMAP */
+#define BCM2836_DMA_DREQ_SDHOST                             13
+
+/* Peripherals, as seen by the DMA engine */
+#define BCM2836_DMA_PERIPHERAL_BUS_ADDRESS                  0x7e000000
+
+/* Control block, must be 32-byte aligned */
+typedef struct {
+  UINT32  TransferInformation;
+  UINT32  SourceAddress;
+  UINT32  DestinationAddress;
+  UINT32  TransferLength;
+  UINT32  Stride;
+  UINT32  NextControlBlockAddress;
+  UINT32  Reserved[2];
+} BCM2836_DMA_CONTROL_BLOCK;
+
+#endif /* __BCM2836_DMA_H__ */
@@ -25,6 +25,7 @@
 #define MMCHS_ARG         (mMmcHsBase + 0x8)
 
 #define MMCHS_CMD         (mMmcHsBase + 0xC)
+#define DE_ENABLE         BIT0
 #define BCE_ENABLE        BIT1
 #define DDIR_READ         BIT4
 #define DDIR_WRITE        (0x0UL << 4)
@@ -64,6 +65,8 @@
 #define MMCHS_HCTL        (mMmcHsBase + 0x28)
 #define DTW_1_BIT         (0x0UL << 1)
 #define DTW_4_BIT         BIT1
+#define DMAS_MASK         (0x3UL << 3)
+#define DMAS_ADMA2_32     (0x2UL << 3)
 #define SDBP_MASK         BIT8
 #define SDBP_OFF          (0x0UL << 8)
 #define SDBP_ON           BIT8
@@ -92,6 +95,7 @@
 #define MMCHS_INT_STAT    (mMmcHsBase + 0x30)
 #define CC                BIT0
 #define TC                BIT1
+#define DMA_INT           BIT3
 #define BWR               BIT4
 #define BRR               BIT5
 #define CARD_INS          BIT6
@@ -100,6 +104,7 @@
 #define DTO               BIT20
 #define DCRC              BIT21
 #define DEB               BIT22
+#define ADMAE             BIT25
 
 #define MMCHS_IE          (mMmcHsBase + 0x34)
 #define CC_EN             BIT0
@@ -136,10 +141,14 @@
 #define MMCHS_HC2R        (mMmcHsBase + 0x3E)
 
 #define MMCHS_CAPA        (mMmcHsBase + 0x40)
+#define ADMA2S            BIT19
+#define SDMAS             BIT22
 #define VS30              BIT25
 #define VS18              BIT26
 
 #define MMCHS_CUR_CAPA    (mMmcHsBase + 0x48)
+#define MMCHS_ADMA_ES     (mMmcHsBase + 0x54)
+#define MMCHS_ADMA_SAR    (mMmcHsBase + 0x58)
 #define MMCHS_REV         (mMmcHsBase + 0xFC)
 
 #define BLOCK_COUNT_SHIFT 16
@@ -53,6 +53,7 @@
 
 #define GENET_VERSION                           0x0a
 #define GENET_MAX_PACKET_SIZE                   1536
+#define GENET_TX_BOUNCE_SIZE                    256
 
 #define GENET_SYS_REV_CTRL                      0x000
 #define  SYS_REV_MAJOR                          (BIT27|BIT26|BIT25|BIT24)
@@ -222,9 +223,17 @@ typedef struct {
   UINT16                              TxNext;
   UINT16                              TxConsIndex;
   UINT16                              TxProdIndex;
+  UINT16                              TxDoorbellIndex;
+
+  UINT8                               *TxBounceBuffer;
+  GENET_MAP_INFO                      TxBounceMap;
+
+  VOID                                *TxRecycle[GENET_DMA_DESC_COUNT];
+  UINT16                              TxRecycleNext;
+  UINT16                              TxRecycleCount;
 
   EFI_PHYSICAL_ADDRESS                RxBuffer;
-  GENET_MAP_INFO                      RxBufferMap[GENET_DMA_DESC_COUNT];
+  GENET_MAP_INFO                      RxBufferMap;
   UINT16                              RxConsIndex;
   UINT16                              RxProdIndex;
 
@@ -245,6 +254,7 @@ extern CONST EFI_ADAPTER_INFORMATION_PROTOCOL gGenetAdapterInfoTemplate;
 #define GENET_PRIVATE_DATA_FROM_AIP_THIS(a)   CR(a, GENET_PRIVATE_DATA, Aip, GENET_DRIVER_SIGNATURE)
 
 #define GENET_RX_BUFFER(g, idx)               ((UINT8 *)(UINTN)(g)->RxBuffer + GENET_MAX_PACKET_SIZE * (idx))
+#define GENET_TX_BOUNCE_BUFFER(g, idx)        ((g)->TxBounceBuffer + GENET_TX_BOUNCE_SIZE * (idx))
 
 EFI_STATUS
 EFIAPI
@@ -342,15 +352,23 @@ GenetDmaTriggerTx (
   );
 
 EFI_STATUS
-GenetDmaMapRxDescriptor (
-  IN GENET_PRIVATE_DATA *Genet,
-  IN UINT8              DescIndex
+GenetDmaMapRxBuffers (
+  IN GENET_PRIVATE_DATA *Genet
   );
 
 VOID
-GenetDmaUnmapRxDescriptor (
-  IN GENET_PRIVATE_DATA *Genet,
-  IN UINT8               DescIndex
+GenetDmaUnmapRxBuffers (
+  IN GENET_PRIVATE_DATA *Genet
+  );
+
+VOID
+GenetDmaFlushTx (
+  IN GENET_PRIVATE_DATA *Genet
+  );
+
+VOID
+GenetTxReclaim (
+  IN GENET_PRIVATE_DATA *Genet
   );
 
 VOID
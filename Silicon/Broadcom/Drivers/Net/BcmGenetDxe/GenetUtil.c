@@ -7,6 +7,7 @@
 **/
 
 #include <Uefi.h>
+#include <Library/CacheMaintenanceLib.h>
 #include <Library/DebugLib.h>
 #include <Library/DmaLib.h>
 #include <Library/IoLib.h>
@@ -16,6 +17,16 @@
 
 #define GENET_PHY_RETRY     1000
 
+//
+// Consumed RX descriptors are handed back to the hardware in batches.
+//
+#define GENET_RX_RELEASE_BATCH  32
+
+//
+// Upper bound on the TX frames queued without a doorbell write.
+//
+#define GENET_TX_DOORBELL_BATCH 8
+
 STATIC CONST
 EFI_PHYSICAL_ADDRESS   mDmaAddressLimit = FixedPcdGet64 (PcdDmaDeviceLimit) -
                                           FixedPcdGet64 (PcdDmaDeviceOffset);
@@ -547,6 +558,9 @@ GenetDmaInitRings (
   Genet->TxNext = 0;
   Genet->TxConsIndex = 0;
   Genet->TxProdIndex = 0;
+  Genet->TxDoorbellIndex = 0;
+  Genet->TxRecycleNext = 0;
+  Genet->TxRecycleCount = 0;
 
   Genet->RxConsIndex = 0;
   Genet->RxProdIndex = 0;
@@ -598,7 +612,7 @@ GenetDmaInitRings (
 }
 
 /**
-  Allocate DMA buffers for RX.
+  Allocate DMA buffers for RX, and the TX bounce buffers.
 
   @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
 
@@ -611,6 +625,7 @@ GenetDmaAlloc (
   )
 {
   EFI_STATUS              Status;
+  UINTN                   DmaNumberOfBytes;
 
   Genet->RxBuffer = mDmaAddressLimit;
   Status = gBS->AllocatePages (AllocateMaxAddress, EfiBootServicesData,
@@ -619,69 +634,114 @@ GenetDmaAlloc (
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR,
       "%a: Failed to allocate RX buffer: %r\n", __FUNCTION__, Status));
+    return Status;
+  }
+
+  //
+  // Small frames are copied into these rather than mapped for DMA, as a copy
+  // into uncached memory is cheaper than the cache maintenance and bookkeeping
+  // of a DmaMap.
+  //
+  Status = DmaAllocateBuffer (EfiBootServicesData,
+             EFI_SIZE_TO_PAGES (GENET_TX_BOUNCE_SIZE * GENET_DMA_DESC_COUNT),
+             (VOID **)&Genet->TxBounceBuffer);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: Failed to allocate TX bounce buffer: %r\n", __FUNCTION__, Status));
+    goto FreeRxBuffer;
+  }
+
+  DmaNumberOfBytes = GENET_TX_BOUNCE_SIZE * GENET_DMA_DESC_COUNT;
+  Status = DmaMap (MapOperationBusMasterCommonBuffer,
+             Genet->TxBounceBuffer,
+             &DmaNumberOfBytes,
+             &Genet->TxBounceMap.PhysAddress,
+             &Genet->TxBounceMap.Mapping);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: Failed to map TX bounce buffer: %r\n", __FUNCTION__, Status));
+    goto FreeTxBounceBuffer;
   }
+
+  return EFI_SUCCESS;
+
+FreeTxBounceBuffer:
+  DmaFreeBuffer (EFI_SIZE_TO_PAGES (GENET_TX_BOUNCE_SIZE * GENET_DMA_DESC_COUNT),
+    Genet->TxBounceBuffer);
+  Genet->TxBounceBuffer = NULL;
+FreeRxBuffer:
+  gBS->FreePages (Genet->RxBuffer,
+         EFI_SIZE_TO_PAGES (GENET_MAX_PACKET_SIZE * GENET_DMA_DESC_COUNT));
+  Genet->RxBuffer = 0;
   return Status;
 }
 
 /**
-  Given an RX buffer descriptor index, program the IO address of the buffer into the hardware.
+  Map the whole RX buffer area for the hardware, and program the IO address
+  of each buffer into its RX descriptor.
 
-  @param  Genet[in]      Pointer to GENET_PRIVATE_DATA.
-  @param  DescIndex[in]  Index of RX buffer descriptor.
+  The buffers stay mapped while the interface is initialized: rather than
+  unmapping and remapping each buffer as frames are received, the cache lines
+  of a buffer are invalidated right before the frame in it is read.
 
-  @retval EFI_SUCCESS  DMA buffers allocated.
-  @retval Others       Programmatic errors, as buffers come from DmaAllocateBuffer, and thus
-                       cannot fail DmaMap (for the expected NonCoherentDmaLib).
+  @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
+
+  @retval EFI_SUCCESS  RX buffers mapped.
+  @retval Others       Programmatic errors, as buffers are allocated below the
+                       DMA limit, and thus cannot fail DmaMap (for the expected
+                       NonCoherentDmaLib).
 **/
 EFI_STATUS
-GenetDmaMapRxDescriptor (
-  IN GENET_PRIVATE_DATA * Genet,
-  IN UINT8                DescIndex
+GenetDmaMapRxBuffers (
+  IN GENET_PRIVATE_DATA * Genet
   )
 {
-  EFI_STATUS    Status;
-  UINTN         DmaNumberOfBytes;
+  EFI_STATUS            Status;
+  UINTN                 DmaNumberOfBytes;
+  UINTN                 Idx;
+  EFI_PHYSICAL_ADDRESS  PhysAddress;
 
-  ASSERT (Genet->RxBufferMap[DescIndex].Mapping == NULL);
+  ASSERT (Genet->RxBufferMap.Mapping == NULL);
   ASSERT (Genet->RxBuffer != 0);
 
-  DmaNumberOfBytes = GENET_MAX_PACKET_SIZE;
+  DmaNumberOfBytes = GENET_MAX_PACKET_SIZE * GENET_DMA_DESC_COUNT;
   Status = DmaMap (MapOperationBusMasterWrite,
-             GENET_RX_BUFFER (Genet, DescIndex),
+             (VOID *)(UINTN)Genet->RxBuffer,
              &DmaNumberOfBytes,
-             &Genet->RxBufferMap[DescIndex].PhysAddress,
-             &Genet->RxBufferMap[DescIndex].Mapping);
+             &Genet->RxBufferMap.PhysAddress,
+             &Genet->RxBufferMap.Mapping);
   if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "%a: Failed to map RX buffer: %r\n",
+    DEBUG ((DEBUG_ERROR, "%a: Failed to map RX buffers: %r\n",
       __FUNCTION__, Status));
     return Status;
   }
 
-  GenetMmioWrite (Genet, GENET_RX_DESC_ADDRESS_LO (DescIndex),
-    Genet->RxBufferMap[DescIndex].PhysAddress & 0xFFFFFFFF);
-  GenetMmioWrite (Genet, GENET_RX_DESC_ADDRESS_HI (DescIndex),
-    (Genet->RxBufferMap[DescIndex].PhysAddress >> 32) & 0xFFFFFFFF);
-  GenetMmioWrite (Genet, GENET_RX_DESC_STATUS (DescIndex), 0);
+  for (Idx = 0; Idx < GENET_DMA_DESC_COUNT; Idx++) {
+    PhysAddress = Genet->RxBufferMap.PhysAddress + GENET_MAX_PACKET_SIZE * Idx;
+    GenetMmioWrite (Genet, GENET_RX_DESC_ADDRESS_LO (Idx),
+      PhysAddress & 0xFFFFFFFF);
+    GenetMmioWrite (Genet, GENET_RX_DESC_ADDRESS_HI (Idx),
+      (PhysAddress >> 32) & 0xFFFFFFFF);
+    GenetMmioWrite (Genet, GENET_RX_DESC_STATUS (Idx), 0);
+  }
 
   return EFI_SUCCESS;
 }
 
 /**
-  Given an RX buffer descriptor index, undo the DmaMap operation on the buffer.
+  Undo the DmaMap operation on the RX buffers.
 
-  @param  Genet[in]      Pointer to GENET_PRIVATE_DATA.
-  @param  DescIndex[in]  Index of RX buffer descriptor.
+  @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
 
 **/
 VOID
-GenetDmaUnmapRxDescriptor (
-  IN GENET_PRIVATE_DATA * Genet,
-  IN UINT8                DescIndex
+GenetDmaUnmapRxBuffers (
+  IN GENET_PRIVATE_DATA * Genet
   )
 {
-  if (Genet->RxBufferMap[DescIndex].Mapping != NULL) {
-    DmaUnmap (Genet->RxBufferMap[DescIndex].Mapping);
-    Genet->RxBufferMap[DescIndex].Mapping = NULL;
+  if (Genet->RxBufferMap.Mapping != NULL) {
+    DmaUnmap (Genet->RxBufferMap.Mapping);
+    Genet->RxBufferMap.Mapping = NULL;
   }
 }
 
@@ -689,7 +749,6 @@ GenetDmaUnmapRxDescriptor (
   Free DMA buffers for RX, undoing GenetDmaAlloc.
 
   @param  Genet[in]      Pointer to GENET_PRIVATE_DATA.
-  @param  DescIndex[in]  Index of RX buffer descriptor.
 
 **/
 VOID
@@ -697,13 +756,13 @@ GenetDmaFree (
   IN GENET_PRIVATE_DATA *Genet
   )
 {
-  UINTN Idx;
-
-  for (Idx = 0; Idx < GENET_DMA_DESC_COUNT; Idx++) {
-    GenetDmaUnmapRxDescriptor (Genet, Idx);
-  }
+  GenetDmaUnmapRxBuffers (Genet);
   gBS->FreePages (Genet->RxBuffer,
          EFI_SIZE_TO_PAGES (GENET_MAX_PACKET_SIZE * GENET_DMA_DESC_COUNT));
+
+  DmaUnmap (Genet->TxBounceMap.Mapping);
+  DmaFreeBuffer (EFI_SIZE_TO_PAGES (GENET_TX_BOUNCE_SIZE * GENET_DMA_DESC_COUNT),
+    Genet->TxBounceBuffer);
 }
 
 /**
@@ -737,8 +796,68 @@ GenetDmaTriggerTx (
     (PhysAddr >> 32) & 0xFFFFFFFF);
   GenetMmioWrite (Genet, GENET_TX_DESC_STATUS (DescIndex), DescStatus);
 
-  GenetMmioWrite (Genet, GENET_TX_DMA_PROD_INDEX (GENET_DMA_DEFAULT_QUEUE),
-    Genet->TxProdIndex);
+  //
+  // Ring the doorbell right away if the hardware has finished the frames
+  // of the previous one. Otherwise, let frames queued back-to-back share a
+  // single producer index write, once the hardware catches up.
+  //
+  if (Genet->TxConsIndex == Genet->TxDoorbellIndex ||
+      ((Genet->TxProdIndex - Genet->TxDoorbellIndex) & 0xFFFF) >= GENET_TX_DOORBELL_BATCH) {
+    GenetDmaFlushTx (Genet);
+  }
+}
+
+/**
+  Hand the TX descriptors queued since the last doorbell write over to the
+  hardware.
+
+  @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
+
+**/
+VOID
+GenetDmaFlushTx (
+  IN GENET_PRIVATE_DATA *Genet
+  )
+{
+  if (Genet->TxDoorbellIndex != Genet->TxProdIndex) {
+    GenetMmioWrite (Genet, GENET_TX_DMA_PROD_INDEX (GENET_DMA_DEFAULT_QUEUE),
+      Genet->TxProdIndex);
+    Genet->TxDoorbellIndex = Genet->TxProdIndex;
+  }
+}
+
+/**
+  Reclaim the TX descriptors the hardware is done with, as per its consumer
+  index, moving their buffers over to the queue of buffers to recycle.
+
+  @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
+
+**/
+VOID
+GenetTxReclaim (
+  IN GENET_PRIVATE_DATA *Genet
+  )
+{
+  UINT32 Total;
+  UINT16 Slot;
+
+  Total = GenetTxPending (Genet);
+  while (Total-- > 0 && Genet->TxRecycleCount < GENET_DMA_DESC_COUNT) {
+    ASSERT (Genet->TxQueued > 0);
+
+    if (Genet->TxBufferMap[Genet->TxNext] != NULL) {
+      DmaUnmap (Genet->TxBufferMap[Genet->TxNext]);
+      Genet->TxBufferMap[Genet->TxNext] = NULL;
+    }
+
+    Slot = (Genet->TxRecycleNext + Genet->TxRecycleCount) % GENET_DMA_DESC_COUNT;
+    Genet->TxRecycle[Slot] = Genet->TxBuffer[Genet->TxNext];
+    Genet->TxRecycleCount++;
+
+    Genet->TxQueued--;
+    Genet->TxNext = (Genet->TxNext + 1) % GENET_DMA_DESC_COUNT;
+    Genet->TxConsIndex = (Genet->TxConsIndex + 1) & 0xFFFF;
+  }
 }
 
 /**
@@ -754,35 +873,35 @@ GenetTxIntr (
   OUT VOID               **TxBuf
   )
 {
-  UINT32 Total;
+  GenetTxReclaim (Genet);
 
-  Total = GenetTxPending (Genet);
-  if (Genet->TxQueued > 0 && Total > 0) {
-    DmaUnmap (Genet->TxBufferMap[Genet->TxNext]);
-    *TxBuf = Genet->TxBuffer[Genet->TxNext];
-    Genet->TxQueued--;
-    Genet->TxNext = (Genet->TxNext + 1) % GENET_DMA_DESC_COUNT;
-    Genet->TxConsIndex = (Genet->TxConsIndex + 1) & 0xFFFF;
+  if (Genet->TxRecycleCount > 0) {
+    *TxBuf = Genet->TxRecycle[Genet->TxRecycleNext];
+    Genet->TxRecycleNext = (Genet->TxRecycleNext + 1) % GENET_DMA_DESC_COUNT;
+    Genet->TxRecycleCount--;
   } else {
     *TxBuf = NULL;
   }
 }
 
+/**
+  Harvest the RX descriptors the hardware has completed, by taking a snapshot
+  of the producer index. All frames received up to that point can then be
+  consumed without going back to the hardware.
+
+  @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
+
+  @retval Number of received frames not yet consumed.
+
+**/
 UINT32
 GenetRxPending (
   IN  GENET_PRIVATE_DATA *Genet
   )
 {
-  UINT32 ProdIndex;
-  UINT32 ConsIndex;
-
-  ConsIndex = GenetMmioRead (Genet,
-                GENET_RX_DMA_CONS_INDEX (GENET_DMA_DEFAULT_QUEUE)) & 0xFFFF;
-  ASSERT (ConsIndex == Genet->RxConsIndex);
-
-  ProdIndex = GenetMmioRead (Genet,
-                GENET_RX_DMA_PROD_INDEX (GENET_DMA_DEFAULT_QUEUE)) & 0xFFFF;
-  return (ProdIndex - Genet->RxConsIndex) & 0xFFFF;
+  Genet->RxProdIndex = GenetMmioRead (Genet,
+                         GENET_RX_DMA_PROD_INDEX (GENET_DMA_DEFAULT_QUEUE)) & 0xFFFF;
+  return (Genet->RxProdIndex - Genet->RxConsIndex) & 0xFFFF;
 }
 
 UINT32
@@ -798,14 +917,27 @@ GenetTxPending (
   return (ConsIndex - Genet->TxConsIndex) & 0xFFFF;
 }
 
+/**
+  Consume the RX descriptor returned by GenetRxIntr.
+
+  Descriptors are given back to the hardware once all harvested frames have
+  been consumed, or every GENET_RX_RELEASE_BATCH frames, rather than one
+  consumer index update per frame.
+
+  @param  Genet[in]  Pointer to GENET_PRIVATE_DATA.
+
+**/
 VOID
 GenetRxComplete (
   IN GENET_PRIVATE_DATA *Genet
   )
 {
   Genet->RxConsIndex = (Genet->RxConsIndex + 1) & 0xFFFF;
-  GenetMmioWrite (Genet, GENET_RX_DMA_CONS_INDEX (GENET_DMA_DEFAULT_QUEUE),
-                  Genet->RxConsIndex);
+  if (Genet->RxConsIndex == Genet->RxProdIndex ||
+      (Genet->RxConsIndex % GENET_RX_RELEASE_BATCH) == 0) {
+    GenetMmioWrite (Genet, GENET_RX_DMA_CONS_INDEX (GENET_DMA_DEFAULT_QUEUE),
+                    Genet->RxConsIndex);
+  }
 }
 
 /**
@@ -816,6 +948,9 @@ GenetRxComplete (
   @param  DescIndex[out]    Location to store completed RX buffer index.
   @param  FrameLength[out]  Location to store frame length.
 
+  The frame is made visible to the CPU, so that it can be read from
+  GENET_RX_BUFFER (Genet, *DescIndex) until GenetRxComplete is called.
+
   @retval EFI_SUCCESS    Data received.
   @retval EFI_NOT_READY  No RX buffers ready as no data received.
 
@@ -831,11 +966,21 @@ GenetRxIntr (
   UINT32        Total;
   UINT32        DescStatus;
 
-  Total = GenetRxPending (Genet);
+  Total = (Genet->RxProdIndex - Genet->RxConsIndex) & 0xFFFF;
+  if (Total == 0) {
+    Total = GenetRxPending (Genet);
+  }
+
   if (Total > 0) {
     *DescIndex = Genet->RxConsIndex % GENET_DMA_DESC_COUNT;
     DescStatus = GenetMmioRead (Genet, GENET_RX_DESC_STATUS (*DescIndex));
     *FrameLength = SHIFTOUT (DescStatus, GENET_RX_DESC_STATUS_BUFLEN);
+    //
+    // The RX buffers are never written by the CPU, so there are no dirty
+    // lines to lose, only stale or speculatively fetched ones to drop.
+    //
+    InvalidateDataCacheRange (GENET_RX_BUFFER (Genet, *DescIndex),
+      MIN (*FrameLength, GENET_MAX_PACKET_SIZE));
     Status = EFI_SUCCESS;
   } else {
     Status = EFI_NOT_READY;
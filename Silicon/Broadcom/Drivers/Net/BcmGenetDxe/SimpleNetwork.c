@@ -131,7 +131,6 @@ GenetSimpleNetworkInitialize (
 {
   GENET_PRIVATE_DATA  *Genet;
   EFI_STATUS          Status;
-  UINTN               Idx;
 
   if (This == NULL) {
     return EFI_INVALID_PARAMETER;
@@ -157,11 +156,9 @@ GenetSimpleNetworkInitialize (
   GenetDmaInitRings (Genet);
 
   // Map RX buffers
-  for (Idx = 0; Idx < GENET_DMA_DESC_COUNT; Idx++) {
-    Status = GenetDmaMapRxDescriptor (Genet, Idx);
-    if (EFI_ERROR (Status)) {
-      return Status;
-    }
+  Status = GenetDmaMapRxBuffers (Genet);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
   GenetEnableTxRx (Genet);
@@ -239,7 +236,6 @@ GenetSimpleNetworkShutdown (
   )
 {
   GENET_PRIVATE_DATA  *Genet;
-  UINTN               Idx;
 
   if (This == NULL) {
     return EFI_INVALID_PARAMETER;
@@ -255,9 +251,7 @@ GenetSimpleNetworkShutdown (
 
   GenetDisableTxRx (Genet);
 
-  for (Idx = 0; Idx < GENET_DMA_DESC_COUNT; Idx++) {
-    GenetDmaUnmapRxDescriptor (Genet, Idx);
-  }
+  GenetDmaUnmapRxBuffers (Genet);
 
   Genet->SnpMode.State = EfiSimpleNetworkStarted;
 
@@ -505,6 +499,19 @@ GenetSimpleNetworkGetStatus (
     Genet->SnpMode.MediaPresent = TRUE;
   }
 
+  Status = EfiAcquireLockOrFail (&Genet->Lock);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: Couldn't get lock: %r\n", __FUNCTION__, Status));
+    return EFI_ACCESS_DENIED;
+  }
+
+  //
+  // Polling for completions is the point where any frames queued without a
+  // doorbell write must be handed over to the hardware.
+  //
+  GenetDmaFlushTx (Genet);
+  GenetTxReclaim (Genet);
+
   if (TxBuf != NULL) {
     GenetTxIntr (Genet, TxBuf);
   }
@@ -514,11 +521,13 @@ GenetSimpleNetworkGetStatus (
     if (GenetRxPending (Genet) > 0) {
       *InterruptStatus |= EFI_SIMPLE_NETWORK_RECEIVE_INTERRUPT;
     }
-    if (GenetTxPending (Genet) > 0) {
+    if (Genet->TxRecycleCount > 0 || GenetTxPending (Genet) > 0) {
       *InterruptStatus |= EFI_SIMPLE_NETWORK_TRANSMIT_INTERRUPT;
     }
   }
 
+  EfiReleaseLock (&Genet->Lock);
+
   return EFI_SUCCESS;
 }
 
@@ -642,7 +651,14 @@ GenetSimpleNetworkTransmit (
     return EFI_ACCESS_DENIED;
   }
 
+  //
+  // Reclaim whatever the hardware has sent since the last call, so the ring
+  // doesn't fill up when the caller is slow to poll GetStatus ().
+  //
+  GenetTxReclaim (Genet);
+
   if (Genet->TxQueued == GENET_DMA_DESC_COUNT - 1) {
+    GenetDmaFlushTx (Genet);
     EfiReleaseLock (&Genet->Lock);
 
     DEBUG ((DEBUG_ERROR, "%a: Queue full\n", __FUNCTION__));
@@ -660,16 +676,27 @@ GenetSimpleNetworkTransmit (
 
   Genet->TxBuffer[Desc] = Frame;
 
-  DmaNumberOfBytes = BufferSize;
-  Status = DmaMap (MapOperationBusMasterRead,
-                   (VOID *)(UINTN)Frame,
-                   &DmaNumberOfBytes,
-                   &DmaDeviceAddress,
-                   &Genet->TxBufferMap[Desc]);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "%a: DmaMap failed: %r\n", __FUNCTION__, Status));
-    EfiReleaseLock (&Genet->Lock);
-    return Status;
+  if (BufferSize <= GENET_TX_BOUNCE_SIZE) {
+    //
+    // Small frames go through the descriptor's slot in the bounce buffer,
+    // which is always mapped.
+    //
+    CopyMem (GENET_TX_BOUNCE_BUFFER (Genet, Desc), Frame, BufferSize);
+    Genet->TxBufferMap[Desc] = NULL;
+    DmaDeviceAddress = Genet->TxBounceMap.PhysAddress + GENET_TX_BOUNCE_SIZE * Desc;
+    DmaNumberOfBytes = BufferSize;
+  } else {
+    DmaNumberOfBytes = BufferSize;
+    Status = DmaMap (MapOperationBusMasterRead,
+                     (VOID *)(UINTN)Frame,
+                     &DmaNumberOfBytes,
+                     &DmaDeviceAddress,
+                     &Genet->TxBufferMap[Desc]);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: DmaMap failed: %r\n", __FUNCTION__, Status));
+      EfiReleaseLock (&Genet->Lock);
+      return Status;
+    }
   }
 
   Genet->TxProdIndex = (Genet->TxProdIndex + 1) & 0xFFFF;
@@ -754,15 +781,15 @@ GenetSimpleNetworkReceive (
     return EFI_ACCESS_DENIED;
   }
 
+  GenetDmaFlushTx (Genet);
+
   Status = GenetRxIntr (Genet, &DescIndex, &FrameLength);
   if (EFI_ERROR (Status)) {
     EfiReleaseLock (&Genet->Lock);
     return Status;
   }
 
-  ASSERT (Genet->RxBufferMap[DescIndex].Mapping != NULL);
-
-  GenetDmaUnmapRxDescriptor (Genet, DescIndex);
+  ASSERT (Genet->RxBufferMap.Mapping != NULL);
 
   Frame = GENET_RX_BUFFER (Genet, DescIndex);
 
@@ -803,11 +830,6 @@ GenetSimpleNetworkReceive (
   }
 
 out:
-  Status = GenetDmaMapRxDescriptor (Genet, DescIndex);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "%a: Failed to remap RX descriptor!\n", __FUNCTION__));
-  }
-
   GenetRxComplete (Genet);
 
   EfiReleaseLock (&Genet->Lock);